@@ -1,98 +1,94 @@
 #pragma once
 
+#include <bit>
 #include <cassert>
+#include <cstdlib>
 #include <map>
-#include <sstream>
+#include <optional>
 #include <stack>
 #include <string>
 #include <vector>
 
 #include "ir_generator.hpp"
+#include "instruction_selector.hpp"
+#include "ir_optimizer.hpp"
+#include "peephole_optimizer.hpp"
+#include "register_allocator.hpp"
 
-class ASMGenerator {
-public:
-    explicit ASMGenerator(std::vector<TACInstruction> &instructions) : instructions(std::move(instructions)) {
-    }
+enum class VectorISA {
+    sse2, avx2
+};
 
-    void assign_variable(const std::string &ident, const std::string &value) {
-        if (ident[0] == '#') {
-            asm_push_stack(value);
-        } else {
-            const bool reassignment = stack_vars.contains(ident);
-            load_stack_var(value, RAX);
+//What the entry at a loop header expects rdi to point to: the heap top, then the heap top saved by every enclosing
+//scope allocating arrays, given by the index of its bgn_scope, then the values live at the header
+struct OSRLayout {
+    std::vector<size_t> scopes;
+    std::vector<std::string> values;
+};
 
-            if (reassignment) {
-                asm_mov_reg(get_var_pointer(ident), RAX);
-            } else {
-                stack_vars.try_emplace(ident, stack_size);
-                asm_push_stack(RAX);
-            }
-        }
+class ASMGenerator {
+public:
+    explicit ASMGenerator(std::vector<TACInstruction> &instructions, const VectorISA vector_isa = VectorISA::sse2) :
+            vector_isa(vector_isa), instructions(std::move(instructions)) {
     }
 
     void generate_expression(const TACInstruction &instr) {
-        load_stack_var(instr.arg1.value(), RAX);
-        if (instr.arg2.has_value())
-            load_stack_var(instr.arg2.value(), RBX);
-
-        std::string result_reg = RAX;
+        const std::string result = operand(instr.result.value());
+        const std::string lhs = operand(instr.arg1.value());
 
         switch (instr.op) {
             case OperationType::add:
-                asm_add(RAX, RBX);
+                generate_add(result, lhs, operand(instr.arg2.value()));
                 break;
             case OperationType::multiply:
-                asm_multiply(RBX);
+                generate_multiply(result, lhs, operand(instr.arg2.value()));
                 break;
             case OperationType::subtract:
-                asm_substract(RAX, RBX);
+                if (const std::string rhs = operand(instr.arg2.value()); is_imm(rhs) && rhs != "-2147483648") {
+                    generate_add(result, lhs, std::to_string(-std::stoll(rhs)));
+                } else {
+                    asm_binary("sub", result, lhs, rhs);
+                }
                 break;
             case OperationType::divide:
-                asm_divide(RBX);
+                asm_mov_reg(RAX, lhs);
+                asm_divide(rhs_operand(operand(instr.arg2.value()), false));
+                asm_move(result, RAX);
                 break;
             case OperationType::modulo:
-                asm_divide(RBX);
-                result_reg = RDX;
+                asm_mov_reg(RAX, lhs);
+                asm_divide(rhs_operand(operand(instr.arg2.value()), false));
+                asm_move(result, RDX);
                 break;
             case OperationType::is_equal:
-                asm_cmp(RAX, RBX);
-                asm_set_equal();
-                break;
             case OperationType::not_equal:
-                asm_cmp(RAX, RBX);
-                asm_set_not_equal();
-                break;
             case OperationType::is_greater:
-                asm_cmp(RAX, RBX);
-                asm_set_greater();
-                break;
             case OperationType::is_less:
-                asm_cmp(RAX, RBX);
-                asm_set_less();
-                break;
             case OperationType::is_greater_equal:
-                asm_cmp(RAX, RBX);
-                asm_set_greater_equal();
-                break;
-            case OperationType::is_less_equal:
-                asm_cmp(RAX, RBX);
-                asm_set_less_equal();
+            case OperationType::is_less_equal: {
+                //Only the lowest byte is replaced by the result, like a setcc into the left operand
+                const std::string rhs = rhs_operand(operand(instr.arg2.value()));
+                const std::string dest = is_reg(result) ? result : RAX;
+                asm_move(dest, lhs);
+                asm_cmp(dest, rhs);
+                asm_set_cond(condition_codes.at(instr.op), low_bytes.at(dest));
+                asm_move(result, dest);
                 break;
+            }
             case OperationType::log_and:
-                asm_logical_and(RAX, RBX);
+                asm_binary("and", result, lhs, operand(instr.arg2.value()));
                 break;
             case OperationType::log_or:
-                asm_logical_or(RAX, RBX);
+                asm_binary("or", result, lhs, operand(instr.arg2.value()));
                 break;
             case OperationType::log_not:
-                asm_logical_not(RAX);
+                asm_move(result, lhs);
+                asm_logical_not(result);
                 break;
 
             default:
                 assert(false);
         }
-
-        asm_push_stack(result_reg);
     }
 
     void generate_instruction(const TACInstruction &instr) {
@@ -106,34 +102,53 @@ public:
                 break;
             }
             case OperationType::jump_false: {
-                load_stack_var(instr.arg1.value(), RAX);
-                asm_test(RAX);
+                std::string cond = operand(instr.arg1.value());
+                if (!is_reg(cond)) {
+                    asm_mov_reg(RAX, cond);
+                    cond = RAX;
+                }
+                asm_test(low_bytes.at(cond));
                 asm_jump_zero(instr.arg2.value());
                 break;
             }
             case OperationType::assign: {
-                assign_variable(instr.result.value(), instr.arg1.value());
+                //Constants are rematerialized at every use instead
+                if (locations.at(instr.result.value()).kind == Location::Kind::constant) break;
+
+                if (const auto update = folded_def(instr.arg1.value()); update.has_value()) {
+                    generate_in_place(operand(instr.result.value()), instructions[update.value()]);
+                    break;
+                }
+
+                asm_move(operand(instr.result.value()), operand(instr.arg1.value()));
+                break;
+            }
+            case OperationType::cond_assign: {
+                asm_mov_reg(RAX, operand(instr.arg1.value()));
+                asm_test(low_bytes.at(RAX));
+                generate_cmov("nz", instr);
                 break;
             }
             case OperationType::prog_exit: {
-                load_stack_var(instr.arg1.value(), RDI);
+                asm_mov_reg(RDI, operand(instr.arg1.value()));
                 asm_exit();
                 break;
             }
             case OperationType::print_int: {
-                load_stack_var(instr.arg1.value(), RAX);
+                asm_mov_reg(RAX, operand(instr.arg1.value()));
                 asm_print_int();
                 break;
             }
             case OperationType::print_char: {
-                load_stack_var(instr.arg1.value(), RAX);
-                asm_push_stack(RAX);
-                asm_print_char("[rsp]");
-                asm_pop_stack(RAX);
+                asm_mov_reg(RAX, operand(instr.arg1.value()));
+                asm_print_char();
                 break;
             }
             case OperationType::read_char: {
-                asm_read_char();
+                asm_mov_reg(frame_slot(io_slot), "0");
+                asm_read_char(frame_address(io_slot));
+                asm_mov_reg(RAX, frame_slot(io_slot));
+                asm_move(operand(instr.result.value()), RAX);
                 break;
             }
             case OperationType::bgn_scope: {
@@ -145,41 +160,138 @@ public:
                 break;
             }
             case OperationType::array_allocate: {
-                size_t loc = heap_pointers.top();
-                const std::string offset = get_loc_offset(loc);
-                asm_mov_reg(RDI, offset);
-                load_stack_var(instr.arg1.value(), RAX);
-                asm_mov_reg(RBX, "8");
-                asm_multiply(RBX);
-                asm_add(RDI, RAX);
+                //Arrays are carved from the top of the heap, the old top is where the new array starts
+                asm_mov_reg(RAX, operand(instr.arg1.value()));
+                asm_array_bytes(RAX, instr.element);
+                asm_mov_reg(RDX, frame_slot(heap_top_slot));
+                asm_lea(RDI, "[rdx + rax]");
+                asm_mov_reg(frame_slot(heap_top_slot), RDI);
                 asm_alloc_mem();
 
-                stack_vars.try_emplace(instr.result.value(), loc);
-                heap_pointers.push(stack_size);
-                asm_push_stack(RAX);
+                //Memory given back at the end of a scope is handed out again, so the elements have to be cleared
+                asm_mov_reg(RDI, RDX);
+                asm_mov_reg(RCX, frame_slot(heap_top_slot));
+                emit("sub", {RCX, RDX});
+                asm_shift_right(RCX, "3");
+                asm_mov_reg(RAX, "0");
+                asm_call("_fill_qwords");
+                asm_move(operand(instr.result.value()), RDX);
 
                 break;
             }
-            case OperationType::array_assign: {
-                load_stack_var(instr.result.value(), RBX);
-                load_stack_var(instr.arg1.value(), RAX);
-                asm_mov_reg(RCX, "8");
-                asm_multiply(RCX);
-                asm_add(RAX, RBX);
-                load_stack_var(instr.arg2.value(), RBX);
-                asm_mov_reg("QWORD [RAX]", RBX);
+            case OperationType::array_stack:
+            case OperationType::array_static: {
+                const std::string array = operand(instr.result.value());
+                const std::string dest = is_reg(array) ? array : RAX;
+                if (instr.op == OperationType::array_stack) {
+                    //The arrays of the frame are at its bottom
+                    asm_lea(dest, "[rbp - " + std::to_string(frame_size - stack_array_offsets.at(current_index)) + "]");
+                } else {
+                    const std::string label = "array_bss_" + std::to_string(bss_out.size() / 2);
+                    bss_out.push_back({AsmInstruction::Kind::label, label});
+                    bss_out.push_back({AsmInstruction::Kind::instruction, "resq",
+                                       {std::to_string(array_bytes(instr.element, std::stoll(instr.arg1.value())) / 8)}});
+                    asm_mov_reg(dest, label);
+                }
+                asm_move(array, dest);
+                asm_clear_array(instr.result.value(), array_bytes(instr.element, std::stoll(instr.arg1.value())) / 8);
 
                 break;
             }
+            case OperationType::array_assign: {
+                if (instr.element == ElementType::boolean) {
+                    generate_bit_assign(instr);
+                    break;
+                }
+
+                const int bytes = element_bits(instr.element) / 8;
+                std::string value = operand(instr.arg2.value());
+                if (is_imm(value)) {
+                    value = std::to_string(element_value(instr.element, std::stoll(value)));
+                }
+                if (is_mem(value) || (is_imm(value) && !fits_imm32(value))) {
+                    asm_mov_reg(RAX, value);
+                    value = RAX;
+                }
+                if (is_reg(value)) value = sub_register(value, bytes);
+
+                asm_mov_reg(element_operand(instr.result.value(), instr.arg1.value(), instr.element), value);
+                break;
+            }
             case OperationType::array_get: {
-                load_stack_var(instr.arg1.value(), RBX);
-                load_stack_var(instr.arg2.value(), RAX);
-                asm_mov_reg(RCX, "8");
-                asm_multiply(RCX);
-                asm_add(RAX, RBX);
-                asm_mov_reg(RBX, "QWORD [RAX]");
-                asm_push_stack(RBX);
+                if (instr.element == ElementType::boolean) {
+                    generate_bit_get(instr);
+                    break;
+                }
+
+                const std::string result = operand(instr.result.value());
+                const std::string dest = is_reg(result) ? result : RAX;
 
+                emit(load_instructions.at(instr.element),
+                     {dest, element_operand(instr.arg1.value(), instr.arg2.value(), instr.element)});
+                asm_move(result, dest);
+                break;
+            }
+            case OperationType::array_fill: {
+                asm_parallel_move({instr.result.value(), instr.arg1.value(), instr.arg2.value(), instr.arg3.value()},
+                                  {RDI, RDX, RCX, RAX});
+                if (instr.element == ElementType::int64) {
+                    asm_lea(RDI, "[rdi + rdx*8]");
+                    asm_call("_fill_qwords");
+                    break;
+                }
+
+                //The value repeated over a whole qword, filled byte by byte
+                const int bytes = element_bits(instr.element) / 8;
+                asm_byte_range(bytes);
+                if (bytes == 4) {
+                    asm_mov_reg("eax", "eax");
+                } else {
+                    emit("movzx", {RAX, sub_register(RAX, bytes)});
+                }
+                asm_mov_reg(RDX, repeat_patterns.at(bytes));
+                emit("imul", {RAX, RDX});
+                asm_call("_fill_bytes");
+
+                break;
+            }
+            case OperationType::array_copy: {
+                asm_parallel_move({instr.result.value(), instr.arg3.value(), instr.arg1.value(), instr.arg2.value()},
+                                  {RDI, RSI, RDX, RCX});
+                if (instr.element == ElementType::int64) {
+                    asm_lea(RDI, "[rdi + rdx*8]");
+                    asm_lea(RSI, "[rsi + rdx*8]");
+                    asm_call("_copy_qwords");
+                    break;
+                }
+
+                const int bytes = element_bits(instr.element) / 8;
+                asm_lea(RSI, "[rsi + rdx" + scale(bytes) + "]");
+                asm_byte_range(bytes);
+                asm_call("_copy_bytes");
+
+                break;
+            }
+            case OperationType::print_array: {
+                asm_parallel_move({instr.arg3.value(), instr.arg1.value(), instr.arg2.value()}, {RSI, RDX, RCX});
+                if (instr.element == ElementType::int64) {
+                    asm_lea(RSI, "[rsi + rdx*8]");
+                    asm_call("_print_chars");
+                    break;
+                }
+
+                //Bytes are already laid out the way they're printed
+                asm_lea(RSI, "[rsi + rdx]");
+                asm_call("_print_bytes");
+
+                break;
+            }
+            case OperationType::vectorize: {
+                //Only a hint, the loop that follows stays a valid scalar loop
+                break;
+            }
+            case OperationType::bounds_check: {
+                generate_bounds_check(instr);
                 break;
             }
 
@@ -188,18 +300,498 @@ public:
         }
     }
 
-    [[nodiscard]] std::string generate_program() {
+    static bool is_fusable_compare(const TACInstruction &instr, const TACInstruction &next) {
+        //Comparison results are temporaries used exactly once, so if the next instruction is the branch consuming
+        //it, the boolean never has to be materialized
+        return condition_codes.contains(instr.op) && (next.op == OperationType::jump_false ||
+                                                      next.op == OperationType::cond_assign) &&
+               next.arg1 == instr.result;
+    }
+
+    void generate_compare(const TACInstruction &compare) {
+        std::string lhs = operand(compare.arg1.value());
+        const std::string rhs = rhs_operand(operand(compare.arg2.value()));
+
+        if (is_imm(lhs) || (is_mem(lhs) && is_mem(rhs))) {
+            asm_mov_reg(RAX, lhs);
+            lhs = RAX;
+        }
+        asm_cmp(lhs, rhs);
+    }
+
+    void generate_compare_branch(const TACInstruction &compare, const TACInstruction &branch) {
+        generate_compare(compare);
+        asm_jump_cond(inverted_condition_codes.at(compare.op), branch.arg2.value());
+    }
+
+    void generate_compare_select(const TACInstruction &compare, const TACInstruction &select) {
+        generate_compare(compare);
+        generate_cmov(condition_codes.at(compare.op), select);
+    }
+
+    //A negative index compares as a huge unsigned one, so a single unsigned comparison covers both ends
+    void generate_bounds_check(const TACInstruction &instr) {
+        const std::string fail = "bounds_error_" + std::to_string(bounds_errors.size());
+        bounds_errors.push_back(instr.arg3.value());
+
+        std::string lhs = operand(instr.arg1.value());
+        std::string rhs = operand(instr.arg2.value());
+        std::string cond = "ae";
+        if (is_imm(lhs)) {
+            std::swap(lhs, rhs);
+            cond = "be";
+        }
+
+        rhs = rhs_operand(rhs);
+        if (is_imm(lhs) || (is_mem(lhs) && is_mem(rhs))) {
+            asm_mov_reg(RAX, lhs);
+            lhs = RAX;
+        }
+        asm_cmp(lhs, rhs);
+        asm_jump_cond(cond, fail);
+    }
+
+    //Failed checks are out of the way of the code falling through them
+    void generate_bounds_errors() {
+        for (size_t i = 0; i < bounds_errors.size(); i++) {
+            asm_label("bounds_error_" + std::to_string(i));
+            asm_mov_reg(RDI, bounds_errors[i]);
+            asm_call("_bounds_error");
+        }
+    }
+
+    //Neither mov nor cmov touch the flags, so the condition can be set up before loading the operands
+    void generate_cmov(const std::string &cond, const TACInstruction &select) {
+        const std::string result = operand(select.result.value());
+        std::string value = operand(select.arg2.value());
+
+        if (is_imm(value)) {
+            asm_mov_reg(RDX, value);
+            value = RDX;
+        }
+
+        if (is_reg(result)) {
+            asm_cmov(cond, result, value);
+        } else {
+            asm_mov_reg(RAX, result);
+            asm_cmov(cond, RAX, value);
+            asm_mov_reg(result, RAX);
+        }
+    }
+
+    void generate_jump_table(const TACInstruction &instr, const std::vector<std::string> &entries) {
+        const std::string table = "jump_table_" + std::to_string(jump_table_counter++);
+
+        asm_mov_reg(RAX, operand(instr.arg1.value()));
+        asm_cmp(RAX, std::to_string(entries.size() - 1));
+        asm_jump_cond("a", instr.arg2.value());
+        asm_jump("QWORD [" + table + " + rax*8]");
+
+        data_out.push_back({AsmInstruction::Kind::label, table});
+        for (const std::string &entry: entries) {
+            data_out.push_back({AsmInstruction::Kind::instruction, "dq", {entry}});
+        }
+    }
+
+    //Short initializers are stored as immediates, longer ones copied from the read-only data
+    void generate_array_data(const TACInstruction &instr, const std::vector<int64_t> &words) {
+        if (instr.op == OperationType::array_init && words.size() <= RegisterAllocator::max_inline_init_qwords) {
+            const std::string base = pointer_register(instr.result.value());
+            for (size_t i = 0; i < words.size(); i++) {
+                std::string word = std::to_string(words[i]);
+                if (!fits_imm32(word)) {
+                    asm_mov_reg(RAX, word);
+                    word = RAX;
+                }
+                asm_mov_reg("QWORD [" + base + " + " + std::to_string(i * 8) + "]", word);
+            }
+            return;
+        }
+
+        const std::string data = "array_data_" + std::to_string(array_data_counter++);
+        const std::string array = operand(instr.result.value());
+        if (instr.op == OperationType::array_init) {
+            asm_move(RDI, array);
+            asm_mov_reg(RSI, data);
+            asm_mov_reg(RCX, std::to_string(words.size()));
+            asm_call("_copy_qwords");
+        } else if (is_reg(array)) {
+            asm_mov_reg(array, data);
+        } else {
+            asm_mov_reg(RAX, data);
+            asm_mov_reg(array, RAX);
+        }
+
+        data_out.push_back({AsmInstruction::Kind::label, data});
+        for (const int64_t word: words) {
+            data_out.push_back({AsmInstruction::Kind::instruction, "dq", {std::to_string(word)}});
+        }
+    }
+
+    //The whole text is written by a single system call, straight from the read-only data
+    void generate_print_string(const std::vector<long long> &values) {
+        const std::string data = "array_data_" + std::to_string(array_data_counter++);
+        asm_mov_reg(RSI, data);
+        asm_mov_reg(RCX, std::to_string(values.size()));
+        asm_call("_print_bytes");
+
+        data_out.push_back({AsmInstruction::Kind::label, data});
+        for (const int64_t word: pack_elements(ElementType::character, values)) {
+            data_out.push_back({AsmInstruction::Kind::instruction, "dq", {std::to_string(word)}});
+        }
+    }
+
+    /*
+     * Emits a loop processing whole vectors of elements in front of the scalar loop, which then runs only the
+     * leftover iterations. Registers: rcx - counter, rdx - end, rsi/r8 - sources, rdi - destination,
+     * r9/r10 - values to broadcast. The allocated registers among them are saved around the loop.
+     */
+    void generate_vector_loop(const CountedLoop &loop, const VectorLoop &vector_loop) {
+        const bool avx2 = vector_isa == VectorISA::avx2;
+
+        //Without AVX2 there is no 64-bit signed comparison to build these from
+        if (!avx2 && (vector_loop.kind == VectorKind::min || vector_loop.kind == VectorKind::max ||
+                      (vector_loop.kind == VectorKind::count && vector_loop.op != OperationType::is_equal))) {
+            return;
+        }
+
+        const std::string id = std::to_string(vector_loop_counter++);
+        const std::string loop_label = "vector_loop_" + id;
+        const std::string end_label = "vector_end_" + id;
+        const std::string width = std::to_string(avx2 ? 4 : 2);
+
+        const std::vector<std::string> saved_regs = {RCX, RSI, RDI, R8, R9, R10};
+        for (const std::string &reg: saved_regs) {
+            asm_push(reg);
+        }
+
+        std::vector<std::string> values = {loop.counter, loop.bound};
+        std::vector<std::string> regs = {RCX, RDX};
+        switch (vector_loop.kind) {
+            case VectorKind::sum:
+                values.push_back(vector_loop.array);
+                regs.push_back(RSI);
+                break;
+            case VectorKind::count:
+                values.insert(values.end(), {vector_loop.array, vector_loop.rhs});
+                regs.insert(regs.end(), {RSI, R10});
+                break;
+            case VectorKind::min:
+            case VectorKind::max:
+                values.insert(values.end(), {vector_loop.array, vector_loop.accumulator});
+                regs.insert(regs.end(), {RSI, R10});
+                break;
+            case VectorKind::map:
+                values.insert(values.end(), {vector_loop.dest, vector_loop.lhs, vector_loop.rhs});
+                regs.insert(regs.end(), {RDI, vector_loop.lhs_array ? RSI : R9, vector_loop.rhs_array ? R8 : R10});
+                break;
+        }
+        asm_parallel_move(values, regs);
+        if (loop.inclusive) asm_add(RDX, "1");
+
+        switch (vector_loop.kind) {
+            case VectorKind::sum:
+            case VectorKind::count:
+                asm_vector("pxor", vreg(0), vreg(0));
+                if (vector_loop.kind == VectorKind::count) asm_vector_broadcast(vreg(2), R10);
+                break;
+            case VectorKind::min:
+            case VectorKind::max:
+                asm_vector_broadcast(vreg(0), R10);
+                break;
+            case VectorKind::map:
+                if (!vector_loop.lhs_array) asm_vector_broadcast(vreg(2), R9);
+                if (!vector_loop.rhs_array) asm_vector_broadcast(vreg(3), R10);
+                break;
+        }
+
+        asm_label(loop_label);
+        asm_lea(RAX, "[rcx + " + width + "]");
+        asm_cmp(RAX, RDX);
+        asm_jump_cond("g", end_label);
+
+        switch (vector_loop.kind) {
+            case VectorKind::sum:
+                asm_vector_move(vreg(1), "[rsi + rcx*8]");
+                asm_vector("paddq", vreg(0), vreg(1));
+                break;
+            case VectorKind::count:
+                asm_vector_move(vreg(1), "[rsi + rcx*8]");
+                if (vector_loop.op == OperationType::is_greater) {
+                    asm_vector("pcmpgtq", vreg(1), vreg(2));
+                } else if (vector_loop.op == OperationType::is_less) {
+                    asm_vector("pcmpgtq", vreg(1), vreg(2), vreg(1));
+                } else if (avx2) {
+                    asm_vector("pcmpeqq", vreg(1), vreg(2));
+                } else {
+                    //Both halves of a quadword have to be equal
+                    asm_vector("pcmpeqd", vreg(1), vreg(2));
+                    emit("pshufd", {"xmm3", "xmm1", "0xB1"});
+                    asm_vector("pand", vreg(1), vreg(3));
+                }
+                //Matching lanes are -1
+                asm_vector("psubq", vreg(0), vreg(1));
+                break;
+            case VectorKind::min:
+            case VectorKind::max:
+                asm_vector_move(vreg(1), "[rsi + rcx*8]");
+                if (vector_loop.kind == VectorKind::max) {
+                    asm_vector("pcmpgtq", vreg(2), vreg(1), vreg(0));
+                } else {
+                    asm_vector("pcmpgtq", vreg(2), vreg(0), vreg(1));
+                }
+                emit("vblendvpd", {"ymm0", "ymm0", "ymm1", "ymm2"});
+                break;
+            case VectorKind::map: {
+                if (vector_loop.lhs_array) {
+                    asm_vector_move(vreg(0), "[rsi + rcx*8]");
+                } else {
+                    asm_vector_move(vreg(0), vreg(2));
+                }
+
+                std::string rhs = vreg(3);
+                if (vector_loop.rhs_array) {
+                    asm_vector_move(vreg(1), "[r8 + rcx*8]");
+                    rhs = vreg(1);
+                }
+
+                asm_vector(vector_map_ops.at(vector_loop.op), vreg(0), rhs);
+                asm_vector_move("[rdi + rcx*8]", vreg(0));
+                break;
+            }
+        }
+
+        asm_mov_reg(RCX, RAX);
+        asm_jump(loop_label);
+        asm_label(end_label);
+
+        //Reduce the lanes into rax
+        switch (vector_loop.kind) {
+            case VectorKind::sum:
+            case VectorKind::count:
+                if (avx2) {
+                    emit("vextracti128", {"xmm1", "ymm0", "1"});
+                    emit("vpaddq", {"xmm0", "xmm0", "xmm1"});
+                    emit("vpshufd", {"xmm1", "xmm0", "0x4E"});
+                    emit("vpaddq", {"xmm0", "xmm0", "xmm1"});
+                    emit("vmovq", {RAX, "xmm0"});
+                } else {
+                    emit("pshufd", {"xmm1", "xmm0", "0x4E"});
+                    emit("paddq", {"xmm0", "xmm1"});
+                    emit("movq", {RAX, "xmm0"});
+                }
+                break;
+            case VectorKind::min:
+            case VectorKind::max: {
+                const bool max = vector_loop.kind == VectorKind::max;
+                const std::vector<std::string> compared = max ? std::vector<std::string>{"xmm2", "xmm1", "xmm0"}
+                                                              : std::vector<std::string>{"xmm2", "xmm0", "xmm1"};
+                emit("vextracti128", {"xmm1", "ymm0", "1"});
+                emit("vpcmpgtq", compared);
+                emit("vblendvpd", {"xmm0", "xmm0", "xmm1", "xmm2"});
+                emit("vpshufd", {"xmm1", "xmm0", "0x4E"});
+                emit("vpcmpgtq", compared);
+                emit("vblendvpd", {"xmm0", "xmm0", "xmm1", "xmm2"});
+                emit("vmovq", {RAX, "xmm0"});
+                break;
+            }
+            case VectorKind::map:
+                break;
+        }
+
+        asm_mov_reg(R11, RCX);
+        for (auto it = saved_regs.rbegin(); it != saved_regs.rend(); ++it) {
+            asm_pop(*it);
+        }
+
+        asm_move(operand(loop.counter), R11);
+        if (vector_loop.kind == VectorKind::sum || vector_loop.kind == VectorKind::count) {
+            asm_add(operand(vector_loop.accumulator), RAX);
+        } else if (vector_loop.kind != VectorKind::map) {
+            asm_move(operand(vector_loop.accumulator), RAX);
+        }
+        if (avx2) emit("vzeroupper");
+    }
+
+    //Bit `index` of a logiczna array lives in the qword index / 64 as its bit index % 64, which is what bt takes
+    void generate_bit_get(const TACInstruction &instr) {
+        const std::string base = pointer_register(instr.arg1.value());
+        const std::string index = operand(instr.arg2.value());
+
+        if (const auto bit = constant_bit(base, index); bit.has_value()) {
+            emit("bt", {bit->first, bit->second});
+        } else {
+            const std::string bit_index = index_register(index);
+            asm_mov_reg(RAX, bit_index);
+            asm_shift_right(RAX, "6");
+            asm_mov_reg(RAX, "QWORD [" + base + " + rax*8]");
+            emit("bt", {RAX, bit_index});
+        }
+
+        asm_set_cond("c", "al");
+        emit("movzx", {RAX, "al"});
+        asm_move(operand(instr.result.value()), RAX);
+    }
+
+    //The qword is updated in rax, a value only known at runtime is set with a cmov, which leaves it predictable
+    void generate_bit_assign(const TACInstruction &instr) {
+        const std::string base = pointer_register(instr.result.value());
+        const std::string index = operand(instr.arg1.value());
+        const std::string value = operand(instr.arg2.value());
+
+        std::string word;
+        std::string bit_index;
+        if (const auto bit = constant_bit(base, index); bit.has_value()) {
+            word = bit->first;
+            bit_index = bit->second;
+        } else {
+            bit_index = index_register(index);
+            asm_mov_reg(RAX, bit_index);
+            asm_shift_right(RAX, "6");
+            asm_lea(R11, "[" + base + " + rax*8]");
+            word = "QWORD [r11]";
+        }
+
+        asm_mov_reg(RAX, word);
+        if (is_imm(value)) {
+            emit(element_value(ElementType::boolean, std::stoll(value)) ? "bts" : "btr", {RAX, bit_index});
+        } else if (bit_index != RDX) {
+            emit("btr", {RAX, bit_index});
+            asm_mov_reg(RDX, RAX);
+            emit("bts", {RDX, bit_index});
+            asm_test_low_byte(value);
+            asm_cmov("nz", RAX, RDX);
+        } else {
+            //The index took the only free register
+            const std::string skip = "bit_" + std::to_string(bit_label_counter++);
+            emit("btr", {RAX, bit_index});
+            asm_test_low_byte(value);
+            asm_jump_zero(skip);
+            emit("bts", {RAX, bit_index});
+            asm_label(skip);
+        }
+        asm_mov_reg(word, RAX);
+    }
+
+    //Adds an _osr_entry jumping straight to the given loop header, for switching to the native code mid-run
+    void set_osr_header(const std::string &label) {
+        osr_header = label;
+    }
+
+    [[nodiscard]] const OSRLayout &get_osr_layout() const {
+        return osr_layout;
+    }
+
+    [[nodiscard]] std::vector<AsmInstruction> generate_program() {
+        //Loops are matched before the instruction selector reorders commutative operands
+        std::map<size_t, std::pair<CountedLoop, VectorLoop>> vector_loops;
+        for (size_t i = 0; i < instructions.size(); i++) {
+            if (instructions[i].op != OperationType::vectorize) continue;
+
+            if (const auto loop = IROptimizer::match_counted_loop(instructions, i + 1)) {
+                if (const auto vector_loop = IROptimizer::match_vector_loop(loop.value())) {
+                    vector_loops.emplace(i, std::pair{loop.value(), vector_loop.value()});
+                }
+            }
+        }
+
+        InstructionSelector selector(instructions);
+        folded = selector.select();
+        for (const auto &[def, root]: folded) {
+            folded_temps[instructions[def].result.value()] = def;
+        }
+
+        RegisterAllocator allocator(instructions, folded);
+        locations = allocator.allocate();
+
+        find_allocating_scopes();
+
+        const size_t slots = spill_slot + allocator.get_stack_slots();
+        frame_size = (slots * 8 + stack_array_bytes + 15) / 16 * 16;
+
         asm_header();
+        asm_mov_reg(RBP, RSP);
+        asm_substract(RSP, std::to_string(frame_size));
         asm_init_mem();
-        heap_pointers.push(stack_size);
-        asm_push_stack(RAX);
+        asm_mov_reg(frame_slot(heap_top_slot), RAX);
+
+        for (size_t i = 0; i < instructions.size(); i++) {
+            const TACInstruction &instruction = instructions[i];
+
+            //Folded definitions are emitted by the instruction using them
+            if (folded.contains(i)) continue;
+
+            if (instruction.op == OperationType::vectorize) {
+                if (vector_loops.contains(i)) {
+                    generate_vector_loop(vector_loops.at(i).first, vector_loops.at(i).second);
+                }
+                continue;
+            }
 
+            if (instruction.op == OperationType::jump_table) {
+                std::vector<std::string> entries;
+                while (i + 1 < instructions.size() && instructions[i + 1].op == OperationType::table_entry) {
+                    entries.push_back(instructions[++i].arg1.value());
+                }
 
-        for (TACInstruction const &instruction: instructions) {
+                generate_jump_table(instruction, entries);
+                continue;
+            }
+
+            if (instruction.op == OperationType::array_init || instruction.op == OperationType::array_constant) {
+                std::vector<long long> values;
+                while (i + 1 < instructions.size() && instructions[i + 1].op == OperationType::data_entry) {
+                    values.push_back(std::stoll(instructions[++i].arg1.value()));
+                }
+
+                generate_array_data(instruction, pack_elements(instruction.element, values));
+                continue;
+            }
+
+            if (instruction.op == OperationType::print_string) {
+                std::vector<long long> values;
+                while (i + 1 < instructions.size() && instructions[i + 1].op == OperationType::data_entry) {
+                    values.push_back(std::stoll(instructions[++i].arg1.value()));
+                }
+
+                generate_print_string(values);
+                continue;
+            }
+
+            if (i + 1 < instructions.size() && is_fusable_compare(instruction, instructions[i + 1])) {
+                if (instructions[i + 1].op == OperationType::jump_false) {
+                    generate_compare_branch(instruction, instructions[i + 1]);
+                } else {
+                    generate_compare_select(instruction, instructions[i + 1]);
+                }
+                i++;
+                continue;
+            }
+
+            if (instruction.op == OperationType::bgn_scope) {
+                scope_indexes.push(i);
+            }
+
+            current_index = i;
             generate_instruction(instruction);
         }
 
-        return asm_out.str();
+        generate_bounds_errors();
+
+        if (osr_header.has_value()) {
+            generate_osr_entry(allocator.get_intervals());
+        }
+
+        if (!data_out.empty()) {
+            asm_out.push_back({AsmInstruction::Kind::directive, "section .rodata"});
+            asm_out.insert(asm_out.end(), data_out.begin(), data_out.end());
+        }
+        if (!bss_out.empty()) {
+            asm_out.push_back({AsmInstruction::Kind::directive, "section .bss"});
+            asm_out.insert(asm_out.end(), bss_out.begin(), bss_out.end());
+        }
+
+        return asm_out;
     }
 
 private:
@@ -209,54 +801,193 @@ private:
     const std::string RDX = "rdx";
     const std::string RDI = "rdi";
     const std::string RSI = "rsi";
+    const std::string R8 = "r8";
+    const std::string R9 = "r9";
+    const std::string R10 = "r10";
+    const std::string R11 = "r11";
 
     const std::string RSP = "rsp";
     const std::string RBP = "rbp";
 
-    std::stringstream asm_out;
-
-    size_t stack_size = 0;
-    std::map<std::string, size_t> stack_vars;
-
-    std::stack<size_t> heap_pointers;
-
-    std::vector<size_t> scopes;
+    std::vector<AsmInstruction> asm_out;
+    std::vector<AsmInstruction> data_out;
+    std::vector<AsmInstruction> bss_out;
+    int jump_table_counter = 0;
+    std::vector<std::string> bounds_errors;
+
+    VectorISA vector_isa;
+    int vector_loop_counter = 0;
+    int bit_label_counter = 0;
+    int array_data_counter = 0;
+
+    static inline const std::map<ElementType, std::string> load_instructions = {
+            {ElementType::int64,     "mov"},
+            {ElementType::int32,     "movsxd"},
+            {ElementType::int16,     "movsx"},
+            {ElementType::int8,      "movsx"},
+            {ElementType::character, "movzx"},
+    };
+
+    //Multiplying a zero extended element by these repeats it over a whole qword
+    static inline const std::map<int, std::string> repeat_patterns = {
+            {1, "72340172838076673"}, //0x0101010101010101
+            {2, "281479271743489"}, //0x0001000100010001
+            {4, "4294967297"}, //0x0000000100000001
+    };
+
+    static inline const std::map<OperationType, std::string> vector_map_ops = {
+            {OperationType::add,      "paddq"},
+            {OperationType::subtract, "psubq"},
+            {OperationType::log_and,  "pand"},
+            {OperationType::log_or,   "por"},
+    };
+
+    std::map<std::string, Location> locations;
+    std::map<size_t, size_t> folded;
+    std::map<std::string, size_t> folded_temps;
+
+    static inline const std::map<std::string, std::string> low_bytes = {
+            {"rax", "al"}, {"rbx", "bl"}, {"rcx", "cl"}, {"rdx", "dl"}, {"rsi", "sil"}, {"rdi", "dil"},
+            {"r8", "r8b"}, {"r9", "r9b"}, {"r10", "r10b"}, {"r11", "r11b"},
+            {"r12", "r12b"}, {"r13", "r13b"}, {"r14", "r14b"}, {"r15", "r15b"},
+    };
+
+    //Fixed frame slots below rbp: the heap top, a buffer for reading single characters, then the heap top saved by
+    //every nesting level of scopes allocating arrays, then the spilled values
+    static constexpr size_t heap_top_slot = 0;
+    static constexpr size_t io_slot = 1;
+    static constexpr size_t scope_slot = 2;
+    size_t spill_slot = scope_slot;
+    size_t frame_size = 0;
+    size_t current_index = 0;
+
+    //Offsets of the arrays placed in the frame from its bottom, the space of a scope reused once it ends
+    std::map<size_t, size_t> stack_array_offsets;
+    size_t stack_array_bytes = 0;
+
+    std::optional<std::string> osr_header;
+    OSRLayout osr_layout;
+
+    std::map<size_t, bool> allocating_scopes;
+    std::stack<size_t> scope_indexes;
+    std::vector<bool> scopes;
 
     std::vector<TACInstruction> instructions;
 
-    void begin_scope() {
-        scopes.push_back(stack_vars.size());
+    static inline const std::map<OperationType, std::string> condition_codes = {
+            {OperationType::is_equal,         "e"},
+            {OperationType::not_equal,        "ne"},
+            {OperationType::is_greater,       "g"},
+            {OperationType::is_greater_equal, "ge"},
+            {OperationType::is_less,          "l"},
+            {OperationType::is_less_equal,    "le"},
+    };
+
+    static inline const std::map<OperationType, std::string> inverted_condition_codes = {
+            {OperationType::is_equal,         "ne"},
+            {OperationType::not_equal,        "e"},
+            {OperationType::is_greater,       "le"},
+            {OperationType::is_greater_equal, "l"},
+            {OperationType::is_less,          "ge"},
+            {OperationType::is_less_equal,    "g"},
+    };
+
+    //Scopes with an array allocated anywhere inside them give the memory back at their end
+    void find_allocating_scopes() {
+        std::vector<size_t> open;
+        size_t max_depth = 0;
+        std::vector<size_t> frame_tops = {0};
+
+        for (size_t i = 0; i < instructions.size(); i++) {
+            switch (instructions[i].op) {
+                case OperationType::bgn_scope:
+                    open.push_back(i);
+                    allocating_scopes[i] = false;
+                    max_depth = std::max(max_depth, open.size());
+                    frame_tops.push_back(frame_tops.back());
+                    break;
+                case OperationType::end_scope:
+                    open.pop_back();
+                    frame_tops.pop_back();
+                    break;
+                case OperationType::array_stack:
+                    stack_array_offsets[i] = frame_tops.back();
+                    frame_tops.back() += array_bytes(instructions[i].element, std::stoll(instructions[i].arg1.value()));
+                    stack_array_bytes = std::max(stack_array_bytes, frame_tops.back());
+                    break;
+                case OperationType::array_allocate:
+                    for (const size_t scope: open) {
+                        allocating_scopes[scope] = true;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        spill_slot = scope_slot + max_depth;
     }
 
-    void end_scope() {
-        bool heap_freed = false;
-        while (heap_pointers.top() > scopes.back()) {
-            heap_freed = true;
-            heap_pointers.pop();
+    void generate_osr_entry(const std::vector<LiveInterval> &intervals) {
+        size_t header = 0;
+        std::vector<size_t> open;
+        for (; instructions[header].op != OperationType::label || instructions[header].arg1 != osr_header; header++) {
+            if (instructions[header].op == OperationType::bgn_scope) open.push_back(header);
+            if (instructions[header].op == OperationType::end_scope) open.pop_back();
         }
 
-        if (heap_freed) {
-            asm_mov_reg(RDI, get_loc_offset(heap_pointers.top()));
-            asm_alloc_mem();
+        asm_label("_osr_entry");
+        asm_mov_reg(RBP, RSP);
+        asm_substract(RSP, std::to_string(frame_size));
+        asm_mov_reg(RDX, RDI);
+
+        size_t offset = 0;
+        const auto load = [&](const std::string &dest) {
+            asm_mov_reg(RAX, "QWORD [rdx + " + std::to_string(offset) + "]");
+            asm_move(dest, RAX);
+            offset += 8;
+        };
+
+        //The interpreter's heap is mapped already, the runtime carries on from its top
+        load(frame_slot(heap_top_slot));
+        asm_call("_heap_start");
+        for (size_t depth = 0; depth < open.size(); depth++) {
+            if (!allocating_scopes.at(open[depth])) continue;
+
+            osr_layout.scopes.push_back(open[depth]);
+            load(frame_slot(scope_slot + depth));
         }
 
-        const size_t var_count = stack_vars.size() - scopes.back();
-        asm_add(RSP, std::to_string(var_count * 8));
-        stack_size -= var_count;
+        //Intervals covering the same position never share a location
+        for (const LiveInterval &interval: intervals) {
+            if (interval.start > header || interval.end < header) continue;
+            if (locations.at(interval.vreg).kind == Location::Kind::constant) continue;
 
-        /*for (auto it = stack_vars.begin(); it != stack_vars.end();) {
-            if (it->second > scopes.back()) {
-                it = stack_vars.erase(it);
-            }
-            else {
-                ++it;
-            }
-        }*/
+            osr_layout.values.push_back(interval.vreg);
+            load(operand(interval.vreg));
+        }
 
-        erase_if(stack_vars, [this](auto it) {
-            return it.second > scopes.back();
-        });
+        asm_jump(osr_header.value());
+    }
 
+    void begin_scope() {
+        const bool allocating = allocating_scopes.at(scope_indexes.top());
+        scope_indexes.pop();
+        scopes.push_back(allocating);
+
+        if (allocating) {
+            asm_mov_reg(RAX, frame_slot(heap_top_slot));
+            asm_mov_reg(frame_slot(scope_slot + scopes.size() - 1), RAX);
+        }
+    }
+
+    void end_scope() {
+        if (scopes.back()) {
+            asm_mov_reg(RSI, frame_slot(heap_top_slot));
+            asm_mov_reg(RDI, frame_slot(scope_slot + scopes.size() - 1));
+            asm_mov_reg(frame_slot(heap_top_slot), RDI);
+            asm_call("_heap_release");
+        }
 
         scopes.pop_back();
     }
@@ -267,142 +998,448 @@ private:
         return *p == 0;
     }
 
-    void load_stack_var(const std::string &ident, const std::string &reg) {
-        if (is_num(ident)) {
-            asm_mov_reg(reg, ident);
-        } else if (ident[0] == '#') {
-            asm_pop_stack(reg);
+    static bool is_imm(const std::string &operand) {
+        return is_num(operand);
+    }
+
+    static bool is_mem(const std::string &operand) {
+        return operand.find('[') != std::string::npos;
+    }
+
+    static bool is_reg(const std::string &operand) {
+        return !is_imm(operand) && !is_mem(operand);
+    }
+
+    static bool fits_imm32(const std::string &operand) {
+        const long long value = std::stoll(operand);
+        return value >= INT32_MIN && value <= INT32_MAX;
+    }
+
+    [[nodiscard]] std::optional<size_t> folded_def(const std::string &value) const {
+        if (!folded_temps.contains(value)) return {};
+        return folded_temps.at(value);
+    }
+
+    //Register, frame slot or immediate holding a TAC operand, or the memory operand of a folded array element
+    [[nodiscard]] std::string operand(const std::string &value) {
+        if (is_num(value)) return value;
+
+        if (const auto load = folded_def(value); load.has_value()) {
+            const TACInstruction &instr = instructions[load.value()];
+            return element_operand(instr.arg1.value(), instr.arg2.value());
+        }
+
+        const Location &location = locations.at(value);
+        switch (location.kind) {
+            case Location::Kind::reg:
+            case Location::Kind::constant:
+                return location.value;
+            case Location::Kind::stack:
+                return frame_slot(spill_slot + std::stoul(location.value));
+        }
+
+        assert(false); //Unreachable
+    }
+
+    //Immediates that don't fit into an instruction, or that the instruction can't take, go through r11
+    std::string rhs_operand(const std::string &operand, const bool allow_imm = true) {
+        if (is_imm(operand) && (!allow_imm || !fits_imm32(operand))) {
+            asm_mov_reg(R11, operand);
+            return R11;
+        }
+        return operand;
+    }
+
+    static std::string frame_slot(const size_t slot) {
+        return "QWORD " + frame_address(slot);
+    }
+
+    static std::string frame_address(const size_t slot) {
+        return "[rbp - " + std::to_string((slot + 1) * 8) + "]";
+    }
+
+    //Array pointers living in the frame are loaded into r11
+    std::string pointer_register(const std::string &array) {
+        const std::string base = operand(array);
+        if (is_reg(base)) return base;
+
+        asm_mov_reg(R11, base);
+        return R11;
+    }
+
+    //Indexes living in the frame or too large to be folded are loaded into rdx
+    std::string index_register(const std::string &index) {
+        if (is_reg(index)) return index;
+
+        asm_mov_reg(RDX, index);
+        return RDX;
+    }
+
+    //The qword holding a bit at a constant index and the bit within it
+    static std::optional<std::pair<std::string, std::string>> constant_bit(const std::string &base,
+                                                                           const std::string &index) {
+        if (!is_imm(index) || std::llabs(std::stoll(index)) >= max_displacement) return {};
+
+        const long long bit = std::stoll(index);
+        const long long offset = (bit >> 6) * 8;
+        const std::string displacement = offset < 0 ? " - " + std::to_string(-offset)
+                                                    : " + " + std::to_string(offset);
+        return std::pair{"QWORD [" + base + displacement + "]", std::to_string(bit & 63)};
+    }
+
+    static std::string scale(const int bytes) {
+        return bytes == 1 ? "" : "*" + std::to_string(bytes);
+    }
+
+    //Turns rdi, rdx and rcx holding an array, a start index and an element count into the range of bytes they cover
+    void asm_byte_range(const int bytes) {
+        asm_lea(RDI, "[rdi + rdx" + scale(bytes) + "]");
+        if (bytes > 1) asm_shift_left(RCX, std::to_string(std::countr_zero(static_cast<unsigned>(bytes))));
+    }
+
+    //Turns an element count into the number of bytes the array takes, see array_bytes
+    void asm_array_bytes(const std::string &reg, const ElementType element) {
+        const int bits = element_bits(element);
+        if (bits == 64) {
+            asm_shift_left(reg, "3");
+            return;
+        }
+
+        if (bits > 8) asm_shift_left(reg, std::to_string(std::countr_zero(static_cast<unsigned>(bits / 8))));
+        asm_add(reg, bits == 1 ? "63" : "7");
+        if (bits == 1) {
+            asm_shift_right(reg, "6");
+            asm_shift_left(reg, "3");
+        } else {
+            emit("and", {reg, "-8"});
+        }
+    }
+
+    void asm_test_low_byte(const std::string &value) {
+        if (is_reg(value)) {
+            asm_test(low_bytes.at(value));
         } else {
-            const std::string pointer = get_var_pointer(ident);
-            asm_mov_reg(reg, pointer);
+            //The lowest byte comes first in memory
+            asm_cmp("BYTE " + value.substr(value.find('[')), "0");
+        }
+    }
+
+    /*
+     * Memory operand of array[index], folding a constant index or an index offset by a constant into the
+     * displacement. Array pointers or indexes living in the frame are loaded into r11 and rdx.
+     */
+    std::string element_operand(const std::string &array, const std::string &index,
+                                const ElementType element = ElementType::int64) {
+        const std::string base = pointer_register(array);
+        const int bytes = element_bits(element) / 8;
+
+        long long displacement = 0;
+        std::string index_value = index;
+        if (const auto def = folded_def(index); def.has_value()) {
+            const TACInstruction &offset = instructions[def.value()];
+            const long long constant = std::stoll(offset.arg2.value());
+
+            index_value = offset.arg1.value();
+            displacement = offset.op == OperationType::add ? constant : -constant;
+        }
+
+        std::string index_operand = operand(index_value);
+        if (is_imm(index_operand)) {
+            displacement += std::stoll(index_operand);
+            index_operand.clear();
+
+            if (std::llabs(displacement) >= max_displacement) {
+                asm_mov_reg(RDX, std::to_string(displacement));
+                index_operand = RDX;
+                displacement = 0;
+            }
+        } else if (!is_reg(index_operand)) {
+            asm_mov_reg(RDX, index_operand);
+            index_operand = RDX;
+        }
+
+        std::string address = memory_size(bytes) + " [" + base;
+        if (!index_operand.empty()) address += " + " + index_operand + scale(bytes);
+        if (displacement > 0) address += " + " + std::to_string(displacement * bytes);
+        if (displacement < 0) address += " - " + std::to_string(-displacement * bytes);
+        return address + "]";
+    }
+
+    //Loads values into registers when some of them may currently hold other values from the list
+    void asm_parallel_move(const std::vector<std::string> &values, const std::vector<std::string> &regs) {
+        for (const std::string &value: values) {
+            asm_push(rhs_operand(operand(value)));
+        }
+        for (auto it = regs.rbegin(); it != regs.rend(); ++it) {
+            asm_pop(*it);
+        }
+    }
+
+    void asm_move(const std::string &dest, const std::string &src) {
+        if (dest == src) return;
+
+        if (is_mem(dest) && (is_mem(src) || (is_imm(src) && !fits_imm32(src)))) {
+            asm_mov_reg(R11, src);
+            asm_mov_reg(dest, R11);
+        } else {
+            asm_mov_reg(dest, src);
+        }
+    }
+
+    //Elements further than this don't fit into a 32-bit displacement
+    static constexpr long long max_displacement = 1LL << 28;
+
+    //Picks the cheapest tile computing dest = lhs + rhs
+    void generate_add(const std::string &dest, std::string lhs, std::string rhs) {
+        if (is_imm(lhs) && !is_imm(rhs)) std::swap(lhs, rhs);
+
+        const bool lea_operands = is_reg(lhs) && (is_reg(rhs) || (is_imm(rhs) && fits_imm32(rhs)));
+        if (is_reg(dest) && dest != lhs && lea_operands &&
+            InstructionSelector::cost({Tile::lea}) < InstructionSelector::cost({Tile::move, Tile::alu})) {
+            if (is_reg(rhs)) {
+                asm_lea(dest, "[" + lhs + " + " + rhs + "]");
+            } else {
+                const long long value = std::stoll(rhs);
+                asm_lea(dest, "[" + lhs + (value < 0 ? " - " : " + ") + std::to_string(std::llabs(value)) + "]");
+            }
+            return;
+        }
+
+        asm_binary("add", dest, lhs, rhs);
+    }
+
+    //Picks the cheapest tile computing dest = lhs * rhs, multiplications by small constants become shifts or lea
+    void generate_multiply(const std::string &dest, const std::string &lhs, const std::string &rhs) {
+        if (!is_imm(rhs) || !fits_imm32(rhs) || !is_reg(dest) || is_imm(lhs)) {
+            asm_binary("imul", dest, lhs, rhs);
+            return;
+        }
+
+        const long long value = std::stoll(rhs);
+        const int multiply_cost = InstructionSelector::cost({Tile::multiply});
+
+        if ((value == 3 || value == 5 || value == 9) && is_reg(lhs) &&
+            InstructionSelector::cost({Tile::lea}) < multiply_cost) {
+            asm_lea(dest, "[" + lhs + " + " + lhs + "*" + std::to_string(value - 1) + "]");
+            return;
         }
+
+        if (value > 0 && (value & (value - 1)) == 0 &&
+            InstructionSelector::cost({Tile::move, Tile::shift}) < multiply_cost) {
+            asm_move(dest, lhs);
+            if (value > 1) asm_shift_left(dest, std::to_string(std::countr_zero(static_cast<unsigned long long>(value))));
+            return;
+        }
+
+        //The three operand form doesn't need the left-hand side moved first
+        emit("imul", {dest, lhs, rhs});
     }
 
-    std::string get_var_pointer(const std::string &ident) const {
-        const size_t stack_loc = stack_vars.at(ident);
-        return get_loc_offset(stack_loc);
+    //x = x <op> rhs without a temporary
+    void generate_in_place(const std::string &dest, const TACInstruction &update) {
+        std::string rhs = rhs_operand(operand(update.arg2.value()));
+
+        if (update.op == OperationType::multiply && !is_reg(dest)) {
+            asm_mov_reg(RAX, dest);
+            emit("imul", {RAX, rhs});
+            asm_mov_reg(dest, RAX);
+            return;
+        }
+
+        if (is_mem(dest) && is_mem(rhs)) {
+            asm_mov_reg(RAX, rhs);
+            rhs = RAX;
+        }
+        emit(in_place_instructions.at(update.op), {dest, rhs});
     }
 
-    std::string get_loc_offset(const size_t stack_loc) const {
-        const std::string offset = std::to_string((stack_size - stack_loc - 1) * 8);
+    static inline const std::map<OperationType, std::string> in_place_instructions = {
+            {OperationType::add,      "add"},
+            {OperationType::subtract, "sub"},
+            {OperationType::multiply, "imul"},
+            {OperationType::log_and,  "and"},
+            {OperationType::log_or,   "or"},
+    };
+
+    //dest = lhs <instr> rhs, computed in place when dest is a register the right-hand side doesn't live in
+    void asm_binary(const std::string &instr, const std::string &dest, const std::string &lhs, const std::string &rhs) {
+        const std::string src = rhs_operand(rhs);
+
+        if (is_reg(dest) && dest != src) {
+            asm_move(dest, lhs);
+            emit(instr, {dest, src});
+        } else {
+            asm_mov_reg(RAX, lhs);
+            emit(instr, {RAX, src});
+            asm_move(dest, RAX);
+        }
+    }
 
-        return "QWORD [rsp + " + offset + "]";
+    void emit(const std::string &opcode, const std::vector<std::string> &operands = {}) {
+        asm_out.push_back({AsmInstruction::Kind::instruction, opcode, operands});
     }
 
-    void asm_push_stack(const std::string &reg) {
-        asm_out << "    push " << reg << std::endl;
-        stack_size++;
+    void asm_push(const std::string &operand) {
+        emit("push", {operand});
     }
 
-    void asm_pop_stack(const std::string &reg) {
-        asm_out << "    pop " << reg << std::endl;
-        stack_size--;
+    void asm_pop(const std::string &reg) {
+        emit("pop", {reg});
     }
 
     void asm_mov_reg(const std::string &reg, const std::string &val) {
-        asm_out << "    mov " << reg << ", " << val << std::endl;
+        emit("mov", {reg, val});
     }
 
     void asm_add(const std::string &reg1, const std::string &reg2) {
-        asm_out << "    add " << reg1 << ", " << reg2 << std::endl;
+        emit("add", {reg1, reg2});
     }
 
     void asm_substract(const std::string &reg1, const std::string &reg2) {
-        asm_out << "    sub " << reg1 << ", " << reg2 << std::endl;
+        emit("sub", {reg1, reg2});
     }
 
-    void asm_multiply(const std::string &reg) {
-        asm_out << "    mul " << reg << std::endl;
+    void asm_shift_left(const std::string &reg, const std::string &count) {
+        emit("shl", {reg, count});
     }
 
-    void asm_divide(const std::string &reg) {
-        asm_out << "    xor rdx, rdx\n    div " << reg << std::endl;
-    }
-
-    void asm_logical_and(const std::string &reg1, const std::string &reg2) {
-        asm_out << "    and " << reg1 << ", " << reg2 << std::endl;
+    void asm_shift_right(const std::string &reg, const std::string &count) {
+        emit("shr", {reg, count});
     }
 
-    void asm_logical_or(const std::string &reg1, const std::string &reg2) {
-        asm_out << "    or " << reg1 << ", " << reg2 << std::endl;
+    void asm_divide(const std::string &reg) {
+        emit("xor", {RDX, RDX});
+        emit("div", {reg});
     }
 
     void asm_logical_not(const std::string &reg) {
-        asm_out << "    not " << reg << std::endl;
+        emit("not", {reg});
     }
 
     void asm_test(const std::string &reg) {
-        asm_out << "    movzx rax, al\n    test " << reg << ", " << reg << std::endl;
+        emit("test", {reg, reg});
     }
 
     void asm_cmp(const std::string &reg1, const std::string &reg2) {
-        asm_out << "    cmp " << reg1 << ", " << reg2 << std::endl;
+        emit("cmp", {reg1, reg2});
     }
 
-    void asm_set_equal() {
-        asm_out << "    setz al" << std::endl;
+    void asm_set_cond(const std::string &cond, const std::string &reg) {
+        emit("set" + cond, {reg});
     }
 
-    void asm_set_not_equal() {
-        asm_out << "    setnz al" << std::endl;
+    void asm_cmov(const std::string &cond, const std::string &reg, const std::string &val) {
+        emit("cmov" + cond, {reg, val});
     }
 
-    void asm_set_greater() {
-        asm_out << "    setg al" << std::endl;
+    void asm_jump_zero(const std::string &label) {
+        emit("jz", {label});
     }
 
-    void asm_set_less() {
-        asm_out << "    setl al" << std::endl;
+    void asm_jump_cond(const std::string &cond, const std::string &label) {
+        emit("j" + cond, {label});
     }
 
-    void asm_set_greater_equal() {
-        asm_out << "    setge al" << std::endl;
+    void asm_jump(const std::string &label) {
+        emit("jmp", {label});
     }
 
-    void asm_set_less_equal() {
-        asm_out << "    setle al" << std::endl;
+    void asm_label(const std::string &label) {
+        asm_out.push_back({AsmInstruction::Kind::label, label});
     }
 
-    void asm_jump_zero(const std::string &label) {
-        asm_out << "    jz " << label << std::endl;
+    [[nodiscard]] std::string vreg(const int index) const {
+        return (vector_isa == VectorISA::avx2 ? "ymm" : "xmm") + std::to_string(index);
     }
 
-    void asm_jump(const std::string &label) {
-        asm_out << "    jmp " << label << std::endl;
+    //SSE instructions overwrite their first operand, the AVX forms take it as a separate source
+    void asm_vector(const std::string &instr, const std::string &dest, const std::string &src) {
+        asm_vector(instr, dest, dest, src);
     }
 
-    void asm_label(const std::string &label) {
-        asm_out << label << ":" << std::endl;
+    void asm_vector(const std::string &instr, const std::string &dest, const std::string &src1,
+                    const std::string &src2) {
+        if (vector_isa == VectorISA::avx2) {
+            emit("v" + instr, {dest, src1, src2});
+        } else {
+            assert(dest == src1);
+            emit(instr, {dest, src2});
+        }
+    }
+
+    void asm_vector_move(const std::string &dest, const std::string &src) {
+        emit(vector_isa == VectorISA::avx2 ? "vmovdqu" : "movdqu", {dest, src});
+    }
+
+    void asm_vector_broadcast(const std::string &dest, const std::string &reg) {
+        if (vector_isa == VectorISA::avx2) {
+            emit("vmovq", {"xmm" + dest.substr(3), reg});
+            emit("vpbroadcastq", {dest, "xmm" + dest.substr(3)});
+        } else {
+            emit("movq", {dest, reg});
+            emit("punpcklqdq", {dest, dest});
+        }
+    }
+
+    void asm_lea(const std::string &reg, const std::string &address) {
+        emit("lea", {reg, address});
+    }
+
+    void asm_call(const std::string &label) {
+        emit("call", {label});
     }
 
     void asm_print_int() {
-        asm_out << "    call _print_int" << std::endl;
+        asm_call("_print_int");
     }
 
-    void asm_print_char(const std::string &pointer) {
-        asm_out << "    mov rax, 1\n    mov rdi, 1\n    mov rdx, 1\n    lea rsi, " << pointer << "\n    syscall\n";
+    //The runtime collects the output and writes it out only once its buffer is full, before reading and at the exit
+    void asm_print_char() {
+        asm_call("_print_char");
     }
 
+    //The runtime maps the heap in growing chunks, the generated code only bumps its top
     void asm_init_mem() {
-        asm_out << "    mov rax, 12\n    mov rdi, 0\n    syscall\n";
+        asm_call("_heap_init");
+    }
+
+    //Arrays start out zeroed at every declaration, even when a sibling scope or an earlier iteration used the memory
+    void asm_clear_array(const std::string &array, const long long qwords) {
+        if (static_cast<size_t>(qwords) <= RegisterAllocator::max_inline_init_qwords) {
+            const std::string base = pointer_register(array);
+            for (long long i = 0; i < qwords; i++) {
+                asm_mov_reg("QWORD [" + base + " + " + std::to_string(i * 8) + "]", "0");
+            }
+            return;
+        }
+
+        asm_move(RDI, operand(array));
+        asm_mov_reg(RCX, std::to_string(qwords));
+        asm_mov_reg(RAX, "0");
+        asm_call("_fill_qwords");
     }
 
     void asm_alloc_mem() {
-        asm_out << "    mov rax, 12\n    syscall\n";
+        asm_call("_heap_alloc");
     }
 
-    void asm_read_char() {
-        asm_out << "    inc rsp\n    mov rax, 0\n    mov rdi, 0\n    mov rdx, 1\n    lea rsi, [rsp]\n    syscall\n";
-        stack_size++;
+    void asm_read_char(const std::string &pointer) {
+        asm_call("_flush");
+        asm_mov_reg(RAX, "0");
+        asm_mov_reg(RDI, "0");
+        asm_mov_reg(RDX, "1");
+        asm_lea(RSI, pointer);
+        emit("syscall");
     }
 
     void asm_exit() {
-        asm_out << "    mov rax, 60\n    syscall\n";
+        asm_call("_flush");
+        asm_mov_reg(RAX, "60");
+        emit("syscall");
     }
 
     void asm_header() {
-        asm_out << "%include \"printer.asm\"" << std::endl
-                << "global _start" << std::endl
-                << "_start:" << std::endl;
+        asm_out.push_back({AsmInstruction::Kind::directive, "global _start"});
+        asm_label("_start");
     }
 };
@@ -0,0 +1,1049 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <map>
+#include <optional>
+#include <set>
+#include <stack>
+#include <string>
+#include <vector>
+
+#include "ir_generator.hpp"
+#include "parser.hpp"
+#include "peephole_optimizer.hpp"
+
+/*
+ * Single-pass code generator for -O0, going straight from the parse tree to assembly. Every variable lives in its own
+ * frame slot and expressions are evaluated in registers in the order given by Sethi-Ullman numbering, so that no
+ * temporaries have to be stored on the stack. The semantic analysis and the behaviour are the same as in the
+ * IRGenerator and ASMGenerator path.
+ */
+class BaselineGenerator {
+public:
+    explicit BaselineGenerator(NodeStart root, const bool bounds_check = false) : root(std::move(root)),
+                                                                                  bounds_check(bounds_check) {
+    }
+
+    //Registers needed to evaluate an expression, also checking its types in the order the IRGenerator does
+    int label_expr(const NodeExpr *expr, const TokenType expected_type) {
+        struct ExprVisitor {
+            BaselineGenerator &gen;
+            TokenType expected_type;
+
+            int operator()(const NodeBinExpr *bin_expr) const {
+                IRGenerator::check_operator(bin_expr->opr.type, expected_type, bin_expr->opr.line);
+
+                const TokenType expected_param_type = IRGenerator::get_param_type(bin_expr->opr.type);
+                const int rhs = gen.label_expr(bin_expr->right, expected_param_type);
+                const int lhs = gen.label_expr(bin_expr->left, expected_param_type);
+
+                //A variable or a literal on the right is used directly as an operand
+                if (gen.leaf_operand(bin_expr->right).has_value()) return lhs;
+                return lhs == rhs ? lhs + 1 : std::max(lhs, rhs);
+            }
+
+            int operator()(const NodeTerm *term) const {
+                return gen.label_term(term, expected_type);
+            }
+
+            int operator()(const NodeUnExpr *un_expr) const {
+                IRGenerator::check_operator(un_expr->opr.type, expected_type, un_expr->opr.line);
+                return gen.label_term(un_expr->term, IRGenerator::get_param_type(un_expr->opr.type));
+            }
+        };
+
+        const int need = visit(ExprVisitor{*this, expected_type}, expr->var);
+        needs[expr] = need;
+        return need;
+    }
+
+    int label_term(const NodeTerm *term, const TokenType expected_type) {
+        struct TermVisitor {
+            BaselineGenerator &gen;
+            TokenType expected_type;
+
+            int operator()(const NodeTermIntLit *term_int_lit) const {
+                IRGenerator::check_token(TokenType::var_type_int, expected_type, term_int_lit->int_lit.line);
+                return 1;
+            }
+
+            int operator()(const NodeTermBoolLit *term_bool_lit) const {
+                IRGenerator::check_token(TokenType::var_type_boolean, expected_type, term_bool_lit->bool_lit.line);
+                return 1;
+            }
+
+            int operator()(const NodeTermCharLit *term_char_lit) const {
+                IRGenerator::check_token(TokenType::var_type_char, expected_type, term_char_lit->char_lit.line);
+                return 1;
+            }
+
+            int operator()(const NodeTermStringLit *term_string_lit) const {
+                const int line = term_string_lit->array_expr->token.line;
+                IRGenerator::check_token(TokenType::var_type_string, expected_type, line);
+                IRGenerator::string_err(line);
+            }
+
+            int operator()(const NodeTermIdent *term_ident) const {
+                gen.check_ident(term_ident->ident, true);
+                IRGenerator::check_token(gen.var_types[term_ident->ident.value.value()], expected_type,
+                                         term_ident->ident.line);
+                if (gen.get_element_type(term_ident->ident.value.value()) != ElementType::int64) {
+                    IRGenerator::narrow_array_err(term_ident->ident);
+                }
+                return 1;
+            }
+
+            int operator()(const NodeTermParen *term_paren) const {
+                return gen.label_expr(term_paren->expr, expected_type);
+            }
+
+            int operator()(const NodeTermArrIdent *arr_ident) const {
+                gen.check_ident(arr_ident->ident, true);
+                IRGenerator::check_token(gen.var_types[arr_ident->ident.value.value()], expected_type,
+                                         arr_ident->ident.line);
+                return gen.label_index(arr_ident->ident, arr_ident->indexes);
+            }
+
+            int operator()(const NodeTermArray *array_expr) const {
+                IRGenerator::check_token(TokenType::array, expected_type, array_expr->token.line);
+                assert(false);
+                //TODO
+            }
+
+            int operator()(const NodeTermReadChar *read_char) const {
+                IRGenerator::check_token(TokenType::var_type_char, expected_type, read_char->token.line);
+                return 1;
+            }
+        };
+
+        return visit(TermVisitor{*this, expected_type}, term->var);
+    }
+
+    //Evaluates a labeled expression into the first of the given registers, using only the registers given
+    void generate_expr(const NodeExpr *expr, const std::vector<std::string> &regs) {
+        struct ExprVisitor {
+            BaselineGenerator &gen;
+            const std::vector<std::string> &regs;
+
+            void operator()(const NodeBinExpr *bin_expr) const {
+                const std::string src = gen.generate_operands(bin_expr, regs);
+                gen.generate_operation(bin_expr->opr.type, regs.front(), src);
+            }
+
+            void operator()(const NodeTerm *term) const {
+                gen.generate_term(term, regs);
+            }
+
+            void operator()(const NodeUnExpr *un_expr) const {
+                gen.generate_term(un_expr->term, regs);
+                gen.emit("not", {regs.front()});
+            }
+        };
+
+        visit(ExprVisitor{*this, regs}, expr->var);
+    }
+
+    void generate_term(const NodeTerm *term, const std::vector<std::string> &regs) {
+        if (const auto operand = leaf_term_operand(term); operand.has_value()) {
+            asm_mov(regs.front(), operand.value());
+            return;
+        }
+
+        if (const auto *paren = std::get_if<NodeTermParen *>(&term->var)) {
+            generate_expr((*paren)->expr, regs);
+        } else if (const auto *arr_ident = std::get_if<NodeTermArrIdent *>(&term->var)) {
+            generate_index((*arr_ident)->ident, (*arr_ident)->indexes, regs);
+            const std::string &ident = (*arr_ident)->ident.value.value();
+            asm_mov(R11, var_slot(ident));
+            asm_element_load(regs.front(), get_element_type(ident));
+        } else if (std::holds_alternative<NodeTermReadChar *>(term->var)) {
+            emit("call", {"_flush"});
+            asm_mov(frame_slot(io_slot), "0");
+            asm_mov(RAX, "0");
+            asm_mov(RDI, "0");
+            asm_mov(RDX, "1");
+            emit("lea", {RSI, frame_address(io_slot)});
+            emit("syscall");
+            asm_mov(regs.front(), frame_slot(io_slot));
+        } else {
+            assert(false);
+        }
+    }
+
+    /*
+     * Evaluates both sides of a binary expression, leaving the left one in the first register and returning the
+     * operand holding the right one. The side needing more registers goes first, the right side goes first when
+     * both read characters, as that's the order their input is consumed in.
+     */
+    std::string generate_operands(const NodeBinExpr *bin_expr, const std::vector<std::string> &regs) {
+        if (const auto operand = leaf_operand(bin_expr->right); operand.has_value()) {
+            generate_expr(bin_expr->left, regs);
+            return operand.value();
+        }
+
+        const int lhs = needs.at(bin_expr->left);
+        const int rhs = needs.at(bin_expr->right);
+        const bool right_first = rhs > lhs || (reads_char(bin_expr->left) && reads_char(bin_expr->right));
+
+        if (static_cast<size_t>(right_first ? lhs : rhs) >= regs.size()) {
+            //Not enough registers to hold both sides at once
+            generate_expr(bin_expr->right, regs);
+            emit("push", {regs.front()});
+            generate_expr(bin_expr->left, regs);
+            emit("pop", {R11});
+            return R11;
+        }
+
+        if (right_first) {
+            std::vector<std::string> right_regs = {regs[1], regs[0]};
+            right_regs.insert(right_regs.end(), regs.begin() + 2, regs.end());
+
+            generate_expr(bin_expr->right, right_regs);
+            generate_expr(bin_expr->left, without(regs, regs[1]));
+        } else {
+            generate_expr(bin_expr->left, regs);
+            generate_expr(bin_expr->right, without(regs, regs[0]));
+        }
+
+        return regs[1];
+    }
+
+    void generate_operation(const TokenType opr, const std::string &dest, const std::string &src) {
+        switch (opr) {
+            case TokenType::add:
+                emit("add", {dest, src});
+                break;
+            case TokenType::subtract:
+                emit("sub", {dest, src});
+                break;
+            case TokenType::multiply:
+                emit("imul", {dest, src});
+                break;
+            case TokenType::divide:
+            case TokenType::modulo: {
+                std::string divisor = src;
+                if (is_imm(divisor)) {
+                    asm_mov(R11, divisor);
+                    divisor = R11;
+                }
+                asm_mov(RAX, dest);
+                emit("xor", {RDX, RDX});
+                emit("div", {divisor});
+                asm_mov(dest, opr == TokenType::divide ? RAX : RDX);
+                break;
+            }
+            case TokenType::logical_and:
+                emit("and", {dest, src});
+                break;
+            case TokenType::logical_or:
+                emit("or", {dest, src});
+                break;
+            default:
+                //Only the lowest byte holds the result of a comparison
+                emit("cmp", {dest, src});
+                emit("set" + condition_codes.at(opr), {low_bytes.at(dest)});
+        }
+    }
+
+    //Jumps to the label if the condition is false, comparing directly without materializing the result if possible
+    void generate_condition(const NodeExpr *expr, const std::string &false_label) {
+        label_expr(expr, TokenType::var_type_boolean);
+
+        const NodeExpr *inner = unwrap_parens(expr);
+        if (const auto *bin_expr = std::get_if<NodeBinExpr *>(&inner->var);
+            bin_expr != nullptr && condition_codes.contains((*bin_expr)->opr.type)) {
+            const std::string src = generate_operands(*bin_expr, expr_regs);
+            emit("cmp", {expr_regs.front(), src});
+            emit("j" + inverted_condition_codes.at((*bin_expr)->opr.type), {false_label});
+            return;
+        }
+
+        generate_expr(expr, expr_regs);
+        emit("test", {low_bytes.at(expr_regs.front()), low_bytes.at(expr_regs.front())});
+        emit("jz", {false_label});
+    }
+
+    //Checks and evaluates an expression into the first register
+    std::string generate_value(const NodeExpr *expr, const TokenType expected_type) {
+        label_expr(expr, expected_type);
+        generate_expr(expr, expr_regs);
+        return expr_regs.front();
+    }
+
+    void generate_store(const std::string &ident, const NodeExpr *expr, const TokenType type) {
+        label_expr(expr, type);
+
+        //Literals are stored directly
+        if (const auto operand = leaf_operand(expr); operand.has_value() && is_imm(operand.value())) {
+            asm_mov(var_slot(ident), operand.value());
+            return;
+        }
+
+        generate_expr(expr, expr_regs);
+        asm_mov(var_slot(ident), expr_regs.front());
+    }
+
+    //Stores a whole array of narrower elements, which the variable indexes the same way, see IRGenerator::generate_alias
+    bool store_alias(const Token &target, const NodeExpr *expr, const TokenType type, const bool declaration) {
+        const ElementType element = IRGenerator::alias_element(target, expr, declaration, array_elements);
+        if (element == ElementType::int64) return false;
+
+        const Token &source = *IRGenerator::plain_ident(expr);
+        IRGenerator::check_token(TokenType::var_type_int, type, source.line);
+        array_elements.try_emplace(target.value.value(), element);
+        asm_mov(expr_regs.front(), var_slot(source.value.value()));
+        asm_mov(var_slot(target.value.value()), expr_regs.front());
+        return true;
+    }
+
+    void generate_element_store(const Token &array, const std::vector<NodeExpr *> &indexes, const NodeExpr *expr,
+                                const TokenType type) {
+        const std::string &ident = array.value.value();
+        generate_value(expr, type);
+        label_index(array, indexes);
+        generate_index(array, indexes, without(expr_regs, expr_regs.front()));
+
+        asm_mov(R11, var_slot(ident));
+        asm_element_store(expr_regs[1], get_element_type(ident));
+    }
+
+    void generate_statement(const NodeStatement *stmt) {
+        struct StatementVisitor {
+            BaselineGenerator &gen;
+
+            void operator()(const NodeStmtVariable *stmt_var) const {
+                const std::string &ident = stmt_var->ident.value.value();
+                gen.check_ident(stmt_var->ident, false);
+
+                gen.var_types.try_emplace(ident, stmt_var->type);
+                gen.scopes.top().push_back(ident);
+
+                //Constants are kept in their slots like variables, only checked to be known at compile time
+                if (stmt_var->constant) {
+                    gen.label_expr(stmt_var->expr, stmt_var->type);
+                    const auto value = IRGenerator::evaluate(stmt_var->expr, gen.constants);
+                    if (!value.has_value()) IRGenerator::constant_value_err(stmt_var->ident);
+                    gen.constants.try_emplace(ident, value.value());
+                } else if (gen.store_alias(stmt_var->ident, stmt_var->expr, stmt_var->type, true)) {
+                    return;
+                }
+
+                gen.generate_store(ident, stmt_var->expr, stmt_var->type);
+            }
+
+            void operator()(const NodeStmtExit *stmt_exit) const {
+                gen.generate_exit(stmt_exit);
+            }
+
+            void operator()(const NodeStmtScope *stmt_scope) const {
+                gen.begin_scope(allocates(stmt_scope));
+
+                for (const NodeStatement *stmt: stmt_scope->statements) {
+                    gen.generate_statement(stmt);
+                }
+
+                gen.end_scope();
+            }
+
+            void operator()(const NodeStmtIf *stmt_if) const {
+                const std::string end_label = gen.get_new_label();
+                std::string false_label = gen.get_new_label();
+                gen.generate_if_pred(stmt_if->pred, false_label, end_label);
+
+                for (const NodeIfPred *pred_if: stmt_if->pred_elif) {
+                    gen.asm_label(false_label);
+                    false_label = gen.get_new_label();
+                    gen.generate_if_pred(pred_if, false_label, end_label);
+                }
+
+                gen.asm_label(false_label);
+
+                if (stmt_if->pred_else.has_value()) {
+                    gen.generate_statement(stmt_if->pred_else.value()->stmt);
+                }
+
+                gen.asm_label(end_label);
+            }
+
+            void operator()(const NodeStmtAssign *stmt_assign) const {
+                const std::string &ident = stmt_assign->ident.value.value();
+                gen.check_ident(stmt_assign->ident, true);
+                if (gen.constants.contains(ident)) IRGenerator::constant_err(stmt_assign->ident);
+                if (gen.loop_counters.contains(ident)) IRGenerator::counter_err(stmt_assign->ident);
+
+                if (gen.store_alias(stmt_assign->ident, stmt_assign->expr, gen.var_types[ident], false)) return;
+                gen.generate_store(ident, stmt_assign->expr, gen.var_types[ident]);
+            }
+
+            void operator()(const NodeStmtWhile *stmt_while) const {
+                const std::string start_label = gen.get_new_label();
+                const std::string end_label = gen.get_new_label();
+                auto label_pair = std::pair{start_label, end_label};
+                gen.loop_labels.emplace(label_pair);
+
+                gen.asm_label(start_label);
+
+                if (stmt_while->expr.has_value()) {
+                    gen.generate_condition(stmt_while->expr.value(), end_label);
+                }
+
+                gen.generate_statement(stmt_while->stmt);
+                gen.asm_jump(start_label);
+
+                gen.asm_label(end_label);
+
+                if (!gen.loop_labels.empty() && gen.loop_labels.top() == label_pair) {
+                    gen.loop_labels.pop();
+                }
+            }
+
+            //The same counted loop as the optimized code, with the bound kept in a slot unless it's a literal
+            void operator()(const NodeStmtFor *stmt_for) const {
+                const std::string &ident = stmt_for->ident.value.value();
+                gen.check_ident(stmt_for->ident, false);
+
+                gen.generate_store(ident, stmt_for->from, TokenType::var_type_int);
+                std::string bound;
+                if (const auto operand = gen.leaf_operand(stmt_for->to); operand.has_value() && is_imm(operand.value())) {
+                    gen.label_expr(stmt_for->to, TokenType::var_type_int);
+                    bound = operand.value();
+                } else {
+                    gen.generate_store("koniec(" + ident + ")", stmt_for->to, TokenType::var_type_int);
+                    bound = gen.var_slot("koniec(" + ident + ")");
+                }
+
+                long long step = 1;
+                if (stmt_for->step.has_value()) {
+                    gen.label_expr(stmt_for->step.value(), TokenType::var_type_int);
+                    const auto value = IRGenerator::evaluate(stmt_for->step.value(), gen.constants);
+                    if (!value.has_value() || value.value() == 0) IRGenerator::step_err(stmt_for->ident);
+                    step = value.value();
+                }
+
+                gen.var_types.try_emplace(ident, TokenType::var_type_int);
+                gen.loop_counters.insert(ident);
+
+                const std::string start_label = gen.get_new_label();
+                const std::string continue_label = gen.get_new_label();
+                const std::string end_label = gen.get_new_label();
+                auto label_pair = std::pair{continue_label, end_label};
+                gen.loop_labels.emplace(label_pair);
+
+                gen.asm_label(start_label);
+                gen.asm_mov(RAX, gen.var_slot(ident));
+                gen.emit("cmp", {RAX, bound});
+                gen.emit(step > 0 ? "jg" : "jl", {end_label});
+
+                gen.begin_scope(allocates(stmt_for->stmt));
+                if (const auto *stmt_scope = std::get_if<NodeStmtScope *>(&stmt_for->stmt->var)) {
+                    for (const NodeStatement *stmt: (*stmt_scope)->statements) {
+                        gen.generate_statement(stmt);
+                    }
+                } else {
+                    gen.generate_statement(stmt_for->stmt);
+                }
+
+                //A counter that would wrap around past the bound has had its last iteration
+                gen.asm_label(continue_label);
+                gen.asm_mov(RAX, gen.var_slot(ident));
+                gen.emit("add", {RAX, std::to_string(step)});
+                gen.emit("jo", {end_label});
+                gen.asm_mov(gen.var_slot(ident), RAX);
+                gen.end_scope();
+                gen.asm_jump(start_label);
+
+                gen.asm_label(end_label);
+
+                if (!gen.loop_labels.empty() && gen.loop_labels.top() == label_pair) {
+                    gen.loop_labels.pop();
+                }
+                gen.var_types.erase(ident);
+                gen.loop_counters.erase(ident);
+            }
+
+            void operator()(const NodeStmtBreak *stmt_break) const {
+                if (gen.loop_labels.empty()) {
+                    std::cerr
+                            << "[BŁĄD] [Analiza semantyczna] Instrukcja 'przerwij' poza zakresem pętli \n\t w linijce "
+                            <<
+                            stmt_break->token.line << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+
+                gen.asm_jump(gen.loop_labels.top().second);
+                gen.loop_labels.pop();
+            }
+
+            void operator()(const NodeStmtContinue *stmt_continue) const {
+                if (gen.loop_labels.empty()) {
+                    std::cerr
+                            << "[BŁĄD] [Analiza semantyczna] Instrukcja 'kontynuuj' poza zakresem pętli \n\t w linijce "
+                            <<
+                            stmt_continue->token.line << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+
+                gen.asm_jump(gen.loop_labels.top().first);
+            }
+
+            void operator()(const NodeStmtPrintInt *stmt_print) const {
+                gen.asm_mov(RAX, gen.generate_value(stmt_print->expr, TokenType::var_type_int));
+                gen.emit("call", {"_print_int"});
+            }
+
+            void operator()(const NodeStmtPrintChar *stmt_print) const {
+                gen.asm_mov(RAX, gen.generate_value(stmt_print->expr, TokenType::var_type_char));
+                gen.emit("call", {"_print_char"});
+            }
+
+            void operator()(const NodeStmtPrintString *stmt_print) const {
+                const std::string &text = stmt_print->text->array_expr->token.value.value();
+                if (text.empty()) return;
+
+                gen.asm_print_string(text);
+            }
+
+            void operator()(const NodeStmtArray *stmt_array) const {
+                const std::string &ident = stmt_array->ident.value.value();
+                gen.check_ident(stmt_array->ident, false);
+
+                const std::vector<NodeExpr *> &sizes = stmt_array->sizes;
+                std::vector<std::string> dimensions;
+                for (size_t i = 0; i < sizes.size(); i++) {
+                    dimensions.push_back(IRGenerator::dimension_name(ident, i, sizes.size()));
+                }
+
+                //The sizes of the dimensions are kept for the indexing, and multiplied into the size of the block
+                std::string size;
+                if (sizes.size() == 1) {
+                    size = gen.generate_value(sizes.front(), TokenType::var_type_int);
+                    if (gen.bounds_check) gen.asm_mov(gen.var_slot(dimensions.front()), size);
+                } else {
+                    for (size_t i = 0; i < sizes.size(); i++) {
+                        gen.asm_mov(gen.var_slot(dimensions[i]), gen.generate_value(sizes[i], TokenType::var_type_int));
+                    }
+                    size = expr_regs.front();
+                    gen.asm_mov(size, gen.var_slot(dimensions.front()));
+                    for (size_t i = 1; i < sizes.size(); i++) {
+                        gen.emit("imul", {size, gen.var_slot(dimensions[i])});
+                    }
+                }
+
+                //Arrays are carved from the top of the heap, the old top is where the new array starts
+                const ElementType element = IRGenerator::get_array_element(stmt_array->type);
+                gen.asm_array_bytes(size, element);
+                gen.asm_mov(RDX, frame_slot(heap_top_slot));
+                gen.emit("lea", {RDI, "[rdx + " + size + "]"});
+                gen.asm_mov(frame_slot(heap_top_slot), RDI);
+                gen.emit("call", {"_heap_alloc"});
+
+                //Memory given back at the end of a scope is handed out again, so the elements have to be cleared
+                gen.asm_mov(RDI, RDX);
+                gen.asm_mov(RCX, size);
+                gen.emit("shr", {RCX, "3"});
+                gen.asm_mov(RAX, "0");
+                gen.emit("call", {"_fill_qwords"});
+
+                const TokenType type = IRGenerator::get_array_value_type(stmt_array->type);
+                gen.var_types.try_emplace(ident, type);
+                gen.array_elements.try_emplace(ident, element);
+                gen.array_dimensions.try_emplace(ident, dimensions);
+                gen.scopes.top().push_back(ident);
+                gen.asm_mov(gen.var_slot(ident), RDX);
+
+                if (stmt_array->contents.has_value()) {
+                    const NodeTermArray *array_expr = stmt_array->contents.value();
+
+                    //Literals are copied from read-only data all at once
+                    if (const auto values = gen.literal_values(array_expr, type, element); values.has_value()) {
+                        gen.asm_array_data(ident, pack_elements(element, values.value()));
+                        return;
+                    }
+
+                    for (size_t index = 0; index < array_expr->exprs.size(); index++) {
+                        gen.generate_value(array_expr->exprs.at(index), type);
+                        gen.asm_mov(R11, gen.var_slot(ident));
+                        gen.asm_element_store(std::to_string(index), element);
+                    }
+                }
+            }
+
+            void operator()(const NodeStmtArrAssign *stmt_arr_assign) const {
+                const std::string &ident = stmt_arr_assign->ident.value.value();
+                gen.check_ident(stmt_arr_assign->ident, true);
+
+                gen.generate_element_store(stmt_arr_assign->ident, stmt_arr_assign->indexes, stmt_arr_assign->expr,
+                                           gen.var_types[ident]);
+            }
+        };
+
+        visit(StatementVisitor{*this}, stmt->var);
+    }
+
+    [[nodiscard]] std::vector<AsmInstruction> generate_program() {
+        scopes.emplace();
+
+        bool contains_exit = false;
+        for (const NodeStatement *stmt: root.statements) {
+            if (holds_alternative<NodeStmtExit *>(stmt->var)) {
+                contains_exit = true;
+            }
+
+            generate_statement(stmt);
+        }
+
+        if (!contains_exit) {
+            generate_exit({});
+        }
+
+        //The frame size is only known once every variable got its slot
+        std::vector<AsmInstruction> program = {
+                {AsmInstruction::Kind::directive,   "global _start"},
+                {AsmInstruction::Kind::label,       "_start"},
+                {AsmInstruction::Kind::instruction, "mov", {RBP, RSP}},
+                {AsmInstruction::Kind::instruction, "sub", {RSP, std::to_string((slot_count * 8 + 15) / 16 * 16)}},
+                {AsmInstruction::Kind::instruction, "call", {"_heap_init"}},
+                {AsmInstruction::Kind::instruction, "mov", {frame_slot(heap_top_slot), RAX}},
+        };
+        program.insert(program.end(), asm_out.begin(), asm_out.end());
+
+        //Failed checks are out of the way of the code falling through them
+        for (size_t i = 0; i < bounds_errors.size(); i++) {
+            program.push_back({AsmInstruction::Kind::label, "bounds_error_" + std::to_string(i)});
+            program.push_back({AsmInstruction::Kind::instruction, "mov", {RDI, std::to_string(bounds_errors[i])}});
+            program.push_back({AsmInstruction::Kind::instruction, "call", {"_bounds_error"}});
+        }
+
+        if (!data_out.empty()) {
+            program.push_back({AsmInstruction::Kind::directive, "section .rodata"});
+            program.insert(program.end(), data_out.begin(), data_out.end());
+        }
+
+        return program;
+    }
+
+private:
+    static inline const std::string RAX = "rax";
+    static inline const std::string RDX = "rdx";
+    static inline const std::string RDI = "rdi";
+    static inline const std::string RSI = "rsi";
+    static inline const std::string RCX = "rcx";
+    static inline const std::string R11 = "r11";
+    static inline const std::string RSP = "rsp";
+    static inline const std::string RBP = "rbp";
+
+    //Neither syscalls nor the runtime overwrite these, rax, rdx and r11 are left for division and addressing
+    static inline const std::vector<std::string> expr_regs = {
+            "rbx", "r8", "r9", "r10", "r12", "r13", "r14", "r15"
+    };
+
+    static inline const std::map<std::string, std::string> low_bytes = {
+            {"rbx", "bl"}, {"r8", "r8b"}, {"r9", "r9b"}, {"r10", "r10b"},
+            {"r12", "r12b"}, {"r13", "r13b"}, {"r14", "r14b"}, {"r15", "r15b"},
+    };
+
+    //Narrower integers are sign extended, characters zero extended
+    static inline const std::map<ElementType, std::string> element_loads = {
+            {ElementType::int32,     "movsxd"},
+            {ElementType::int16,     "movsx"},
+            {ElementType::int8,      "movsx"},
+            {ElementType::character, "movzx"},
+    };
+
+    static inline const std::map<TokenType, std::string> condition_codes = {
+            {TokenType::equal,         "e"},
+            {TokenType::not_equal,     "ne"},
+            {TokenType::greater,       "g"},
+            {TokenType::greater_equal, "ge"},
+            {TokenType::less,          "l"},
+            {TokenType::less_equal,    "le"},
+    };
+
+    static inline const std::map<TokenType, std::string> inverted_condition_codes = {
+            {TokenType::equal,         "ne"},
+            {TokenType::not_equal,     "e"},
+            {TokenType::greater,       "le"},
+            {TokenType::greater_equal, "l"},
+            {TokenType::less,          "ge"},
+            {TokenType::less_equal,    "g"},
+    };
+
+    NodeStart root;
+    bool bounds_check;
+    std::vector<int> bounds_errors;
+    std::vector<AsmInstruction> asm_out;
+    std::vector<AsmInstruction> data_out;
+    int array_data_counter = 0;
+
+    std::map<std::string, TokenType> var_types;
+    std::map<std::string, long long> constants;
+    std::map<std::string, ElementType> array_elements;
+    std::map<std::string, std::vector<std::string>> array_dimensions;
+    std::set<std::string> loop_counters;
+    std::stack<std::vector<std::string>> scopes;
+    std::map<const NodeExpr *, int> needs;
+
+    int label_counter = 0;
+    std::stack<std::pair<std::string, std::string>> loop_labels;
+
+    //Frame slots below rbp: the heap top, a buffer for reading single characters, then variables and saved heap tops
+    static constexpr size_t heap_top_slot = 0;
+    static constexpr size_t io_slot = 1;
+    size_t slot_count = 2;
+    std::map<std::string, size_t> var_slots;
+    std::vector<size_t> scope_slots;
+    std::vector<bool> allocating_scopes;
+
+    void check_ident(const Token &ident, const bool should_exist) const {
+        const std::string &ident_str = ident.value.value();
+
+        if (var_types.contains(ident_str)) {
+            if (!should_exist) {
+                std::cerr << "[BŁĄD] [Analiza semantyczna] Redeklaracja identyfikatora '" << ident_str <<
+                          "' \n\t w linijce " << ident.line << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            if (should_exist) {
+                std::cerr << "[BŁĄD] [Analiza semantyczna] Nieznany identyfikator '" << ident_str << "' \n\t w linijce "
+                          <<
+                          ident.line << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    void generate_if_pred(const NodeIfPred *pred_if, const std::string &false_label, const std::string &end_label) {
+        generate_condition(pred_if->expr, false_label);
+        generate_statement(pred_if->stmt);
+        asm_jump(end_label);
+    }
+
+    void generate_exit(const std::optional<const NodeStmtExit *> stmt_exit) {
+        if (stmt_exit.has_value()) {
+            asm_mov(RDI, generate_value(stmt_exit.value()->expr, TokenType::var_type_int));
+        } else {
+            asm_mov(RDI, "0");
+        }
+        emit("call", {"_flush"});
+        asm_mov(RAX, "60");
+        emit("syscall");
+    }
+
+    //Scopes with an array declared anywhere inside them give the memory back at their end
+    static bool allocates(const NodeStatement *stmt) {
+        if (std::holds_alternative<NodeStmtArray *>(stmt->var)) return true;
+
+        if (const auto *stmt_scope = std::get_if<NodeStmtScope *>(&stmt->var)) {
+            return allocates(*stmt_scope);
+        }
+        if (const auto *stmt_while = std::get_if<NodeStmtWhile *>(&stmt->var)) {
+            return allocates((*stmt_while)->stmt);
+        }
+        if (const auto *stmt_for = std::get_if<NodeStmtFor *>(&stmt->var)) {
+            return allocates((*stmt_for)->stmt);
+        }
+        if (const auto *stmt_if = std::get_if<NodeStmtIf *>(&stmt->var)) {
+            if (allocates((*stmt_if)->pred->stmt)) return true;
+            for (const NodeIfPred *pred: (*stmt_if)->pred_elif) {
+                if (allocates(pred->stmt)) return true;
+            }
+            return (*stmt_if)->pred_else.has_value() && allocates((*stmt_if)->pred_else.value()->stmt);
+        }
+        return false;
+    }
+
+    static bool allocates(const NodeStmtScope *stmt_scope) {
+        return std::ranges::any_of(stmt_scope->statements, [](const NodeStatement *stmt) {
+            return allocates(stmt);
+        });
+    }
+
+    void begin_scope(const bool allocating) {
+        scopes.emplace();
+        allocating_scopes.push_back(allocating);
+        if (!allocating) return;
+
+        if (scope_slots.size() < allocating_scopes.size()) {
+            scope_slots.resize(allocating_scopes.size(), 0);
+        }
+        if (scope_slots[allocating_scopes.size() - 1] == 0) {
+            scope_slots[allocating_scopes.size() - 1] = slot_count++;
+        }
+
+        asm_mov(RAX, frame_slot(heap_top_slot));
+        asm_mov(frame_slot(scope_slots[allocating_scopes.size() - 1]), RAX);
+    }
+
+    void end_scope() {
+        for (const std::string &var: scopes.top()) {
+            var_types.erase(var);
+            constants.erase(var);
+            array_elements.erase(var);
+            array_dimensions.erase(var);
+        }
+        scopes.pop();
+
+        if (allocating_scopes.back()) {
+            asm_mov(RSI, frame_slot(heap_top_slot));
+            asm_mov(RDI, frame_slot(scope_slots[allocating_scopes.size() - 1]));
+            asm_mov(frame_slot(heap_top_slot), RDI);
+            emit("call", {"_heap_release"});
+        }
+        allocating_scopes.pop_back();
+    }
+
+    std::string var_slot(const std::string &ident) {
+        auto [it, inserted] = var_slots.try_emplace(ident, slot_count);
+        if (inserted) slot_count++;
+        return frame_slot(it->second);
+    }
+
+    //The stored values of the elements, if all of them are literals
+    std::optional<std::vector<long long>> literal_values(const NodeTermArray *array_expr, const TokenType type,
+                                                         const ElementType element) {
+        std::vector<long long> values;
+        for (const NodeExpr *expr: array_expr->exprs) {
+            label_expr(expr, type);
+
+            const auto operand = leaf_operand(expr);
+            if (!operand.has_value() || !is_imm(operand.value())) return {};
+            values.push_back(element_value(element, std::stoll(operand.value())));
+        }
+        return values;
+    }
+
+    void asm_array_data(const std::string &ident, const std::vector<int64_t> &words) {
+        const std::string data = "array_data_" + std::to_string(array_data_counter++);
+
+        asm_mov(RDI, var_slot(ident));
+        asm_mov(RSI, data);
+        asm_mov(RCX, std::to_string(words.size()));
+        emit("call", {"_copy_qwords"});
+
+        data_out.push_back({AsmInstruction::Kind::label, data});
+        for (const int64_t word: words) {
+            data_out.push_back({AsmInstruction::Kind::instruction, "dq", {std::to_string(word)}});
+        }
+    }
+
+    void asm_print_string(const std::string &text) {
+        const std::string data = "array_data_" + std::to_string(array_data_counter++);
+
+        asm_mov(RSI, data);
+        asm_mov(RCX, std::to_string(text.size()));
+        emit("call", {"_print_bytes"});
+
+        data_out.push_back({AsmInstruction::Kind::label, data});
+        for (const int64_t word: pack_elements(ElementType::character, {text.begin(), text.end()})) {
+            data_out.push_back({AsmInstruction::Kind::instruction, "dq", {std::to_string(word)}});
+        }
+    }
+
+    //Indexing a scalar treats it as a pointer to qwords, unless it was given a narrower array
+    [[nodiscard]] ElementType get_element_type(const std::string &ident) const {
+        if (!array_elements.contains(ident)) return ElementType::int64;
+        return array_elements.at(ident);
+    }
+
+    //Registers needed to evaluate the indexes of an element, see generate_index
+    int label_index(const Token &array, const std::vector<NodeExpr *> &indexes) {
+        const std::string &ident = array.value.value();
+        if (constants.contains(ident)) IRGenerator::constant_err(array);
+        IRGenerator::check_index_count(array, array_dimensions.contains(ident) ? array_dimensions.at(ident).size() : 1,
+                                       indexes.size());
+
+        int need = label_expr(indexes.front(), TokenType::var_type_int);
+        for (size_t i = 1; i < indexes.size(); i++) {
+            need = std::max(need, label_expr(indexes[i], TokenType::var_type_int) + 1);
+        }
+        return need;
+    }
+
+    //Leaves the position of the element in the first register, row-major like IRGenerator::generate_index
+    void generate_index(const Token &array, const std::vector<NodeExpr *> &indexes,
+                        const std::vector<std::string> &regs) {
+        const std::string &ident = array.value.value();
+        generate_expr(indexes.front(), regs);
+        asm_bounds_check(ident, 0, regs.front(), array.line);
+
+        for (size_t i = 1; i < indexes.size(); i++) {
+            emit("imul", {regs.front(), var_slot(array_dimensions.at(ident)[i])});
+
+            if (static_cast<size_t>(needs.at(indexes[i])) < regs.size()) {
+                generate_expr(indexes[i], without(regs, regs.front()));
+                asm_bounds_check(ident, i, regs[1], array.line);
+                emit("add", {regs.front(), regs[1]});
+            } else {
+                //Not enough registers to hold the row while evaluating the index
+                emit("push", {regs.front()});
+                generate_expr(indexes[i], regs);
+                asm_bounds_check(ident, i, regs.front(), array.line);
+                emit("pop", {R11});
+                emit("add", {regs.front(), R11});
+            }
+        }
+    }
+
+    //Only declared arrays have known dimensions, a scalar holding the address of one is indexed unchecked
+    void asm_bounds_check(const std::string &ident, const size_t dimension, const std::string &index, const int line) {
+        if (!bounds_check || !array_dimensions.contains(ident)) return;
+
+        const std::string fail = "bounds_error_" + std::to_string(bounds_errors.size());
+        bounds_errors.push_back(line);
+        emit("cmp", {index, var_slot(array_dimensions.at(ident)[dimension])});
+        emit("jae", {fail});
+    }
+
+    //The size of an array in bytes, rounded up to whole qwords
+    void asm_array_bytes(const std::string &reg, const ElementType element) {
+        const int bits = element_bits(element);
+        if (bits == 64) {
+            emit("shl", {reg, "3"});
+            return;
+        }
+
+        if (bits > 8) emit("shl", {reg, std::to_string(std::countr_zero(static_cast<unsigned>(bits / 8)))});
+        emit("add", {reg, bits == 1 ? "63" : "7"});
+        if (bits == 1) {
+            emit("shr", {reg, "6"});
+            emit("shl", {reg, "3"});
+        } else {
+            emit("and", {reg, "-8"});
+        }
+    }
+
+    //Replaces the index in the given register with the element of the array r11 points to
+    void asm_element_load(const std::string &reg, const ElementType element) {
+        if (element == ElementType::boolean) {
+            asm_mov(RAX, reg);
+            emit("shr", {RAX, "6"});
+            asm_mov(RAX, "QWORD [r11 + rax*8]");
+            emit("bt", {RAX, reg});
+            emit("setc", {"al"});
+            emit("movzx", {reg, "al"});
+            return;
+        }
+
+        const int bytes = element_bits(element) / 8;
+        const std::string address = memory_size(bytes) + " [r11 + " + reg + scale(bytes) + "]";
+        if (element == ElementType::int64) {
+            asm_mov(reg, address);
+        } else {
+            emit(element_loads.at(element), {reg, address});
+        }
+    }
+
+    //Stores the first expression register as the element at the given index, a register or a literal
+    void asm_element_store(const std::string &index, const ElementType element) {
+        if (element == ElementType::boolean) {
+            //Only the low byte tells whether the value is true
+            if (is_imm(index)) asm_mov(expr_regs[1], index);
+            asm_mov(RAX, expr_regs[1]);
+            emit("shr", {RAX, "6"});
+            emit("lea", {R11, "[r11 + rax*8]"});
+            asm_mov(RAX, "QWORD [r11]");
+            emit("btr", {RAX, expr_regs[1]});
+            asm_mov(RDX, RAX);
+            emit("bts", {RDX, expr_regs[1]});
+            emit("test", {low_bytes.at(expr_regs.front()), low_bytes.at(expr_regs.front())});
+            emit("cmovnz", {RAX, RDX});
+            asm_mov("QWORD [r11]", RAX);
+            return;
+        }
+
+        const int bytes = element_bits(element) / 8;
+        const std::string address = is_imm(index) ? "[r11 + " + std::to_string(std::stoll(index) * bytes) + "]"
+                                                   : "[r11 + " + index + scale(bytes) + "]";
+        asm_mov(memory_size(bytes) + " " + address, sub_register(expr_regs.front(), bytes));
+    }
+
+    static std::string scale(const int bytes) {
+        return bytes == 1 ? "" : "*" + std::to_string(bytes);
+    }
+
+    static std::string frame_slot(const size_t slot) {
+        return "QWORD " + frame_address(slot);
+    }
+
+    static std::string frame_address(const size_t slot) {
+        return "[rbp - " + std::to_string((slot + 1) * 8) + "]";
+    }
+
+    static const NodeExpr *unwrap_parens(const NodeExpr *expr) {
+        while (const auto *term = std::get_if<NodeTerm *>(&expr->var)) {
+            const auto *paren = std::get_if<NodeTermParen *>(&(*term)->var);
+            if (paren == nullptr) break;
+            expr = (*paren)->expr;
+        }
+        return expr;
+    }
+
+    //A frame slot or an immediate holding the value of a variable or a literal
+    std::optional<std::string> leaf_operand(const NodeExpr *expr) {
+        const auto *term = std::get_if<NodeTerm *>(&unwrap_parens(expr)->var);
+        if (term == nullptr) return {};
+        return leaf_term_operand(*term);
+    }
+
+    std::optional<std::string> leaf_term_operand(const NodeTerm *term) {
+        if (const auto *int_lit = std::get_if<NodeTermIntLit *>(&term->var)) {
+            return (*int_lit)->int_lit.value.value();
+        }
+        if (const auto *bool_lit = std::get_if<NodeTermBoolLit *>(&term->var)) {
+            return (*bool_lit)->bool_lit.value.value();
+        }
+        if (const auto *char_lit = std::get_if<NodeTermCharLit *>(&term->var)) {
+            return std::to_string(static_cast<unsigned char>((*char_lit)->char_lit.value.value()[0]));
+        }
+        if (const auto *ident = std::get_if<NodeTermIdent *>(&term->var)) {
+            return var_slot((*ident)->ident.value.value());
+        }
+        if (const auto *paren = std::get_if<NodeTermParen *>(&term->var)) {
+            return leaf_operand((*paren)->expr);
+        }
+        return {};
+    }
+
+    static bool reads_char(const NodeExpr *expr) {
+        return IRGenerator::any_term(expr, [](const NodeTerm *term) {
+            return std::holds_alternative<NodeTermReadChar *>(term->var);
+        });
+    }
+
+    static std::vector<std::string> without(const std::vector<std::string> &regs, const std::string &reg) {
+        std::vector<std::string> result;
+        for (const std::string &other: regs) {
+            if (other != reg) result.push_back(other);
+        }
+        return result;
+    }
+
+    static bool is_imm(const std::string &operand) {
+        char *p;
+        strtol(operand.c_str(), &p, 10);
+        return *p == 0;
+    }
+
+    std::string get_new_label() {
+        return "label_" + std::to_string(label_counter++);
+    }
+
+    void emit(const std::string &opcode, const std::vector<std::string> &operands = {}) {
+        asm_out.push_back({AsmInstruction::Kind::instruction, opcode, operands});
+    }
+
+    void asm_mov(const std::string &dest, const std::string &src) {
+        if (dest == src) return;
+        emit("mov", {dest, src});
+    }
+
+    void asm_jump(const std::string &label) {
+        emit("jmp", {label});
+    }
+
+    void asm_label(const std::string &label) {
+        asm_out.push_back({AsmInstruction::Kind::label, label});
+    }
+};
@@ -0,0 +1,763 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <stack>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+#include "ir_generator.hpp"
+#include "ir_optimizer.hpp"
+
+enum class Opcode : uint8_t {
+    add, subtract, multiply, divide, modulo, log_and, log_or,
+    is_equal, not_equal, is_greater, is_greater_equal, is_less, is_less_equal,
+    log_not, move, cond_move, jump, jump_false, jump_table, loop_jump,
+    jump_not_equal, jump_equal, jump_less_equal, jump_less, jump_greater_equal, jump_greater,
+    move_if_equal, move_if_not_equal, move_if_greater, move_if_greater_equal, move_if_less, move_if_less_equal,
+    prog_exit, print_int, print_char, read_char, bgn_scope, end_scope,
+    array_allocate, array_get, array_assign, array_add, array_fill, array_copy, print_array,
+    array_get_int32, array_get_int16, array_get_int8, array_get_char, array_get_bit,
+    array_assign_int32, array_assign_int16, array_assign_int8, array_assign_bit,
+    array_fill_int32, array_fill_int16, array_fill_int8, array_copy_int32, array_copy_int16, array_copy_int8,
+    print_array_bytes, array_init, array_constant, bounds_check, print_string, halt
+};
+
+//Operands are frame slot indices, except jump targets, which are instruction indices
+struct Bytecode {
+    Opcode opcode;
+    uint32_t a = 0;
+    uint32_t b = 0;
+    uint32_t c = 0;
+    uint32_t d = 0;
+};
+
+/*
+ * Interprets the intermediate code without any toolchain. The instructions are compiled into a register-based
+ * bytecode working on a frame of 64-bit slots: one per variable, temporary, scope and literal.
+ * Common sequences are fused into superinstructions:
+ *
+ *  #t = lt a, b; jmp_false #t, L                 ->  jump_greater_equal a, b, L
+ *  #t = eq a, b; x = cmov #t, y                  ->  move_if_equal x, a, b, y
+ *  #t = offset_get t, i; #u = add #t, v;
+ *  t = offset_set i, #u                          ->  array_add t, i, v
+ *  #t = add a, b; x = #t                         ->  add x, a, b
+ *
+ * The bytecode is run as direct-threaded code, each instruction holding the address of its handler. The behaviour
+ * matches the native backend exactly, including comparisons only replacing the lowest byte of the left operand.
+ *
+ * Given a hot loop handler, backward jumps count how many times they were taken. Once one is taken
+ * hot_loop_threshold times, the handler is called with the label of the loop header and may finish running the
+ * program, returning its exit code.
+ */
+class BytecodeVM {
+public:
+    using HotLoopHandler = std::function<std::optional<int>(const std::string &)>;
+
+    static constexpr uint64_t hot_loop_threshold = 1000;
+    static constexpr uint64_t heap_size = 1ull << 40;
+    static constexpr size_t digit_space_size = 22;
+
+    explicit BytecodeVM(const std::vector<TACInstruction> &instructions, HotLoopHandler on_hot_loop = {}) :
+            instructions(instructions), on_hot_loop(std::move(on_hot_loop)) {
+    }
+
+    BytecodeVM(const BytecodeVM &) = delete;
+    BytecodeVM &operator=(const BytecodeVM &) = delete;
+
+    ~BytecodeVM() {
+        if (heap != nullptr) munmap(heap, heap_size);
+    }
+
+    void compile() {
+        for (size_t i = 0; i < instructions.size(); i++) {
+            i += compile_instruction(i);
+        }
+        code.push_back({Opcode::halt});
+
+        for (const auto &[index, label]: fixups) {
+            uint32_t &target = code[index].opcode == Opcode::jump ? code[index].a
+                               : code[index].opcode == Opcode::jump_false ? code[index].b
+                               : code[index].c;
+            target = labels.at(label);
+        }
+        for (uint32_t &entry: tables) {
+            entry = labels.at(table_labels[entry]);
+        }
+    }
+
+    [[nodiscard]] const std::vector<Bytecode> &get_code() const {
+        return code;
+    }
+
+    //Value of a variable or temporary while the hot loop handler runs, if it has one
+    [[nodiscard]] std::optional<int64_t> get_value(const std::string &name) const {
+        if (!slots.contains(name)) return {};
+        return current_frame[slots.at(name)];
+    }
+
+    //The heap top saved by the scope starting at the given instruction
+    [[nodiscard]] std::optional<int64_t> get_scope_top(const size_t scope) const {
+        if (!scope_slots.contains(scope)) return {};
+        return current_frame[scope_slots.at(scope)];
+    }
+
+    [[nodiscard]] void *get_heap() const {
+        return heap;
+    }
+
+    [[nodiscard]] int64_t *get_heap_top() const {
+        return current_heap_top;
+    }
+
+    [[nodiscard]] const unsigned char *get_digit_space() const {
+        return digit_space;
+    }
+
+    //Runs the compiled bytecode and returns the exit code of the program
+    [[nodiscard]] int run() {
+        heap = mmap(nullptr, heap_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (heap == MAP_FAILED) {
+            heap = nullptr;
+            std::cerr << "[BŁĄD] [Interpreter] Nie udało się zarezerwować pamięci na sterty programu" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        std::vector<int64_t> frame(slot_count, 0);
+        for (const auto &[value, slot]: constants) {
+            frame[slot] = value;
+        }
+
+        loop_counters.assign(loop_headers.size(), 0);
+        const int exit_code = execute(frame.data());
+        flush();
+        return exit_code;
+    }
+
+private:
+    const std::vector<TACInstruction> &instructions;
+    HotLoopHandler on_hot_loop;
+
+    std::vector<Bytecode> code;
+    std::map<std::string, uint32_t> slots;
+    std::map<int64_t, uint32_t> constants;
+    uint32_t slot_count = 0;
+    std::stack<uint32_t> open_scopes;
+    std::map<size_t, uint32_t> scope_slots;
+    static constexpr uint32_t no_scope = UINT32_MAX;
+
+    std::map<std::string, uint32_t> labels;
+    std::vector<std::pair<size_t, std::string>> fixups;
+    std::vector<uint32_t> tables;
+    std::vector<std::string> table_labels;
+
+    std::vector<std::string> loop_headers;
+    std::vector<uint64_t> loop_counters;
+
+    //Packed elements of the arrays initialized with literals
+    std::vector<std::vector<int64_t>> array_data;
+
+    void *heap = nullptr;
+    const int64_t *current_frame = nullptr;
+    int64_t *current_heap_top = nullptr;
+
+    char output[1 << 16];
+    size_t output_size = 0;
+    unsigned char digit_space[digit_space_size] = {};
+
+    static inline const std::map<OperationType, Opcode> binary_opcodes = {
+            {OperationType::add,              Opcode::add},
+            {OperationType::subtract,         Opcode::subtract},
+            {OperationType::multiply,         Opcode::multiply},
+            {OperationType::divide,           Opcode::divide},
+            {OperationType::modulo,           Opcode::modulo},
+            {OperationType::log_and,          Opcode::log_and},
+            {OperationType::log_or,           Opcode::log_or},
+            {OperationType::is_equal,         Opcode::is_equal},
+            {OperationType::not_equal,        Opcode::not_equal},
+            {OperationType::is_greater,       Opcode::is_greater},
+            {OperationType::is_greater_equal, Opcode::is_greater_equal},
+            {OperationType::is_less,          Opcode::is_less},
+            {OperationType::is_less_equal,    Opcode::is_less_equal},
+    };
+
+    //Jumps taken when the comparison is false
+    static inline const std::map<OperationType, Opcode> branch_opcodes = {
+            {OperationType::is_equal,         Opcode::jump_not_equal},
+            {OperationType::not_equal,        Opcode::jump_equal},
+            {OperationType::is_greater,       Opcode::jump_less_equal},
+            {OperationType::is_greater_equal, Opcode::jump_less},
+            {OperationType::is_less,          Opcode::jump_greater_equal},
+            {OperationType::is_less_equal,    Opcode::jump_greater},
+    };
+
+    //Opcodes for the arrays with narrower elements, characters are stored like any other byte
+    static inline const std::map<ElementType, Opcode> get_opcodes = {
+            {ElementType::int64,     Opcode::array_get},
+            {ElementType::int32,     Opcode::array_get_int32},
+            {ElementType::int16,     Opcode::array_get_int16},
+            {ElementType::int8,      Opcode::array_get_int8},
+            {ElementType::character, Opcode::array_get_char},
+            {ElementType::boolean,   Opcode::array_get_bit},
+    };
+
+    static inline const std::map<ElementType, Opcode> assign_opcodes = {
+            {ElementType::int64,     Opcode::array_assign},
+            {ElementType::int32,     Opcode::array_assign_int32},
+            {ElementType::int16,     Opcode::array_assign_int16},
+            {ElementType::int8,      Opcode::array_assign_int8},
+            {ElementType::character, Opcode::array_assign_int8},
+            {ElementType::boolean,   Opcode::array_assign_bit},
+    };
+
+    static inline const std::map<ElementType, Opcode> fill_opcodes = {
+            {ElementType::int64,     Opcode::array_fill},
+            {ElementType::int32,     Opcode::array_fill_int32},
+            {ElementType::int16,     Opcode::array_fill_int16},
+            {ElementType::int8,      Opcode::array_fill_int8},
+            {ElementType::character, Opcode::array_fill_int8},
+    };
+
+    static inline const std::map<ElementType, Opcode> copy_opcodes = {
+            {ElementType::int64,     Opcode::array_copy},
+            {ElementType::int32,     Opcode::array_copy_int32},
+            {ElementType::int16,     Opcode::array_copy_int16},
+            {ElementType::int8,      Opcode::array_copy_int8},
+            {ElementType::character, Opcode::array_copy_int8},
+    };
+
+    static inline const std::map<OperationType, Opcode> cond_move_opcodes = {
+            {OperationType::is_equal,         Opcode::move_if_equal},
+            {OperationType::not_equal,        Opcode::move_if_not_equal},
+            {OperationType::is_greater,       Opcode::move_if_greater},
+            {OperationType::is_greater_equal, Opcode::move_if_greater_equal},
+            {OperationType::is_less,          Opcode::move_if_less},
+            {OperationType::is_less_equal,    Opcode::move_if_less_equal},
+    };
+
+    uint32_t slot(const std::string &operand) {
+        if (IROptimizer::is_num(operand)) {
+            const auto [it, inserted] = constants.try_emplace(std::stoll(operand), slot_count);
+            if (inserted) slot_count++;
+            return it->second;
+        }
+
+        const auto [it, inserted] = slots.try_emplace(operand, slot_count);
+        if (inserted) slot_count++;
+        return it->second;
+    }
+
+    void emit(const Opcode opcode, const uint32_t a = 0, const uint32_t b = 0, const uint32_t c = 0,
+              const uint32_t d = 0) {
+        code.push_back({opcode, a, b, c, d});
+    }
+
+    void emit_jump(const Opcode opcode, const std::string &label, const uint32_t a = 0, const uint32_t b = 0) {
+        fixups.emplace_back(code.size(), label);
+        emit(opcode, a, b);
+    }
+
+    //Temporaries are used exactly once, so a temporary moved into a variable by the next instruction never has to be
+    //stored anywhere else
+    std::string destination(const size_t at, size_t &skipped) {
+        const std::string &result = instructions[at].result.value();
+        if (IROptimizer::is_temp(result) && at + 1 < instructions.size()) {
+            const TACInstruction &next = instructions[at + 1];
+            if (next.op == OperationType::assign && next.arg1 == result) {
+                skipped++;
+                return next.result.value();
+            }
+        }
+        return result;
+    }
+
+    bool allocates_in_scope(const size_t begin) const {
+        int depth = 0;
+        for (size_t i = begin; i < instructions.size(); i++) {
+            if (instructions[i].op == OperationType::bgn_scope) depth++;
+            if (instructions[i].op == OperationType::end_scope && --depth == 0) return false;
+            if (instructions[i].op == OperationType::array_allocate || instructions[i].op == OperationType::array_stack ||
+                instructions[i].op == OperationType::array_static) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool is_array_add(const size_t at) const {
+        if (at + 2 >= instructions.size()) return false;
+
+        const TACInstruction &get = instructions[at];
+        const TACInstruction &add = instructions[at + 1];
+        const TACInstruction &set = instructions[at + 2];
+        return get.op == OperationType::array_get && get.element == ElementType::int64 &&
+               add.op == OperationType::add &&
+               set.op == OperationType::array_assign && IROptimizer::is_temp(get.result.value()) &&
+               (add.arg1 == get.result || add.arg2 == get.result) && add.arg1 != add.arg2 &&
+               set.arg2 == add.result && set.result == get.arg1 && set.arg1 == get.arg2;
+    }
+
+    //Compiles the instruction at the given index, returns how many of the following ones it consumed
+    size_t compile_instruction(const size_t at) {
+        const TACInstruction &instr = instructions[at];
+        const auto arg = [&](const std::optional<std::string> &operand) {
+            return slot(operand.value());
+        };
+
+        if (is_array_add(at)) {
+            const TACInstruction &add = instructions[at + 1];
+            emit(Opcode::array_add, arg(instr.arg1), arg(instr.arg2),
+                 arg(add.arg1 == instr.result ? add.arg2 : add.arg1));
+            return 2;
+        }
+
+        if (branch_opcodes.contains(instr.op) && at + 1 < instructions.size() &&
+            instructions[at + 1].arg1 == instr.result) {
+            const TACInstruction &next = instructions[at + 1];
+            if (next.op == OperationType::jump_false) {
+                fixups.emplace_back(code.size(), next.arg2.value());
+                emit(branch_opcodes.at(instr.op), arg(instr.arg1), arg(instr.arg2));
+                return 1;
+            }
+            if (next.op == OperationType::cond_assign) {
+                emit(cond_move_opcodes.at(instr.op), arg(next.result), arg(instr.arg1), arg(instr.arg2),
+                     arg(next.arg2));
+                return 1;
+            }
+        }
+
+        size_t skipped = 0;
+        switch (instr.op) {
+            case OperationType::label:
+                labels[instr.arg1.value()] = code.size();
+                break;
+            case OperationType::jump:
+                if (on_hot_loop && labels.contains(instr.arg1.value())) {
+                    emit(Opcode::loop_jump, labels.at(instr.arg1.value()), loop_headers.size());
+                    loop_headers.push_back(instr.arg1.value());
+                    break;
+                }
+                emit_jump(Opcode::jump, instr.arg1.value());
+                break;
+            case OperationType::jump_false:
+                emit_jump(Opcode::jump_false, instr.arg2.value(), arg(instr.arg1));
+                break;
+            case OperationType::jump_table: {
+                const uint32_t first = tables.size();
+                for (size_t i = at + 1; i < instructions.size() && instructions[i].op == OperationType::table_entry;
+                     i++) {
+                    tables.push_back(table_labels.size());
+                    table_labels.push_back(instructions[i].arg1.value());
+                }
+                fixups.emplace_back(code.size(), instr.arg2.value());
+                emit(Opcode::jump_table, arg(instr.arg1), static_cast<uint32_t>(tables.size()) - first, 0, first);
+                break;
+            }
+            case OperationType::table_entry:
+            case OperationType::array_free:
+            case OperationType::vectorize:
+                break;
+            case OperationType::assign:
+                emit(Opcode::move, arg(instr.result), arg(instr.arg1));
+                break;
+            case OperationType::cond_assign:
+                emit(Opcode::cond_move, arg(instr.result), arg(instr.arg1), arg(instr.arg2));
+                break;
+            case OperationType::log_not:
+                emit(Opcode::log_not, slot(destination(at, skipped)), arg(instr.arg1));
+                break;
+            case OperationType::prog_exit:
+                emit(Opcode::prog_exit, arg(instr.arg1));
+                break;
+            case OperationType::print_int:
+                emit(Opcode::print_int, arg(instr.arg1));
+                break;
+            case OperationType::print_char:
+                emit(Opcode::print_char, arg(instr.arg1));
+                break;
+            case OperationType::read_char:
+                emit(Opcode::read_char, slot(destination(at, skipped)));
+                break;
+            case OperationType::bgn_scope:
+                //Only the arrays move the top of the heap, so scopes without any don't have to restore it
+                open_scopes.push(allocates_in_scope(at) ? slot_count++ : no_scope);
+                if (open_scopes.top() != no_scope) {
+                    scope_slots[at] = open_scopes.top();
+                    emit(Opcode::bgn_scope, open_scopes.top());
+                }
+                break;
+            case OperationType::end_scope:
+                if (open_scopes.top() != no_scope) emit(Opcode::end_scope, open_scopes.top());
+                open_scopes.pop();
+                break;
+            //The interpreter has no frame of its own for the arrays, they all live on its heap
+            case OperationType::array_allocate:
+            case OperationType::array_stack:
+            case OperationType::array_static:
+                //The last operand is the size of an element in bits, not a slot
+                emit(Opcode::array_allocate, slot(destination(at, skipped)), arg(instr.arg1), 0,
+                     element_bits(instr.element));
+                break;
+            case OperationType::array_get:
+                emit(get_opcodes.at(instr.element), slot(destination(at, skipped)), arg(instr.arg1), arg(instr.arg2));
+                break;
+            case OperationType::array_assign:
+                emit(assign_opcodes.at(instr.element), arg(instr.result), arg(instr.arg1), arg(instr.arg2));
+                break;
+            case OperationType::array_fill:
+                emit(fill_opcodes.at(instr.element), arg(instr.result), arg(instr.arg1), arg(instr.arg2),
+                     arg(instr.arg3));
+                break;
+            case OperationType::array_copy:
+                emit(copy_opcodes.at(instr.element), arg(instr.result), arg(instr.arg1), arg(instr.arg2),
+                     arg(instr.arg3));
+                break;
+            case OperationType::array_init:
+            case OperationType::array_constant: {
+                std::vector<long long> values;
+                for (size_t i = at + 1; i < instructions.size() && instructions[i].op == OperationType::data_entry;
+                     i++) {
+                    values.push_back(std::stoll(instructions[i].arg1.value()));
+                }
+                skipped = values.size();
+
+                emit(instr.op == OperationType::array_init ? Opcode::array_init : Opcode::array_constant,
+                     arg(instr.result), static_cast<uint32_t>(array_data.size()));
+                array_data.push_back(pack_elements(instr.element, values));
+                break;
+            }
+            case OperationType::print_string: {
+                std::vector<long long> values;
+                for (size_t i = at + 1; i < instructions.size() && instructions[i].op == OperationType::data_entry;
+                     i++) {
+                    values.push_back(std::stoll(instructions[i].arg1.value()));
+                }
+                skipped = values.size();
+
+                emit(Opcode::print_string, static_cast<uint32_t>(array_data.size()),
+                     static_cast<uint32_t>(values.size()));
+                array_data.push_back(pack_elements(ElementType::character, values));
+                break;
+            }
+            case OperationType::print_array:
+                emit(instr.element == ElementType::int64 ? Opcode::print_array : Opcode::print_array_bytes,
+                     arg(instr.arg3), arg(instr.arg1), arg(instr.arg2));
+                break;
+            case OperationType::bounds_check:
+                //The last operand is the line of the access, not a slot
+                emit(Opcode::bounds_check, arg(instr.arg1), arg(instr.arg2),
+                     static_cast<uint32_t>(std::stoul(instr.arg3.value())));
+                break;
+            default:
+                emit(binary_opcodes.at(instr.op), slot(destination(at, skipped)), arg(instr.arg1), arg(instr.arg2));
+        }
+
+        return skipped;
+    }
+
+    void flush() {
+        for (size_t written = 0; written < output_size;) {
+            const ssize_t result = write(STDOUT_FILENO, output + written, output_size - written);
+            if (result <= 0) break;
+            written += result;
+        }
+        output_size = 0;
+    }
+
+    void put(const char character) {
+        if (output_size == sizeof(output)) flush();
+        output[output_size++] = character;
+    }
+
+    //The digits are printed starting from the byte after the last one, like the native runtime does
+    void print_int(int64_t value) {
+        if (value < 0) {
+            put('-');
+            value = static_cast<int64_t>(0 - static_cast<uint64_t>(value));
+        }
+
+        uint64_t rest = value;
+        size_t pos = 1;
+        for (size_t i = 0; i < 8; i++) digit_space[i] = i == 0 ? '\n' : 0;
+        do {
+            digit_space[pos++] = static_cast<unsigned char>('0' + rest % 10);
+            rest /= 10;
+        } while (rest != 0);
+
+        for (size_t i = pos + 1; i-- > 0;) put(static_cast<char>(digit_space[i]));
+    }
+
+    int64_t read_char() {
+        flush();
+        unsigned char character = 0;
+        return read(STDIN_FILENO, &character, 1) == 1 ? character : 0;
+    }
+
+    struct Threaded {
+        const void *handler;
+        uint32_t a;
+        uint32_t b;
+        uint32_t c;
+        uint32_t d;
+    };
+
+    int execute(int64_t *const frame) {
+        //In the order of Opcode
+        static const void *const handlers[] = {
+                &&op_add, &&op_subtract, &&op_multiply, &&op_divide, &&op_modulo, &&op_log_and, &&op_log_or,
+                &&op_is_equal, &&op_not_equal, &&op_is_greater, &&op_is_greater_equal, &&op_is_less,
+                &&op_is_less_equal,
+                &&op_log_not, &&op_move, &&op_cond_move, &&op_jump, &&op_jump_false, &&op_jump_table,
+                &&op_loop_jump,
+                &&op_jump_not_equal, &&op_jump_equal, &&op_jump_less_equal, &&op_jump_less, &&op_jump_greater_equal,
+                &&op_jump_greater,
+                &&op_move_if_equal, &&op_move_if_not_equal, &&op_move_if_greater, &&op_move_if_greater_equal,
+                &&op_move_if_less, &&op_move_if_less_equal,
+                &&op_prog_exit, &&op_print_int, &&op_print_char, &&op_read_char, &&op_bgn_scope, &&op_end_scope,
+                &&op_array_allocate, &&op_array_get, &&op_array_assign, &&op_array_add, &&op_array_fill,
+                &&op_array_copy, &&op_print_array,
+                &&op_array_get_int32, &&op_array_get_int16, &&op_array_get_int8, &&op_array_get_char,
+                &&op_array_get_bit,
+                &&op_array_assign_int32, &&op_array_assign_int16, &&op_array_assign_int8, &&op_array_assign_bit,
+                &&op_array_fill_int32, &&op_array_fill_int16, &&op_array_fill_int8, &&op_array_copy_int32,
+                &&op_array_copy_int16, &&op_array_copy_int8,
+                &&op_print_array_bytes, &&op_array_init, &&op_array_constant, &&op_bounds_check, &&op_print_string,
+                &&op_halt
+        };
+        static_assert(std::size(handlers) == static_cast<size_t>(Opcode::halt) + 1);
+
+        std::vector<Threaded> threaded;
+        threaded.reserve(code.size());
+        for (const Bytecode &instr: code) {
+            threaded.push_back({handlers[static_cast<size_t>(instr.opcode)], instr.a, instr.b, instr.c, instr.d});
+        }
+
+        const Threaded *const start = threaded.data();
+        const Threaded *ip = start;
+        int64_t *heap_top = static_cast<int64_t *>(heap);
+
+        const auto array = [&](const uint32_t operand) {
+            return reinterpret_cast<int64_t *>(frame[operand]);
+        };
+        const auto bits = [&](const uint32_t operand) {
+            return reinterpret_cast<uint64_t *>(frame[operand]);
+        };
+
+#define DISPATCH() goto *ip->handler
+#define NEXT() do { ip++; DISPATCH(); } while (0)
+#define JUMP(target) do { ip = start + (target); DISPATCH(); } while (0)
+#define BINARY(name, expression) \
+    op_##name: { \
+        const uint64_t x = frame[ip->b]; \
+        const uint64_t y = frame[ip->c]; \
+        frame[ip->a] = static_cast<int64_t>(expression); \
+        NEXT(); \
+    }
+#define COMPARE(name, op) \
+    op_##name: \
+        frame[ip->a] = (frame[ip->b] & ~int64_t{0xFF}) | (frame[ip->b] op frame[ip->c]); \
+        NEXT();
+#define BRANCH(name, op) \
+    op_##name: \
+        if (frame[ip->a] op frame[ip->b]) JUMP(ip->c); \
+        NEXT();
+#define COND_MOVE(name, op) \
+    op_##name: \
+        if (frame[ip->b] op frame[ip->c]) frame[ip->a] = frame[ip->d]; \
+        NEXT();
+#define NARROW(name, type) \
+    op_array_get_##name: \
+        frame[ip->a] = reinterpret_cast<type *>(frame[ip->b])[frame[ip->c]]; \
+        NEXT(); \
+    op_array_assign_##name: \
+        reinterpret_cast<type *>(frame[ip->a])[frame[ip->b]] = static_cast<type>(frame[ip->c]); \
+        NEXT(); \
+    op_array_fill_##name: { \
+        type *const elements = reinterpret_cast<type *>(frame[ip->a]) + frame[ip->b]; \
+        for (int64_t i = 0; i < frame[ip->c]; i++) elements[i] = static_cast<type>(frame[ip->d]); \
+        NEXT(); \
+    } \
+    op_array_copy_##name: { \
+        type *const destination = reinterpret_cast<type *>(frame[ip->a]) + frame[ip->b]; \
+        const type *const source = reinterpret_cast<const type *>(frame[ip->d]) + frame[ip->b]; \
+        for (int64_t i = 0; i < frame[ip->c]; i++) destination[i] = source[i]; \
+        NEXT(); \
+    }
+
+        DISPATCH();
+
+        BINARY(add, x + y)
+        BINARY(subtract, x - y)
+        BINARY(multiply, x * y)
+        BINARY(divide, x / y)
+        BINARY(modulo, x % y)
+        BINARY(log_and, x & y)
+        BINARY(log_or, x | y)
+
+        COMPARE(is_equal, ==)
+        COMPARE(not_equal, !=)
+        COMPARE(is_greater, >)
+        COMPARE(is_greater_equal, >=)
+        COMPARE(is_less, <)
+        COMPARE(is_less_equal, <=)
+
+        op_log_not:
+            frame[ip->a] = ~frame[ip->b];
+            NEXT();
+        op_move:
+            frame[ip->a] = frame[ip->b];
+            NEXT();
+        op_cond_move:
+            if (static_cast<uint8_t>(frame[ip->b]) != 0) frame[ip->a] = frame[ip->c];
+            NEXT();
+        op_jump:
+            JUMP(ip->a);
+        op_jump_false:
+            if (static_cast<uint8_t>(frame[ip->a]) == 0) JUMP(ip->b);
+            NEXT();
+        op_jump_table:
+            if (static_cast<uint64_t>(frame[ip->a]) < ip->b) JUMP(tables[ip->d + frame[ip->a]]);
+            JUMP(ip->c);
+        op_loop_jump:
+            if (++loop_counters[ip->b] == hot_loop_threshold) {
+                flush();
+                current_frame = frame;
+                current_heap_top = heap_top;
+                if (const std::optional<int> exit_code = on_hot_loop(loop_headers[ip->b])) return exit_code.value();
+            }
+            JUMP(ip->a);
+
+        BRANCH(jump_not_equal, !=)
+        BRANCH(jump_equal, ==)
+        BRANCH(jump_less_equal, <=)
+        BRANCH(jump_less, <)
+        BRANCH(jump_greater_equal, >=)
+        BRANCH(jump_greater, >)
+
+        COND_MOVE(move_if_equal, ==)
+        COND_MOVE(move_if_not_equal, !=)
+        COND_MOVE(move_if_greater, >)
+        COND_MOVE(move_if_greater_equal, >=)
+        COND_MOVE(move_if_less, <)
+        COND_MOVE(move_if_less_equal, <=)
+
+        op_prog_exit:
+            return static_cast<int>(frame[ip->a] & 0xFF);
+        op_print_int:
+            print_int(frame[ip->a]);
+            NEXT();
+        op_print_char:
+            put(static_cast<char>(frame[ip->a]));
+            NEXT();
+        op_read_char:
+            frame[ip->a] = read_char();
+            NEXT();
+        op_bgn_scope:
+            frame[ip->a] = reinterpret_cast<int64_t>(heap_top);
+            NEXT();
+        op_end_scope:
+            heap_top = reinterpret_cast<int64_t *>(frame[ip->a]);
+            NEXT();
+        op_array_allocate: {
+            //Memory given back at the end of a scope is handed out again, so the elements have to be cleared
+            int64_t *const elements = heap_top;
+            heap_top += (frame[ip->b] * ip->d + 63) / 64;
+            std::fill(elements, heap_top, 0);
+            frame[ip->a] = reinterpret_cast<int64_t>(elements);
+            NEXT();
+        }
+        op_array_get:
+            frame[ip->a] = array(ip->b)[frame[ip->c]];
+            NEXT();
+        op_array_assign:
+            array(ip->a)[frame[ip->b]] = frame[ip->c];
+            NEXT();
+        op_array_add: {
+            int64_t &element = array(ip->a)[frame[ip->b]];
+            element = static_cast<int64_t>(static_cast<uint64_t>(element) + static_cast<uint64_t>(frame[ip->c]));
+            NEXT();
+        }
+        op_array_fill: {
+            int64_t *const elements = array(ip->a) + frame[ip->b];
+            for (int64_t i = 0; i < frame[ip->c]; i++) elements[i] = frame[ip->d];
+            NEXT();
+        }
+        op_array_copy: {
+            int64_t *const destination = array(ip->a) + frame[ip->b];
+            const int64_t *const source = array(ip->d) + frame[ip->b];
+            for (int64_t i = 0; i < frame[ip->c]; i++) destination[i] = source[i];
+            NEXT();
+        }
+        op_print_array: {
+            const int64_t *const elements = array(ip->a) + frame[ip->b];
+            for (int64_t i = 0; i < frame[ip->c]; i++) put(static_cast<char>(elements[i]));
+            NEXT();
+        }
+
+        NARROW(int32, int32_t)
+        NARROW(int16, int16_t)
+        NARROW(int8, int8_t)
+
+        op_array_get_char:
+            frame[ip->a] = reinterpret_cast<uint8_t *>(frame[ip->b])[frame[ip->c]];
+            NEXT();
+        op_array_get_bit: {
+            const uint64_t index = frame[ip->c];
+            frame[ip->a] = static_cast<int64_t>(bits(ip->b)[index / 64] >> index % 64 & 1);
+            NEXT();
+        }
+        op_array_assign_bit: {
+            const uint64_t index = frame[ip->b];
+            uint64_t &word = bits(ip->a)[index / 64];
+            if (static_cast<uint8_t>(frame[ip->c]) != 0) {
+                word |= uint64_t{1} << index % 64;
+            } else {
+                word &= ~(uint64_t{1} << index % 64);
+            }
+            NEXT();
+        }
+        op_print_array_bytes: {
+            const char *const elements = reinterpret_cast<const char *>(frame[ip->a]) + frame[ip->b];
+            for (int64_t i = 0; i < frame[ip->c]; i++) put(elements[i]);
+            NEXT();
+        }
+        op_array_init: {
+            const std::vector<int64_t> &data = array_data[ip->b];
+            std::copy(data.begin(), data.end(), array(ip->a));
+            NEXT();
+        }
+        op_array_constant:
+            frame[ip->a] = reinterpret_cast<int64_t>(array_data[ip->b].data());
+            NEXT();
+        op_bounds_check:
+            if (static_cast<uint64_t>(frame[ip->a]) >= static_cast<uint64_t>(frame[ip->b])) {
+                flush();
+                std::cerr << bounds_error_message << ip->c << std::endl;
+                return 1;
+            }
+            NEXT();
+        op_print_string: {
+            const char *const text = reinterpret_cast<const char *>(array_data[ip->a].data());
+            for (uint32_t i = 0; i < ip->b; i++) put(text[i]);
+            NEXT();
+        }
+        op_halt:
+            return 0;
+
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef BINARY
+#undef COMPARE
+#undef BRANCH
+#undef COND_MOVE
+#undef NARROW
+    }
+};
@@ -0,0 +1,387 @@
+#pragma once
+
+#include <cassert>
+#include <map>
+#include <sstream>
+#include <stack>
+#include <string>
+#include <vector>
+
+#include "ir_generator.hpp"
+#include "ir_optimizer.hpp"
+
+/*
+ * Translates the intermediate code into C, to be compiled by the system C compiler. Every value is an int64_t,
+ * arrays are pointers into a heap the scopes give back the same way the native code does. The runtime functions
+ * reproduce the behaviour of the native backend exactly: comparisons only replace the lowest byte of the left
+ * operand, conditions only test the lowest byte, division is unsigned and arithmetic wraps around.
+ */
+class CGenerator {
+public:
+    explicit CGenerator(const std::vector<TACInstruction> &instructions) : instructions(instructions) {
+    }
+
+    [[nodiscard]] std::string generate_program() {
+        std::stringstream body;
+
+        for (size_t i = 0; i < instructions.size(); i++) {
+            const TACInstruction &instr = instructions[i];
+
+            if (instr.op == OperationType::jump_table) {
+                body << "    switch ((uint64_t) " << value(instr.arg1.value()) << ") {" << std::endl;
+                for (size_t entry = 0; i + 1 < instructions.size() &&
+                                       instructions[i + 1].op == OperationType::table_entry; entry++) {
+                    body << "        case " << entry << ": goto " << instructions[++i].arg1.value() << ";"
+                         << std::endl;
+                }
+                body << "        default: goto " << instr.arg2.value() << ";" << std::endl;
+                body << "    }" << std::endl;
+                continue;
+            }
+
+            if (instr.op == OperationType::array_init || instr.op == OperationType::array_constant) {
+                std::vector<long long> values;
+                while (i + 1 < instructions.size() && instructions[i + 1].op == OperationType::data_entry) {
+                    values.push_back(std::stoll(instructions[++i].arg1.value()));
+                }
+
+                generate_array_data(instr, pack_elements(instr.element, values), body);
+                continue;
+            }
+
+            if (instr.op == OperationType::print_string) {
+                std::vector<long long> values;
+                while (i + 1 < instructions.size() && instructions[i + 1].op == OperationType::data_entry) {
+                    values.push_back(std::stoll(instructions[++i].arg1.value()));
+                }
+
+                generate_print_string(values, body);
+                continue;
+            }
+
+            generate_instruction(instr, body);
+        }
+
+        std::stringstream program;
+        program << runtime_source;
+        program << "static void pppjp_bounds_error(int64_t line) {" << std::endl;
+        program << "    fflush(stdout);" << std::endl;
+        program << "    fprintf(stderr, \"%s%lld\\n\", " << string_literal(bounds_error_message)
+                << ", (long long) line);" << std::endl;
+        program << "    exit(1);" << std::endl;
+        program << "}" << std::endl << std::endl;
+        program << array_data.str();
+        program << "int main(void) {" << std::endl;
+        program << "    pppjp_init();" << std::endl;
+        for (const auto &[name, c_name]: names) {
+            program << "    int64_t " << c_name << " = 0;" << std::endl;
+        }
+        for (int scope = 0; scope < scope_counter; scope++) {
+            program << "    int64_t *scope_" << scope << " = heap_top;" << std::endl;
+        }
+        program << std::endl << body.str();
+        program << "    return 0;" << std::endl;
+        program << "}" << std::endl;
+
+        return program.str();
+    }
+
+private:
+    const std::vector<TACInstruction> &instructions;
+
+    //TAC name -> C identifier, as the identifiers can contain any letters
+    std::map<std::string, std::string> names;
+    int scope_counter = 0;
+    std::stack<int> open_scopes;
+    std::stringstream array_data;
+    int array_data_counter = 0;
+    int fixed_array_counter = 0;
+
+    static inline const std::map<OperationType, std::string> operators = {
+            {OperationType::add,              "pppjp_add"},
+            {OperationType::subtract,         "pppjp_sub"},
+            {OperationType::multiply,         "pppjp_mul"},
+            {OperationType::divide,           "pppjp_div"},
+            {OperationType::modulo,           "pppjp_mod"},
+            {OperationType::log_and,          "pppjp_and"},
+            {OperationType::log_or,           "pppjp_or"},
+    };
+
+    static inline const std::map<OperationType, std::string> comparisons = {
+            {OperationType::is_equal,         "=="},
+            {OperationType::not_equal,        "!="},
+            {OperationType::is_greater,       ">"},
+            {OperationType::is_greater_equal, ">="},
+            {OperationType::is_less,          "<"},
+            {OperationType::is_less_equal,    "<="},
+    };
+
+    //Bits are packed into qwords
+    static inline const std::map<ElementType, std::string> element_c_types = {
+            {ElementType::int64,     "int64_t"},
+            {ElementType::int32,     "int32_t"},
+            {ElementType::int16,     "int16_t"},
+            {ElementType::int8,      "int8_t"},
+            {ElementType::character, "uint8_t"},
+            {ElementType::boolean,   "uint64_t"},
+    };
+
+    static inline const std::string runtime_source = R"(#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static int64_t *heap_top;
+static unsigned char digit_space[22];
+
+static void pppjp_init(void) {
+    heap_top = mmap(NULL, (size_t) 1 << 40, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                    -1, 0);
+    if (heap_top == MAP_FAILED) exit(1);
+}
+
+static inline int64_t pppjp_add(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a + (uint64_t) b); }
+static inline int64_t pppjp_sub(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a - (uint64_t) b); }
+static inline int64_t pppjp_mul(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a * (uint64_t) b); }
+static inline int64_t pppjp_div(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a / (uint64_t) b); }
+static inline int64_t pppjp_mod(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a % (uint64_t) b); }
+static inline int64_t pppjp_and(int64_t a, int64_t b) { return a & b; }
+static inline int64_t pppjp_or(int64_t a, int64_t b) { return a | b; }
+
+/* The comparison result replaces only the lowest byte of the left operand */
+static inline int64_t pppjp_cmp(int64_t a, int b) { return (a & ~(int64_t) 0xFF) | b; }
+static inline int pppjp_true(int64_t a) { return (unsigned char) a != 0; }
+
+/* Every array takes whole qwords, so the next one stays aligned, and starts out zeroed like in the native code */
+static inline int64_t *pppjp_alloc(int64_t size, int64_t bits) {
+    int64_t *array = heap_top;
+    heap_top += (size * bits + 63) / 64;
+    memset(array, 0, (size_t) (heap_top - array) * 8);
+    return array;
+}
+
+static inline int64_t pppjp_get_bit(const uint64_t *array, uint64_t index) {
+    return (int64_t) (array[index / 64] >> index % 64 & 1);
+}
+
+static inline void pppjp_set_bit(uint64_t *array, uint64_t index, int64_t value) {
+    if (pppjp_true(value)) {
+        array[index / 64] |= (uint64_t) 1 << index % 64;
+    } else {
+        array[index / 64] &= ~((uint64_t) 1 << index % 64);
+    }
+}
+
+/* The digits are printed starting from the byte after the last one, like the native runtime does */
+static void pppjp_print_int(int64_t value) {
+    if (value < 0) {
+        putchar_unlocked('-');
+        value = (int64_t) (0 - (uint64_t) value);
+    }
+
+    uint64_t rest = (uint64_t) value;
+    size_t pos = 1;
+    uint64_t newline = 10;
+    for (size_t i = 0; i < 8; i++) digit_space[i] = (unsigned char) (newline >> (8 * i));
+    do {
+        digit_space[pos++] = (unsigned char) ('0' + rest % 10);
+        rest /= 10;
+    } while (rest != 0);
+
+    for (size_t i = pos + 1; i-- > 0;) putchar_unlocked(digit_space[i]);
+}
+
+static inline void pppjp_print_char(int64_t value) {
+    putchar_unlocked((unsigned char) value);
+}
+
+static inline int64_t pppjp_read_char(void) {
+    fflush(stdout);
+    int c = getchar_unlocked();
+    return c == EOF ? 0 : c;
+}
+
+static void pppjp_exit(int64_t code) {
+    exit((int) code);
+}
+
+)";
+
+    //Only the control characters the messages use need escaping
+    static std::string string_literal(const std::string &text) {
+        std::string literal = "\"";
+        for (const char c: text) {
+            if (c == '\n') {
+                literal += "\\n";
+            } else if (c == '\t') {
+                literal += "\\t";
+            } else {
+                if (c == '"' || c == '\\') literal += '\\';
+                literal += c;
+            }
+        }
+        return literal + "\"";
+    }
+
+    std::string value(const std::string &operand) {
+        if (!IROptimizer::is_num(operand)) {
+            return names.try_emplace(operand, (IROptimizer::is_temp(operand) ? "t_" + operand.substr(1)
+                                                                             : "v_" + std::to_string(names.size())))
+                    .first->second;
+        }
+
+        //The lowest value can't be written as a literal, only its negation can be
+        if (operand == "-9223372036854775808") return "INT64_MIN";
+        return "INT64_C(" + operand + ")";
+    }
+
+    std::string array(const std::string &operand, const ElementType element) {
+        return "((" + element_c_types.at(element) + " *) " + value(operand) + ")";
+    }
+
+    //The packed elements become a constant array, copied into the array or pointed at directly
+    void generate_array_data(const TACInstruction &instr, const std::vector<int64_t> &words, std::stringstream &out) {
+        const std::string data = "array_data_" + std::to_string(array_data_counter++);
+
+        array_data << "static const uint64_t " << data << "[] = {";
+        for (size_t i = 0; i < words.size(); i++) {
+            array_data << (i == 0 ? "" : ", ") << "UINT64_C(" << static_cast<uint64_t>(words[i]) << ")";
+        }
+        array_data << "};" << std::endl << std::endl;
+
+        if (instr.op == OperationType::array_constant) {
+            out << "    " << value(instr.result.value()) << " = (int64_t) " << data << ";" << std::endl;
+            return;
+        }
+        out << "    for (int64_t i = 0; i < " << words.size() << "; i++) ((uint64_t *) " << value(instr.result.value())
+            << ")[i] = " << data << "[i];" << std::endl;
+    }
+
+    void generate_print_string(const std::vector<long long> &values, std::stringstream &out) {
+        const std::string data = "array_data_" + std::to_string(array_data_counter++);
+
+        array_data << "static const uint8_t " << data << "[] = {";
+        for (size_t i = 0; i < values.size(); i++) {
+            array_data << (i == 0 ? "" : ", ") << values[i];
+        }
+        array_data << "};" << std::endl << std::endl;
+
+        out << "    fwrite(" << data << ", 1, " << values.size() << ", stdout);" << std::endl;
+    }
+
+    void generate_instruction(const TACInstruction &instr, std::stringstream &out) {
+        const auto arg = [&](const std::optional<std::string> &operand) {
+            return value(operand.value());
+        };
+
+        switch (instr.op) {
+            case OperationType::label:
+                out << instr.arg1.value() << ":;" << std::endl;
+                return;
+            case OperationType::jump:
+                out << "    goto " << instr.arg1.value() << ";" << std::endl;
+                return;
+            case OperationType::jump_false:
+                out << "    if (!pppjp_true(" << arg(instr.arg1) << ")) goto " << instr.arg2.value() << ";"
+                    << std::endl;
+                return;
+            case OperationType::assign:
+                out << "    " << arg(instr.result) << " = " << arg(instr.arg1) << ";" << std::endl;
+                return;
+            case OperationType::cond_assign:
+                out << "    if (pppjp_true(" << arg(instr.arg1) << ")) " << arg(instr.result) << " = "
+                    << arg(instr.arg2) << ";" << std::endl;
+                return;
+            case OperationType::log_not:
+                out << "    " << arg(instr.result) << " = ~" << arg(instr.arg1) << ";" << std::endl;
+                return;
+            case OperationType::prog_exit:
+                out << "    pppjp_exit(" << arg(instr.arg1) << ");" << std::endl;
+                return;
+            case OperationType::bounds_check:
+                out << "    if ((uint64_t) " << arg(instr.arg1) << " >= (uint64_t) " << arg(instr.arg2)
+                    << ") pppjp_bounds_error(" << instr.arg3.value() << ");" << std::endl;
+                return;
+            case OperationType::print_int:
+                out << "    pppjp_print_int(" << arg(instr.arg1) << ");" << std::endl;
+                return;
+            case OperationType::print_char:
+                out << "    pppjp_print_char(" << arg(instr.arg1) << ");" << std::endl;
+                return;
+            case OperationType::read_char:
+                out << "    " << arg(instr.result) << " = pppjp_read_char();" << std::endl;
+                return;
+            case OperationType::bgn_scope:
+                open_scopes.push(scope_counter++);
+                out << "    scope_" << open_scopes.top() << " = heap_top;" << std::endl;
+                return;
+            case OperationType::end_scope:
+                out << "    heap_top = scope_" << open_scopes.top() << ";" << std::endl;
+                open_scopes.pop();
+                return;
+            case OperationType::array_allocate:
+                out << "    " << arg(instr.result) << " = (int64_t) pppjp_alloc(" << arg(instr.arg1) << ", "
+                    << element_bits(instr.element) << ");" << std::endl;
+                return;
+            case OperationType::array_stack:
+            case OperationType::array_static:
+                array_data << "static uint64_t pppjp_array_" << fixed_array_counter << "["
+                           << std::max<size_t>(array_bytes(instr.element, std::stoll(instr.arg1.value())) / 8, 1)
+                           << "];" << std::endl;
+                out << "    " << arg(instr.result) << " = (int64_t) memset(pppjp_array_" << fixed_array_counter
+                    << ", 0, sizeof pppjp_array_" << fixed_array_counter << ");" << std::endl;
+                fixed_array_counter++;
+                return;
+            case OperationType::array_free:
+                return;
+            case OperationType::array_get:
+                if (instr.element == ElementType::boolean) {
+                    out << "    " << arg(instr.result) << " = pppjp_get_bit(" << array(instr.arg1.value(), instr.element)
+                        << ", " << arg(instr.arg2) << ");" << std::endl;
+                    return;
+                }
+                out << "    " << arg(instr.result) << " = " << array(instr.arg1.value(), instr.element) << "["
+                    << arg(instr.arg2) << "];" << std::endl;
+                return;
+            case OperationType::array_assign:
+                if (instr.element == ElementType::boolean) {
+                    out << "    pppjp_set_bit(" << array(instr.result.value(), instr.element) << ", " << arg(instr.arg1)
+                        << ", " << arg(instr.arg2) << ");" << std::endl;
+                    return;
+                }
+                out << "    " << array(instr.result.value(), instr.element) << "[" << arg(instr.arg1) << "] = ("
+                    << element_c_types.at(instr.element) << ") " << arg(instr.arg2) << ";" << std::endl;
+                return;
+            case OperationType::array_fill:
+                out << "    for (int64_t i = 0; i < " << arg(instr.arg2) << "; i++) "
+                    << array(instr.result.value(), instr.element) << "[" << arg(instr.arg1) << " + i] = ("
+                    << element_c_types.at(instr.element) << ") " << arg(instr.arg3) << ";" << std::endl;
+                return;
+            case OperationType::array_copy:
+                out << "    for (int64_t i = 0; i < " << arg(instr.arg2) << "; i++) "
+                    << array(instr.result.value(), instr.element) << "[" << arg(instr.arg1) << " + i] = "
+                    << array(instr.arg3.value(), instr.element) << "[" << arg(instr.arg1) << " + i];" << std::endl;
+                return;
+            case OperationType::print_array:
+                out << "    for (int64_t i = 0; i < " << arg(instr.arg2) << "; i++) pppjp_print_char("
+                    << array(instr.arg3.value(), instr.element) << "[" << arg(instr.arg1) << " + i]);" << std::endl;
+                return;
+            case OperationType::vectorize:
+                //The C compiler vectorizes loops on its own
+                return;
+            default:
+                break;
+        }
+
+        if (comparisons.contains(instr.op)) {
+            out << "    " << arg(instr.result) << " = pppjp_cmp(" << arg(instr.arg1) << ", " << arg(instr.arg1) << " "
+                << comparisons.at(instr.op) << " " << arg(instr.arg2) << ");" << std::endl;
+            return;
+        }
+
+        assert(operators.contains(instr.op));
+        out << "    " << arg(instr.result) << " = " << operators.at(instr.op) << "(" << arg(instr.arg1) << ", "
+            << arg(instr.arg2) << ");" << std::endl;
+    }
+};
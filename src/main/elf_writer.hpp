@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "x86_encoder.hpp"
+
+/*
+ * Lays the encoded sections out into a static ELF64 executable, without section headers:
+ *
+ *  0x400000  headers, .text, .rodata   (read, execute)
+ *  next page .data, .bss               (read, write)
+ *
+ * Each segment starts at an address congruent to its file offset modulo the page size, so the kernel can map the
+ * file directly. Everything is below 2 GB, as the encoder uses absolute 32-bit addresses.
+ */
+class ELFWriter {
+public:
+    explicit ELFWriter(ObjectCode &object) : object(object) {
+    }
+
+    void write(const std::string &filename) {
+        layout();
+        object.relocate(addresses);
+
+        std::vector<uint8_t> file;
+        write_header(file);
+
+        const std::vector<uint8_t> &text = object.contents[Section::text];
+        const std::vector<uint8_t> &rodata = object.contents[Section::rodata];
+        const std::vector<uint8_t> &data = object.contents[Section::data];
+
+        file.insert(file.end(), text.begin(), text.end());
+        file.resize(offsets.at(Section::rodata));
+        file.insert(file.end(), rodata.begin(), rodata.end());
+        file.resize(offsets.at(Section::data));
+        file.insert(file.end(), data.begin(), data.end());
+
+        std::ofstream executable(filename, std::ios::binary | std::ios::trunc);
+        executable.write(reinterpret_cast<const char *>(file.data()), static_cast<std::streamsize>(file.size()));
+        executable.close();
+
+        if (!executable) {
+            std::cerr << "[BŁĄD] [Konsolidacja] Nie udało się zapisać pliku '" << filename << "'" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        std::filesystem::permissions(filename, std::filesystem::perms::owner_all | std::filesystem::perms::group_read |
+                                               std::filesystem::perms::group_exec |
+                                               std::filesystem::perms::others_read |
+                                               std::filesystem::perms::others_exec);
+    }
+
+private:
+    ObjectCode &object;
+
+    static constexpr uint64_t base_address = 0x400000;
+    static constexpr uint64_t page_size = 0x1000;
+    static constexpr uint64_t elf_header_size = 64;
+    static constexpr uint64_t program_header_size = 56;
+    static constexpr uint64_t program_header_count = 2;
+
+    std::map<Section, uint64_t> offsets;
+    std::map<Section, uint64_t> addresses;
+
+    static uint64_t align(const uint64_t value, const uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    void layout() {
+        offsets[Section::text] = elf_header_size + program_header_size * program_header_count;
+        offsets[Section::rodata] = align(offsets[Section::text] + object.size(Section::text), 16);
+        offsets[Section::data] = align(offsets[Section::rodata] + object.size(Section::rodata), 16);
+
+        addresses[Section::text] = base_address + offsets[Section::text];
+        addresses[Section::rodata] = base_address + offsets[Section::rodata];
+
+        //The first page after the executable segment, at the same offset within the page as in the file
+        addresses[Section::data] = align(base_address + offsets[Section::data], page_size) +
+                                   offsets[Section::data] % page_size;
+        addresses[Section::bss] = align(addresses[Section::data] + object.size(Section::data), 16);
+    }
+
+    static void put(std::vector<uint8_t> &file, const uint64_t value, const int bytes) {
+        for (int i = 0; i < bytes; i++) {
+            file.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    static void put_program_header(std::vector<uint8_t> &file, const uint32_t flags, const uint64_t offset,
+                                   const uint64_t address, const uint64_t file_size, const uint64_t memory_size) {
+        put(file, 1, 4); //PT_LOAD
+        put(file, flags, 4);
+        put(file, offset, 8);
+        put(file, address, 8);
+        put(file, address, 8);
+        put(file, file_size, 8);
+        put(file, memory_size, 8);
+        put(file, page_size, 8);
+    }
+
+    void write_header(std::vector<uint8_t> &file) const {
+        //Magic, 64-bit, little endian, version 1, System V
+        for (const uint8_t byte: std::vector<uint8_t>{0x7F, 'E', 'L', 'F', 2, 1, 1, 0}) {
+            file.push_back(byte);
+        }
+        put(file, 0, 8);
+
+        put(file, 2, 2); //ET_EXEC
+        put(file, 0x3E, 2); //x86-64
+        put(file, 1, 4);
+        put(file, object.symbol_address("_start", addresses), 8);
+        put(file, elf_header_size, 8);
+        put(file, 0, 8); //No section headers
+        put(file, 0, 4);
+        put(file, elf_header_size, 2);
+        put(file, program_header_size, 2);
+        put(file, program_header_count, 2);
+        put(file, 64, 2);
+        put(file, 0, 2);
+        put(file, 0, 2);
+
+        const uint64_t code_end = offsets.at(Section::rodata) + object.size(Section::rodata);
+        put_program_header(file, 0x4 | 0x1, 0, base_address, code_end, code_end);
+
+        const uint64_t data_size = object.size(Section::data);
+        const uint64_t memory_size = addresses.at(Section::bss) + object.size(Section::bss) - addresses.at(Section::data);
+        put_program_header(file, 0x4 | 0x2, offsets.at(Section::data), addresses.at(Section::data), data_size,
+                           memory_size);
+    }
+};
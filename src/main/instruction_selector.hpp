@@ -0,0 +1,254 @@
+#pragma once
+
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "ir_generator.hpp"
+#include "ir_optimizer.hpp"
+
+//Instruction patterns the selector and the ASMGenerator can cover a part of an expression tree with
+enum class Tile {
+    move, alu, lea, shift, multiply, load, store, scaled_index, displacement, memory_operand, in_place
+};
+
+/*
+ * Tree-pattern instruction selection over the TAC. Every temporary is defined and used exactly once, so its
+ * definition together with its user forms an expression tree. The selector covers those trees with tiles, folding
+ * definitions into the instruction using them whenever a tile doing both is cheaper:
+ *
+ *  #i = add i, 2; #v = array_get a, #i     =>  [a + i*8 + 16]             (scaled index with displacement)
+ *  #v = array_get a, i; #s = add s, #v      =>  add s, QWORD [a + i*8]     (memory operand)
+ *  #k = add i, 1; i = #k                    =>  add i, 1                   (in place update)
+ *
+ * The folded definitions are emitted as part of the instruction they are folded into, the root of their tree.
+ */
+class InstructionSelector {
+public:
+    //Rough number of cycles each tile takes, folded operands cost nothing on top of the instruction using them
+    static inline const std::map<Tile, int> tile_costs = {
+            {Tile::move,           1},
+            {Tile::alu,            1},
+            {Tile::lea,            1},
+            {Tile::shift,          1},
+            {Tile::multiply,       3},
+            {Tile::load,           4},
+            {Tile::store,          1},
+            {Tile::scaled_index,   0},
+            {Tile::displacement,   0},
+            {Tile::memory_operand, 0},
+            {Tile::in_place,       1},
+    };
+
+    static int cost(const std::initializer_list<Tile> tiles) {
+        int total = 0;
+        for (const Tile tile: tiles) {
+            total += tile_costs.at(tile);
+        }
+        return total;
+    }
+
+    explicit InstructionSelector(std::vector<TACInstruction> &instructions) : instructions(instructions) {
+    }
+
+    //Returns the root every folded definition is emitted at
+    [[nodiscard]] std::map<size_t, size_t> select() {
+        std::map<std::string, size_t> defs;
+        std::map<std::string, int> use_counts;
+        for (size_t i = 0; i < instructions.size(); i++) {
+            if (const auto def = get_def(instructions[i]); def.has_value() && IROptimizer::is_temp(def.value())) {
+                defs[def.value()] = i;
+            }
+            for (const std::string &use: get_uses(instructions[i])) {
+                use_counts[use]++;
+            }
+        }
+
+        for (size_t j = 0; j < instructions.size(); j++) {
+            TACInstruction &instr = instructions[j];
+
+            const auto folded_def = [&](const std::optional<std::string> &operand) -> std::optional<size_t> {
+                if (!operand.has_value() || !IROptimizer::is_temp(operand.value())) return {};
+                if (use_counts[operand.value()] != 1 || !defs.contains(operand.value())) return {};
+                return defs.at(operand.value());
+            };
+
+            switch (instr.op) {
+                case OperationType::array_get:
+                case OperationType::array_assign: {
+                    //Bits are addressed through the qword holding them instead
+                    if (instr.element == ElementType::boolean) break;
+
+                    //base + (i ± c)*8 is base + i*8 ± c*8
+                    const auto &index = instr.op == OperationType::array_get ? instr.arg2 : instr.arg1;
+                    if (const auto def = folded_def(index); def.has_value() && is_index_tile(def.value())) {
+                        try_fold(def.value(), j, cost({Tile::alu}) > cost({Tile::displacement}));
+                    }
+                    break;
+                }
+                case OperationType::add:
+                case OperationType::multiply:
+                case OperationType::log_and:
+                case OperationType::log_or:
+                    //Only the right-hand side can be a memory operand
+                    if (is_load(folded_def(instr.arg1)) && !is_load(folded_def(instr.arg2))) {
+                        std::swap(instr.arg1, instr.arg2);
+                    }
+                    fold_load(j, folded_def(instr.arg2));
+                    break;
+                case OperationType::is_equal:
+                case OperationType::not_equal:
+                case OperationType::is_greater:
+                case OperationType::is_greater_equal:
+                case OperationType::is_less:
+                case OperationType::is_less_equal:
+                    //A comparison feeding a branch only needs the flags, so the left-hand side can be a memory
+                    //operand as well, as long as the right one is a register or an immediate
+                    if (!is_load(folded_def(instr.arg2)) && is_compare_branch(j) &&
+                        (!IROptimizer::is_num(instr.arg2.value()) || fits_imm32(instr.arg2.value()))) {
+                        fold_load(j, folded_def(instr.arg1));
+                    }
+                    fold_load(j, folded_def(instr.arg2));
+                    break;
+                case OperationType::subtract:
+                    fold_load(j, folded_def(instr.arg2));
+                    break;
+                case OperationType::assign: {
+                    //x = x op y updates x in place
+                    const auto def = folded_def(instr.arg1);
+                    if (!def.has_value()) break;
+
+                    TACInstruction &update = instructions[def.value()];
+                    if (!in_place_ops.contains(update.op)) break;
+                    if (update.arg1 != instr.result && update.op != OperationType::subtract &&
+                        update.arg2 == instr.result) {
+                        std::swap(update.arg1, update.arg2);
+                    }
+                    if (update.arg1 != instr.result) break;
+
+                    try_fold(def.value(), j, cost({Tile::move, Tile::alu, Tile::move}) > cost({Tile::in_place}));
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+
+        std::map<size_t, size_t> roots;
+        for (const auto &[def, user]: folded_into) {
+            size_t root = user;
+            while (folded_into.contains(root)) root = folded_into.at(root);
+            roots[def] = root;
+        }
+        return roots;
+    }
+
+    static bool is_folded_index(const TACInstruction &instr) {
+        return (instr.op == OperationType::add || instr.op == OperationType::subtract) && instr.arg2.has_value() &&
+               IROptimizer::is_num(instr.arg2.value());
+    }
+
+private:
+    std::vector<TACInstruction> &instructions;
+    std::map<size_t, size_t> folded_into;
+
+    static inline const std::set<OperationType> in_place_ops = {
+            OperationType::add, OperationType::subtract, OperationType::multiply, OperationType::log_and,
+            OperationType::log_or
+    };
+
+    [[nodiscard]] bool is_index_tile(const size_t def) {
+        TACInstruction &instr = instructions[def];
+        if (instr.op == OperationType::add && instr.arg1.has_value() && IROptimizer::is_num(instr.arg1.value())) {
+            std::swap(instr.arg1, instr.arg2);
+        }
+        return is_folded_index(instr) && !IROptimizer::is_num(instr.arg1.value()) &&
+               std::llabs(std::stoll(instr.arg2.value())) < (1 << 27);
+    }
+
+    //Narrower elements have to be extended first, so only qwords can be used as memory operands
+    [[nodiscard]] bool is_load(const std::optional<size_t> def) const {
+        return def.has_value() && instructions[def.value()].op == OperationType::array_get &&
+               instructions[def.value()].element == ElementType::int64;
+    }
+
+    [[nodiscard]] bool is_compare_branch(const size_t compare) const {
+        if (compare + 1 >= instructions.size()) return false;
+
+        const TACInstruction &next = instructions[compare + 1];
+        return next.arg1 == instructions[compare].result &&
+               (next.op == OperationType::jump_false || next.op == OperationType::cond_assign);
+    }
+
+    static bool fits_imm32(const std::string &operand) {
+        const long long value = std::stoll(operand);
+        return value >= INT32_MIN && value <= INT32_MAX;
+    }
+
+    void fold_load(const size_t user, const std::optional<size_t> def) {
+        if (is_load(def)) {
+            try_fold(def.value(), user, cost({Tile::load, Tile::alu}) > cost({Tile::memory_operand, Tile::alu}));
+        }
+    }
+
+    //Everything folded into the definition moves to the root together with it
+    [[nodiscard]] std::vector<size_t> subtree(const size_t def) const {
+        std::vector<size_t> result = {def};
+        for (const auto &[other, user]: folded_into) {
+            if (user == def) {
+                const std::vector<size_t> nested = subtree(other);
+                result.insert(result.end(), nested.begin(), nested.end());
+            }
+        }
+        return result;
+    }
+
+    //A definition can only move down to its user if nothing in between changes what it reads
+    [[nodiscard]] bool can_move(const size_t def, const size_t user) const {
+        const TACInstruction &moved = instructions[def];
+        const std::vector<std::string> uses = get_uses(moved);
+
+        for (size_t k = def + 1; k < user; k++) {
+            const TACInstruction &instr = instructions[k];
+
+            switch (instr.op) {
+                case OperationType::label:
+                case OperationType::jump:
+                case OperationType::jump_false:
+                case OperationType::jump_table:
+                case OperationType::table_entry:
+                case OperationType::bgn_scope:
+                case OperationType::end_scope:
+                case OperationType::vectorize:
+                    return false;
+                case OperationType::array_assign:
+                case OperationType::array_fill:
+                case OperationType::array_copy:
+                case OperationType::array_allocate:
+                case OperationType::array_init:
+                    if (moved.op == OperationType::array_get) return false;
+                    break;
+                default:
+                    break;
+            }
+
+            if (const auto def_k = get_def(instr); def_k.has_value() && std::ranges::find(uses, def_k) != uses.end()) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void try_fold(const size_t def, const size_t user, const bool cheaper) {
+        if (!cheaper || def >= user) return;
+
+        for (const size_t moved: subtree(def)) {
+            if (!can_move(moved, user)) return;
+        }
+
+        folded_into[def] = user;
+    }
+};
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
 #include <map>
+#include <set>
 #include <stack>
 
 #include "parser.hpp"
@@ -10,21 +14,172 @@ enum class OperationType {
     add, subtract, multiply, divide, modulo,
     is_equal, not_equal, is_greater, is_greater_equal, is_less, is_less_equal,
     log_and, log_or, log_not,
-    assign, jump_false, jump, label,
-    prog_exit, print_int, print_char, read_char,
-    bgn_scope, end_scope, array_get, array_assign, array_allocate, array_free
+    assign, cond_assign, jump_false, jump, jump_table, table_entry, label,
+    prog_exit, print_int, print_char, print_string, read_char,
+    bgn_scope, end_scope, array_get, array_assign, array_allocate, array_free,
+    array_fill, array_copy, print_array, vectorize, array_init, array_constant, data_entry, array_stack, array_static,
+    bounds_check
 };
 
+//How the elements of an array are stored: narrow integers are sign extended when read, characters zero extended,
+//and booleans are packed into single bits read back as 0 or 1
+enum class ElementType {
+    int64, int32, int16, int8, character, boolean
+};
+
+//What every backend prints to stderr when an index is out of range, followed by the line of the access
+static const std::string bounds_error_message = "[BŁĄD] [Wykonanie] Indeks spoza zakresu tablicy \n\t w linijce ";
+
 struct TACInstruction {
     OperationType op;
     std::optional<std::string> result;
     std::optional<std::string> arg1;
     std::optional<std::string> arg2;
+    std::optional<std::string> arg3;
+    //Of the array accessed by array instructions
+    ElementType element = ElementType::int64;
 };
 
+static int element_bits(const ElementType element) {
+    switch (element) {
+        case ElementType::int64:
+            return 64;
+        case ElementType::int32:
+            return 32;
+        case ElementType::int16:
+            return 16;
+        case ElementType::int8:
+        case ElementType::character:
+            return 8;
+        case ElementType::boolean:
+            return 1;
+    }
+
+    assert(false); //Unreachable
+}
+
+//Bytes taken by an array of the given length, rounded up to whole qwords so that every array stays aligned
+static long long array_bytes(const ElementType element, const long long size) {
+    return (size * element_bits(element) + 63) / 64 * 8;
+}
+
+//What storing a value into an element and reading it back gives
+static long long element_value(const ElementType element, const long long value) {
+    switch (element) {
+        case ElementType::int64:
+            return value;
+        case ElementType::int32:
+            return static_cast<int32_t>(value);
+        case ElementType::int16:
+            return static_cast<int16_t>(value);
+        case ElementType::int8:
+            return static_cast<int8_t>(value);
+        case ElementType::character:
+            return static_cast<uint8_t>(value);
+        case ElementType::boolean:
+            //Only the lowest byte holds the truth value
+            return (value & 0xFF) != 0;
+    }
+
+    assert(false); //Unreachable
+}
+
+//Packs element values into the qwords holding them in memory, the last one padded with zeros
+static std::vector<int64_t> pack_elements(const ElementType element, const std::vector<long long> &values) {
+    const int bits = element_bits(element);
+    std::vector<uint64_t> words(array_bytes(element, static_cast<long long>(values.size())) / 8, 0);
+    const uint64_t mask = bits == 64 ? ~uint64_t{0} : (uint64_t{1} << bits) - 1;
+    for (size_t i = 0; i < values.size(); i++) {
+        words[i * bits / 64] |= (static_cast<uint64_t>(values[i]) & mask) << (i * bits % 64);
+    }
+    return {words.begin(), words.end()};
+}
+
+static bool is_tac_value(const std::optional<std::string> &operand) {
+    if (!operand.has_value()) return false;
+
+    char *p;
+    strtol(operand->c_str(), &p, 10);
+    return *p != 0;
+}
+
+//Variables and temporaries read by an instruction
+static std::vector<std::string> get_uses(const TACInstruction &instr) {
+    std::vector<std::optional<std::string>> operands;
+
+    switch (instr.op) {
+        case OperationType::label:
+        case OperationType::jump:
+        case OperationType::table_entry:
+        case OperationType::data_entry:
+        case OperationType::bgn_scope:
+        case OperationType::end_scope:
+        case OperationType::read_char:
+        case OperationType::vectorize:
+        case OperationType::array_free:
+            break;
+        case OperationType::jump_false:
+        case OperationType::jump_table:
+        case OperationType::assign:
+        case OperationType::prog_exit:
+        case OperationType::print_int:
+        case OperationType::print_char:
+        case OperationType::array_allocate:
+        case OperationType::array_stack:
+        case OperationType::array_static:
+        case OperationType::log_not:
+            operands = {instr.arg1};
+            break;
+        case OperationType::cond_assign:
+        case OperationType::array_assign:
+        case OperationType::array_fill:
+        case OperationType::array_copy:
+        case OperationType::array_init:
+            operands = {instr.result, instr.arg1, instr.arg2, instr.arg3};
+            break;
+        default:
+            operands = {instr.arg1, instr.arg2, instr.arg3};
+    }
+
+    std::vector<std::string> uses;
+    for (const auto &operand: operands) {
+        if (is_tac_value(operand)) uses.push_back(operand.value());
+    }
+    return uses;
+}
+
+//Variables and temporaries written by an instruction
+static std::optional<std::string> get_def(const TACInstruction &instr) {
+    switch (instr.op) {
+        case OperationType::array_assign:
+        case OperationType::array_fill:
+        case OperationType::array_copy:
+        case OperationType::array_init:
+        case OperationType::print_array:
+            return {};
+        default:
+            return instr.result;
+    }
+}
+
 class IRGenerator {
 public:
-    explicit IRGenerator(NodeStart root) : root(std::move(root)) {
+    explicit IRGenerator(NodeStart root, const bool bounds_check = false) : root(std::move(root)),
+                                                                            bounds_check(bounds_check) {
+    }
+
+    //The variable a size of an array is copied to
+    static std::string dimension_name(const std::string &ident, const size_t dimension, const size_t dimensions) {
+        if (dimensions == 1) return "długość(" + ident + ")";
+        return "długość(" + ident + "," + std::to_string(dimension) + ")";
+    }
+
+    static void check_index_count(const Token &ident, const size_t expected, const size_t found) {
+        if (found == expected) return;
+
+        std::cerr << "[BŁĄD] [Analiza semantyczna] Oczekiwano " << expected << " indeksów tablicy '" <<
+                  ident.value.value() << "', znaleziono " << found << " \n\t w linijce " << ident.line << std::endl;
+        exit(EXIT_FAILURE);
     }
 
     static TokenType get_result_type(const TokenType opr) {
@@ -33,6 +188,19 @@ public:
         assert(false);
     }
 
+    static ElementType get_array_element(const TokenType type) {
+        return element_types.at(type);
+    }
+
+    //Elements of every integer width are just integers to the rest of the program
+    static TokenType get_array_value_type(const TokenType type) {
+        const ElementType element = get_array_element(type);
+        if (element == ElementType::int32 || element == ElementType::int16 || element == ElementType::int8) {
+            return TokenType::var_type_int;
+        }
+        return type;
+    }
+
     static TokenType get_param_type(const TokenType opr) {
         if (opr == TokenType::equal || opr == TokenType::not_equal) return TokenType::null;
         if (logical_tokens.contains(opr)) return TokenType::var_type_boolean;
@@ -53,6 +221,166 @@ public:
         exit(EXIT_FAILURE);
     }
 
+    [[noreturn]] static void narrow_array_err(const Token &ident) {
+        std::cerr << "[BŁĄD] [Analiza semantyczna] Tablica '" << ident.value.value() <<
+                  "' o elementach węższych niż 64 bity może zostać jedynie przypisana w całości zmiennej o takich"
+                  " samych elementach \n\t w linijce " << ident.line << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    //The identifier an expression consists of, looking through parentheses
+    static const Token *plain_ident(const NodeExpr *expr) {
+        const auto *term = std::get_if<NodeTerm *>(&expr->var);
+        if (term == nullptr) return nullptr;
+
+        if (const auto *paren = std::get_if<NodeTermParen *>(&(*term)->var)) return plain_ident((*paren)->expr);
+        if (const auto *ident = std::get_if<NodeTermIdent *>(&(*term)->var)) return &(*ident)->ident;
+        return nullptr;
+    }
+
+    /*
+     * Elements a variable indexes once it's given the expression, see IRGenerator::generate_alias. Only a whole
+     * array of narrower elements makes them anything else than qwords, and a variable already indexing such elements
+     * can only be given another array of the same ones.
+     */
+    static ElementType alias_element(const Token &target, const NodeExpr *expr, const bool declaration,
+                                     const std::map<std::string, ElementType> &array_elements) {
+        const auto element_of = [&array_elements](const std::string &ident) {
+            const auto it = array_elements.find(ident);
+            return it != array_elements.end() ? it->second : ElementType::int64;
+        };
+
+        const Token *source = plain_ident(expr);
+        const ElementType element = source != nullptr ? element_of(source->value.value()) : ElementType::int64;
+        if (!declaration && element_of(target.value.value()) != element) {
+            narrow_array_err(element != ElementType::int64 ? *source : target);
+        }
+        return element;
+    }
+
+    //Constants only ever stand for their value
+    [[noreturn]] static void constant_err(const Token &ident) {
+        std::cerr << "[BŁĄD] [Analiza semantyczna] Stała '" << ident.value.value() <<
+                  "' nie może zostać zmieniona ani użyta jako tablica \n\t w linijce " << ident.line << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    [[noreturn]] static void counter_err(const Token &ident) {
+        std::cerr << "[BŁĄD] [Analiza semantyczna] Zmienna sterująca pętli '" << ident.value.value() <<
+                  "' nie może zostać zmieniona w jej wnętrzu \n\t w linijce " << ident.line << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    [[noreturn]] static void step_err(const Token &ident) {
+        std::cerr << "[BŁĄD] [Analiza semantyczna] Krok pętli '" << ident.value.value() <<
+                  "' musi być różny od zera i znany w czasie kompilacji \n\t w linijce " << ident.line << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    [[noreturn]] static void constant_value_err(const Token &ident) {
+        std::cerr << "[BŁĄD] [Analiza semantyczna] Wartość stałej '" << ident.value.value() <<
+                  "' musi być znana w czasie kompilacji \n\t w linijce " << ident.line << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    /*
+     * What an operation on values known at compile time gives when the program runs: arithmetic wraps around,
+     * division is unsigned and comparisons only replace the lowest byte of the left operand. Division by zero is
+     * left for the program to trap on.
+     */
+    static std::optional<long long> fold(const OperationType op, const long long lhs, const long long rhs = 0) {
+        const auto a = static_cast<uint64_t>(lhs);
+        const auto b = static_cast<uint64_t>(rhs);
+        const auto compared = [lhs](const bool result) {
+            return (lhs & ~0xFFll) | static_cast<long long>(result);
+        };
+
+        switch (op) {
+            case OperationType::add:
+                return static_cast<long long>(a + b);
+            case OperationType::subtract:
+                return static_cast<long long>(a - b);
+            case OperationType::multiply:
+                return static_cast<long long>(a * b);
+            case OperationType::divide:
+                if (b == 0) return {};
+                return static_cast<long long>(a / b);
+            case OperationType::modulo:
+                if (b == 0) return {};
+                return static_cast<long long>(a % b);
+            case OperationType::log_and:
+                return lhs & rhs;
+            case OperationType::log_or:
+                return lhs | rhs;
+            case OperationType::log_not:
+                return ~lhs;
+            case OperationType::is_equal:
+                return compared(lhs == rhs);
+            case OperationType::not_equal:
+                return compared(lhs != rhs);
+            case OperationType::is_greater:
+                return compared(lhs > rhs);
+            case OperationType::is_greater_equal:
+                return compared(lhs >= rhs);
+            case OperationType::is_less:
+                return compared(lhs < rhs);
+            case OperationType::is_less_equal:
+                return compared(lhs <= rhs);
+            default:
+                return {};
+        }
+    }
+
+    //Value of an expression made of literals and the given constants only
+    static std::optional<long long> evaluate(const NodeExpr *expr, const std::map<std::string, long long> &constants) {
+        struct ExprVisitor {
+            const std::map<std::string, long long> &constants;
+
+            std::optional<long long> operator()(const NodeBinExpr *bin_expr) const {
+                const auto rhs = evaluate(bin_expr->right, constants);
+                const auto lhs = evaluate(bin_expr->left, constants);
+                if (!lhs.has_value() || !rhs.has_value()) return {};
+                return fold(token_operation_map.at(bin_expr->opr.type), lhs.value(), rhs.value());
+            }
+
+            std::optional<long long> operator()(const NodeTerm *term) const {
+                if (const auto *int_lit = std::get_if<NodeTermIntLit *>(&term->var)) {
+                    return std::stoll((*int_lit)->int_lit.value.value());
+                }
+                if (const auto *bool_lit = std::get_if<NodeTermBoolLit *>(&term->var)) {
+                    return std::stoll((*bool_lit)->bool_lit.value.value());
+                }
+                if (const auto *char_lit = std::get_if<NodeTermCharLit *>(&term->var)) {
+                    return static_cast<unsigned char>((*char_lit)->char_lit.value.value()[0]);
+                }
+                if (const auto *ident = std::get_if<NodeTermIdent *>(&term->var)) {
+                    const auto it = constants.find((*ident)->ident.value.value());
+                    if (it == constants.end()) return {};
+                    return it->second;
+                }
+                if (const auto *paren = std::get_if<NodeTermParen *>(&term->var)) {
+                    return evaluate((*paren)->expr, constants);
+                }
+                return {};
+            }
+
+            std::optional<long long> operator()(const NodeUnExpr *un_expr) const {
+                const auto value = (*this)(un_expr->term);
+                if (!value.has_value()) return {};
+                return fold(token_operation_map.at(un_expr->opr.type), value.value());
+            }
+        };
+
+        return visit(ExprVisitor{constants}, expr->var);
+    }
+
+    //Texts are only ever printed or stored in arrays, they aren't values of any expression
+    [[noreturn]] static void string_err(const int line) {
+        std::cerr << "[BŁĄD] [Analiza semantyczna] Tekst może być jedynie wyświetlony lub zapisany w tablicy znaków "
+                     "\n\t w linijce " << line << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
     static void check_operator(const TokenType opr, const TokenType expected_type, const int line) {
         const TokenType result_type = get_result_type(opr);
         check_token(result_type, expected_type, line);
@@ -84,10 +412,16 @@ public:
         const std::string rhs = generate_expr(expr->right, expected_param_type);
         const std::string lhs = generate_expr(expr->left, expected_param_type);
 
+        //Expressions of literals and constants are computed right away
+        if (!is_tac_value(lhs) && !is_tac_value(rhs)) {
+            const auto value = fold(token_operation_map.at(expr->opr.type), std::stoll(lhs), std::stoll(rhs));
+            if (value.has_value()) return std::to_string(value.value());
+        }
+
         const std::string result = new_temp_var();
 
         instructions.push_back({
-                                       token_operation_map[expr->opr.type],
+                                       token_operation_map.at(expr->opr.type),
                                        result,
                                        lhs,
                                        rhs
@@ -103,9 +437,13 @@ public:
         const TokenType expected_param_type = get_param_type(un_expr->opr.type);
         const std::string term = generate_term(un_expr->term, expected_param_type);
 
+        if (!is_tac_value(term)) {
+            return std::to_string(fold(token_operation_map.at(un_expr->opr.type), std::stoll(term)).value());
+        }
+
         std::string result = new_temp_var();
         instructions.push_back({
-                                       token_operation_map[un_expr->opr.type],
+                                       token_operation_map.at(un_expr->opr.type),
                                        result,
                                        term});
 
@@ -137,10 +475,9 @@ public:
             }
 
             std::string operator()(const NodeTermStringLit *term_string_lit) const {
-                check_token(TokenType::var_type_string, expected_type, term_string_lit->array_expr->token.line);
-                assert(false);
-                //TODO
-                //gen.generate_array_expr(term_string_lit->array_expr, );
+                const int line = term_string_lit->array_expr->token.line;
+                check_token(TokenType::var_type_string, expected_type, line);
+                string_err(line);
             }
 
             std::string operator()(const NodeTermIdent *term_ident) const {
@@ -149,7 +486,9 @@ public:
 
                 const TokenType type = gen.var_types[ident];
                 check_token(type, expected_type, term_ident->ident.line);
+                if (gen.get_element_type(ident) != ElementType::int64) narrow_array_err(term_ident->ident);
 
+                if (gen.constants.contains(ident)) return gen.constants.at(ident);
                 return term_ident->ident.value.value();
             }
 
@@ -164,14 +503,16 @@ public:
                 const TokenType type = gen.var_types[ident];
                 check_token(type, expected_type, arr_ident->ident.line);
 
-                std::string index = gen.generate_expr(arr_ident->index, TokenType::var_type_int);
+                std::string index = gen.generate_index(arr_ident->ident, arr_ident->indexes);
                 std::string result = gen.new_temp_var();
 
                 gen.instructions.push_back({
                                                    OperationType::array_get,
                                                    result,
                                                    ident,
-                                                   index}
+                                                   index,
+                                                   {},
+                                                   gen.get_element_type(ident)}
                 );
 
                 return result;
@@ -238,17 +579,355 @@ public:
         generate_jump(end_label);
     }
 
+    //Calls the predicate on every term of the expression, including the ones nested in parentheses and array indexes
+    static bool any_term(const NodeExpr *expr, const std::function<bool(const NodeTerm *)> &pred) {
+        struct TermVisitor {
+            const std::function<bool(const NodeTerm *)> &pred;
+
+            bool operator()(const NodeTerm *term) const {
+                if (pred(term)) return true;
+                if (const auto *paren = std::get_if<NodeTermParen *>(&term->var)) {
+                    return any_term((*paren)->expr, pred);
+                }
+                if (const auto *arr_ident = std::get_if<NodeTermArrIdent *>(&term->var)) {
+                    return std::ranges::any_of((*arr_ident)->indexes, [this](const NodeExpr *index) {
+                        return any_term(index, pred);
+                    });
+                }
+                return false;
+            }
+
+            bool operator()(const NodeBinExpr *bin_expr) const {
+                return any_term(bin_expr->left, pred) || any_term(bin_expr->right, pred);
+            }
+
+            bool operator()(const NodeUnExpr *un_expr) const {
+                return (*this)(un_expr->term);
+            }
+        };
+
+        return visit(TermVisitor{pred}, expr->var);
+    }
+
+    //`array` element `index` with variable or literal indexes, as text, so that equal accesses can be compared
+    static std::optional<std::string> element_key(const NodeTermArrIdent *arr_ident) {
+        std::string key = arr_ident->ident.value.value();
+        for (const NodeExpr *index_expr: arr_ident->indexes) {
+            const auto *index = std::get_if<NodeTerm *>(&index_expr->var);
+            if (index == nullptr) return {};
+
+            if (const auto *ident = std::get_if<NodeTermIdent *>(&(*index)->var)) {
+                key += "[" + (*ident)->ident.value.value() + "]";
+            } else if (const auto *int_lit = std::get_if<NodeTermIntLit *>(&(*index)->var)) {
+                key += "[" + (*int_lit)->int_lit.value.value() + "]";
+            } else {
+                return {};
+            }
+        }
+        return key;
+    }
+
+    /*
+     * Cost of evaluating an expression unconditionally, or -1 if it can trap or has side effects.
+     * An array element can only be read if the guard reads the very same element, as it would have trapped first.
+     */
+    static int expr_cost(const NodeExpr *expr, const NodeExpr *guard) {
+        struct CostVisitor {
+            const NodeExpr *guard;
+
+            int operator()(const NodeTerm *term) const {
+                if (std::holds_alternative<NodeTermIdent *>(term->var)) return 1;
+                if (const auto *paren = std::get_if<NodeTermParen *>(&term->var)) {
+                    return expr_cost((*paren)->expr, guard);
+                }
+                if (const auto *arr_ident = std::get_if<NodeTermArrIdent *>(&term->var)) {
+                    const std::optional<std::string> key = element_key(*arr_ident);
+                    const bool guarded = key.has_value() && any_term(guard, [&key](const NodeTerm *guard_term) {
+                        const auto *guard_arr = std::get_if<NodeTermArrIdent *>(&guard_term->var);
+                        return guard_arr != nullptr && element_key(*guard_arr) == key;
+                    });
+                    return guarded ? 2 : -1;
+                }
+                if (std::holds_alternative<NodeTermIntLit *>(term->var) ||
+                    std::holds_alternative<NodeTermCharLit *>(term->var) ||
+                    std::holds_alternative<NodeTermBoolLit *>(term->var)) {
+                    return 0;
+                }
+                return -1;
+            }
+
+            int operator()(const NodeBinExpr *bin_expr) const {
+                if (bin_expr->opr.type == TokenType::divide || bin_expr->opr.type == TokenType::modulo) return -1;
+
+                const int lhs = expr_cost(bin_expr->left, guard);
+                const int rhs = expr_cost(bin_expr->right, guard);
+                if (lhs < 0 || rhs < 0) return -1;
+                return lhs + rhs + 1;
+            }
+
+            int operator()(const NodeUnExpr *un_expr) const {
+                const int term = (*this)(un_expr->term);
+                if (term < 0) return -1;
+                return term + 1;
+            }
+        };
+
+        return visit(CostVisitor{guard}, expr->var);
+    }
+
+    static bool expr_uses(const NodeExpr *expr, const std::string &ident) {
+        return any_term(expr, [&ident](const NodeTerm *term) {
+            const auto *term_ident = std::get_if<NodeTermIdent *>(&term->var);
+            return term_ident != nullptr && (*term_ident)->ident.value.value() == ident;
+        });
+    }
+
+    static const NodeStmtAssign *single_assign(const NodeStatement *stmt) {
+        if (const auto *assign = std::get_if<NodeStmtAssign *>(&stmt->var)) {
+            return *assign;
+        }
+        if (const auto *scope = std::get_if<NodeStmtScope *>(&stmt->var)) {
+            if ((*scope)->statements.size() == 1) return single_assign((*scope)->statements.front());
+        }
+        return nullptr;
+    }
+
+    //If-conversion of `jeśli (c): { x równa a } [przeciwnie: { x równa b }]` into a conditional move, so that
+    //cheap data-dependent assignments don't pay for a mispredicted branch
+    bool generate_select(const NodeStmtIf *stmt_if) {
+        if (!stmt_if->pred_elif.empty()) return false;
+
+        const NodeStmtAssign *then_assign = single_assign(stmt_if->pred->stmt);
+        if (then_assign == nullptr) return false;
+
+        const std::string &ident = then_assign->ident.value.value();
+        if (constants.contains(ident) || loop_counters.contains(ident)) return false;
+
+        const NodeStmtAssign *else_assign = nullptr;
+        if (stmt_if->pred_else.has_value()) {
+            else_assign = single_assign(stmt_if->pred_else.value()->stmt);
+            if (else_assign == nullptr || else_assign->ident.value.value() != ident) return false;
+        }
+
+        //The condition is evaluated exactly once either way, so only the arms have to be safe to evaluate early
+        const NodeExpr *cond = stmt_if->pred->expr;
+        const int then_cost = expr_cost(then_assign->expr, cond);
+        const int else_cost = else_assign != nullptr ? expr_cost(else_assign->expr, cond) : 0;
+        if (then_cost < 0 || else_cost < 0 || then_cost + else_cost > max_select_cost) {
+            return false;
+        }
+
+        //The false value is stored before the rest is evaluated, so nothing else may read the old value
+        if (else_assign != nullptr && (expr_uses(then_assign->expr, ident) || expr_uses(cond, ident))) {
+            return false;
+        }
+
+        check_ident(then_assign->ident, true);
+        const TokenType type = var_types[ident];
+
+        if (else_assign != nullptr) {
+            const std::string else_value = generate_expr(else_assign->expr, type);
+            generate_assign(ident, else_value);
+        }
+
+        const std::string value = generate_expr(then_assign->expr, type);
+        const std::string cond_result = generate_expr(stmt_if->pred->expr, TokenType::var_type_boolean);
+
+        instructions.push_back({
+                                       OperationType::cond_assign,
+                                       ident,
+                                       cond_result,
+                                       value
+                               });
+
+        return true;
+    }
+
+    struct DispatchCase {
+        long long value;
+        std::string label;
+    };
+
+    //Matches `ident` równe <int/char literal or constant> (in either order), returning the variable and the value
+    std::optional<std::pair<Token, long long>> match_dispatch_cond(const NodeExpr *expr) const {
+        const auto *bin_expr = std::get_if<NodeBinExpr *>(&expr->var);
+        if (bin_expr == nullptr || (*bin_expr)->opr.type != TokenType::equal) return {};
+
+        const auto as_term = [](const NodeExpr *side) -> const NodeTerm * {
+            const auto *term = std::get_if<NodeTerm *>(&side->var);
+            return term != nullptr ? *term : nullptr;
+        };
+        const NodeTerm *left = as_term((*bin_expr)->left);
+        const NodeTerm *right = as_term((*bin_expr)->right);
+        if (left == nullptr || right == nullptr) return {};
+
+        const auto is_variable = [this](const NodeTerm *term) {
+            const auto *ident = std::get_if<NodeTermIdent *>(&term->var);
+            return ident != nullptr && !constants.contains((*ident)->ident.value.value());
+        };
+        if (!is_variable(left)) std::swap(left, right);
+        if (!is_variable(left)) return {};
+
+        const Token &ident = std::get<NodeTermIdent *>(left->var)->ident;
+        if (const auto *constant = std::get_if<NodeTermIdent *>(&right->var)) {
+            const auto it = constants.find((*constant)->ident.value.value());
+            if (it == constants.end()) return {};
+            return std::pair{ident, std::stoll(it->second)};
+        }
+        if (const auto *int_lit = std::get_if<NodeTermIntLit *>(&right->var)) {
+            return std::pair{ident, std::stoll((*int_lit)->int_lit.value.value())};
+        }
+        if (const auto *char_lit = std::get_if<NodeTermCharLit *>(&right->var)) {
+            return std::pair{ident, static_cast<long long>(
+                    static_cast<unsigned char>((*char_lit)->char_lit.value.value()[0]))};
+        }
+        return {};
+    }
+
+    void generate_jump_table(const std::string &ident, const std::vector<DispatchCase> &cases,
+                             const std::string &default_label) {
+        const long long min = cases.front().value;
+        const long long max = cases.back().value;
+
+        std::string index = ident;
+        if (min != 0) {
+            index = new_temp_var();
+            instructions.push_back({OperationType::subtract, index, ident, std::to_string(min)});
+        }
+
+        instructions.push_back({OperationType::jump_table, {}, index, default_label});
+
+        auto it = cases.begin();
+        for (long long value = min; value <= max; value++) {
+            if (it->value == value) {
+                instructions.push_back({OperationType::table_entry, {}, it->label});
+                ++it;
+            } else {
+                instructions.push_back({OperationType::table_entry, {}, default_label});
+            }
+        }
+    }
+
+    void generate_binary_search(const std::string &ident, const std::vector<DispatchCase> &cases, const size_t lo,
+                                const size_t hi, const std::string &default_label) {
+        if (hi - lo <= dispatch_linear_cases) {
+            for (size_t i = lo; i < hi; i++) {
+                const std::string cond = new_temp_var();
+                instructions.push_back({OperationType::not_equal, cond, ident, std::to_string(cases[i].value)});
+                instructions.push_back({OperationType::jump_false, {}, cond, cases[i].label});
+            }
+            generate_jump(default_label);
+            return;
+        }
+
+        const size_t mid = lo + (hi - lo) / 2;
+        const std::string upper_label = get_new_label();
+
+        const std::string cond = new_temp_var();
+        instructions.push_back({OperationType::is_less, cond, ident, std::to_string(cases[mid].value)});
+        instructions.push_back({OperationType::jump_false, {}, cond, upper_label});
+
+        generate_binary_search(ident, cases, lo, mid, default_label);
+        generate_label(upper_label);
+        generate_binary_search(ident, cases, mid, hi, default_label);
+    }
+
+    //Lowers a jeśli/przeciwnie jeśli chain comparing one variable against distinct constants into a jump table when
+    //the values are dense, or into a balanced binary search when they're sparse
+    bool generate_dispatch(const NodeStmtIf *stmt_if) {
+        std::vector<const NodeIfPred *> preds = {stmt_if->pred};
+        preds.insert(preds.end(), stmt_if->pred_elif.begin(), stmt_if->pred_elif.end());
+        if (preds.size() < min_dispatch_cases) return false;
+
+        std::optional<Token> ident;
+        std::vector<long long> values;
+        for (const NodeIfPred *pred: preds) {
+            const auto match = match_dispatch_cond(pred->expr);
+            if (!match.has_value()) return false;
+            if (ident.has_value() && ident->value != match->first.value) return false;
+
+            ident = match->first;
+            values.push_back(match->second);
+        }
+
+        check_ident(ident.value(), true);
+        const std::string &ident_str = ident->value.value();
+        const TokenType type = var_types[ident_str];
+        if (type != TokenType::var_type_int && type != TokenType::var_type_char) return false;
+        if (get_element_type(ident_str) != ElementType::int64) return false;
+
+        const std::string end_label = get_new_label();
+        const std::string default_label = get_new_label();
+
+        std::vector<std::string> labels;
+        std::vector<DispatchCase> cases;
+        for (const long long value: values) {
+            labels.push_back(get_new_label());
+
+            //An earlier arm with the same constant always wins, so later duplicates are unreachable
+            if (std::ranges::none_of(cases, [value](const DispatchCase &c) { return c.value == value; })) {
+                cases.push_back({value, labels.back()});
+            }
+        }
+        std::ranges::sort(cases, {}, &DispatchCase::value);
+
+        const long long range = cases.back().value - cases.front().value + 1;
+        if (range <= max_jump_table_size && range <= static_cast<long long>(cases.size()) * jump_table_density) {
+            generate_jump_table(ident_str, cases, default_label);
+        } else {
+            generate_binary_search(ident_str, cases, 0, cases.size(), default_label);
+        }
+
+        for (size_t i = 0; i < preds.size(); i++) {
+            generate_label(labels[i]);
+            generate_statement(preds[i]->stmt);
+            generate_jump(end_label);
+        }
+
+        generate_label(default_label);
+        if (stmt_if->pred_else.has_value()) {
+            generate_statement(stmt_if->pred_else.value()->stmt);
+        }
+
+        generate_label(end_label);
+        return true;
+    }
+
     void generate_array_expr(const NodeTermArray *arr_expr, const std::string &ident, TokenType type) {
+        const size_t start = instructions.size();
+        std::vector<long long> values;
+
         for (int index = 0; index < arr_expr->exprs.size(); index++) {
             std::string expr = generate_expr(arr_expr->exprs.at(index), type);
+            if (!is_tac_value(expr)) values.push_back(element_value(get_element_type(ident), std::stoll(expr)));
 
             instructions.push_back({
                                            OperationType::array_assign,
                                            ident,
                                            std::to_string(index),
-                                           expr}
+                                           expr,
+                                           {},
+                                           get_element_type(ident)}
             );
         }
+
+        /*
+         * Literals don't generate any code, so when every element is one the stores can be replaced with data copied
+         * into the array at once:
+         *
+         *  t = array_init 3
+         *      data 76
+         *      data 79
+         *      data 76
+         */
+        if (values.empty() || values.size() != arr_expr->exprs.size()) return;
+
+        instructions.resize(start);
+        instructions.push_back({OperationType::array_init, ident, std::to_string(values.size()), {}, {},
+                                get_element_type(ident)});
+        for (const long long value: values) {
+            instructions.push_back({OperationType::data_entry, {}, std::to_string(value)});
+        }
     }
 
     void generate_exit(const std::optional<NodeStmtExit *> stmt_exit) {
@@ -288,6 +967,144 @@ public:
         return result;
     }
 
+    /*
+     * A variable given a whole array of elements narrower than qwords indexes it with the same element size from then
+     * on, as in `zmienna całkowita `p` równa `t``. Such an array can't be used as a value in any other way, as its
+     * elements couldn't be told apart from qwords anymore. Returns whether the value was such an array.
+     */
+    bool generate_alias(const Token &target, const NodeExpr *expr, const TokenType type, const bool declaration) {
+        const ElementType element = alias_element(target, expr, declaration, array_elements);
+        if (element == ElementType::int64) return false;
+
+        const Token &source = *plain_ident(expr);
+        check_token(TokenType::var_type_int, type, source.line);
+        array_elements.try_emplace(target.value.value(), element);
+        generate_assign(target.value.value(), source.value.value());
+        return true;
+    }
+
+    /*
+     * `dla `i` od a do b krok s:` counts i from a up to b inclusive. The bound is evaluated once, before the loop,
+     * and i can't be assigned in the body, so the loop always has the counted form the optimizer recognizes:
+     *      i = a
+     *      koniec(i) = b
+     *  L:  #c = le i, koniec(i)
+     *      jmp_false #c, E
+     *      begin_scope
+     *      <body>
+     *  C:  #k = add i, s
+     *      i = #k
+     *      end_scope
+     *      jmp L
+     *  E:
+     * The step has to be known at compile time, a negative one counts down, checking with `ge` instead. The label
+     * for `kontynuuj` is only placed when something jumps to it.
+     *
+     * Stepping past a bound close to the end of the range would wrap the counter around, and the loop would never
+     * end. Unless the bound is a literal far enough from it, the loop stops at C once the counter can't be stepped
+     * without passing the bound, with `#g = ne i, koniec(i)` for steps of one and `#g = le i, ostatni(i)` otherwise,
+     * where ostatni(i) is the bound minus the step, followed by `jmp_false #g, E`.
+     */
+    void generate_for(const NodeStmtFor *stmt_for) {
+        const std::string &ident = stmt_for->ident.value.value();
+        check_ident(stmt_for->ident, false);
+
+        const std::string from = generate_expr(stmt_for->from, TokenType::var_type_int);
+        std::string to = generate_expr(stmt_for->to, TokenType::var_type_int);
+        const std::string step = stmt_for->step.has_value()
+                                 ? generate_expr(stmt_for->step.value(), TokenType::var_type_int)
+                                 : "1";
+        if (is_tac_value(step) || std::stoll(step) == 0) step_err(stmt_for->ident);
+
+        var_types.try_emplace(ident, TokenType::var_type_int);
+        loop_counters.insert(ident);
+
+        generate_assign(ident, from);
+        if (is_tac_value(to)) {
+            const std::string bound = "koniec(" + ident + ")";
+            generate_assign(bound, to);
+            to = bound;
+        }
+
+        const long long step_value = std::stoll(step);
+        const bool may_wrap = is_tac_value(to) || (step_value > 0 ? std::stoll(to) > INT64_MAX - step_value
+                                                                  : std::stoll(to) < INT64_MIN - step_value);
+        std::string last;
+        if (may_wrap && step_value != 1 && step_value != -1) {
+            if (is_tac_value(to)) {
+                const std::string difference = new_temp_var();
+                instructions.push_back({OperationType::subtract, difference, to, step});
+                last = "ostatni(" + ident + ")";
+                generate_assign(last, difference);
+            } else {
+                last = std::to_string(fold(OperationType::subtract, std::stoll(to), step_value).value());
+            }
+        }
+
+        const std::string start_label = get_new_label();
+        const std::string continue_label = get_new_label();
+        const std::string end_label = get_new_label();
+        auto label_pair = std::pair{continue_label, end_label};
+        loop_labels.emplace(label_pair);
+
+        generate_label(start_label);
+        const std::string cond = new_temp_var();
+        instructions.push_back({
+                                       step_value > 0 ? OperationType::is_less_equal : OperationType::is_greater_equal,
+                                       cond,
+                                       ident,
+                                       to
+                               });
+        instructions.push_back({OperationType::jump_false, {}, cond, end_label});
+
+        gen_begin_scope();
+        const size_t body_start = instructions.size();
+        if (const auto *stmt_scope = std::get_if<NodeStmtScope *>(&stmt_for->stmt->var)) {
+            for (NodeStatement *stmt: (*stmt_scope)->statements) {
+                generate_statement(stmt);
+            }
+        } else {
+            generate_statement(stmt_for->stmt);
+        }
+
+        const auto body = std::ranges::subrange(instructions.begin() + static_cast<long>(body_start), instructions.end());
+        if (std::ranges::any_of(body, [&](const TACInstruction &instr) {
+            return instr.op == OperationType::jump && instr.arg1 == continue_label;
+        })) {
+            generate_label(continue_label);
+        }
+
+        if (may_wrap) {
+            const std::string more = new_temp_var();
+            if (last.empty()) {
+                instructions.push_back({OperationType::not_equal, more, ident, to});
+            } else {
+                instructions.push_back({
+                                               step_value > 0 ? OperationType::is_less_equal
+                                                              : OperationType::is_greater_equal,
+                                               more,
+                                               ident,
+                                               last
+                                       });
+            }
+            instructions.push_back({OperationType::jump_false, {}, more, end_label});
+        }
+
+        const std::string next = new_temp_var();
+        instructions.push_back({OperationType::add, next, ident, step});
+        generate_assign(ident, next);
+        gen_end_scope();
+        generate_jump(start_label);
+
+        generate_label(end_label);
+
+        if (!loop_labels.empty() && loop_labels.top() == label_pair) {
+            loop_labels.pop();
+        }
+        var_types.erase(ident);
+        loop_counters.erase(ident);
+    }
+
     void generate_statement(NodeStatement *stmt) {
         struct StatementVisitor {
             IRGenerator &gen;
@@ -299,7 +1116,17 @@ public:
                 gen.var_types.try_emplace(*ident, stmt_var->type);
                 gen.scopes.top().push_back(*ident);
 
+                if (!stmt_var->constant && gen.generate_alias(stmt_var->ident, stmt_var->expr, stmt_var->type, true)) {
+                    return;
+                }
                 const std::string expr = gen.generate_expr(stmt_var->expr, stmt_var->type);
+
+                //A constant is never stored anywhere, its uses get the value itself
+                if (stmt_var->constant) {
+                    if (is_tac_value(expr)) constant_value_err(stmt_var->ident);
+                    gen.constants.try_emplace(*ident, expr);
+                    return;
+                }
                 gen.generate_assign(*ident, expr);
             }
 
@@ -318,6 +1145,9 @@ public:
             }
 
             void operator()(const NodeStmtIf *stmt_if) const {
+                if (gen.generate_select(stmt_if)) return;
+                if (gen.generate_dispatch(stmt_if)) return;
+
                 const std::string &end_label = gen.get_new_label();
                 std::string false_label = gen.get_new_label();
                 gen.generate_if_pred(stmt_if->pred, false_label, end_label);
@@ -340,8 +1170,11 @@ public:
             void operator()(const NodeStmtAssign *stmt_assign) const {
                 const std::string *ident = &stmt_assign->ident.value.value();
                 gen.check_ident(stmt_assign->ident, true);
+                if (gen.constants.contains(*ident)) constant_err(stmt_assign->ident);
+                if (gen.loop_counters.contains(*ident)) counter_err(stmt_assign->ident);
 
                 const TokenType type = gen.var_types[*ident];
+                if (gen.generate_alias(stmt_assign->ident, stmt_assign->expr, type, false)) return;
                 const std::string expr = gen.generate_expr(stmt_assign->expr, type);
 
                 gen.generate_assign(*ident, expr);
@@ -375,6 +1208,10 @@ public:
                 }
             }
 
+            void operator()(const NodeStmtFor *stmt_for) const {
+                gen.generate_for(stmt_for);
+            }
+
             void operator()(const NodeStmtBreak *stmt_break) const {
                 if (gen.loop_labels.empty()) {
                     std::cerr
@@ -422,25 +1259,51 @@ public:
                                            });
             }
 
+            /*
+             * The whole text is printed at once from the read-only data:
+             *
+             *  print_string 3
+             *      data 76
+             *      data 79
+             *      data 76
+             */
+            void operator()(const NodeStmtPrintString *stmt_print) const {
+                const std::string &text = stmt_print->text->array_expr->token.value.value();
+                if (text.empty()) return;
+
+                gen.instructions.push_back({OperationType::print_string, {}, std::to_string(text.size())});
+                for (const unsigned char c: text) {
+                    gen.instructions.push_back({OperationType::data_entry, {}, std::to_string(c)});
+                }
+            }
+
             void operator()(const NodeStmtArray *stmt_array) const {
                 const std::string &ident = stmt_array->ident.value.value();
                 gen.check_ident(stmt_array->ident, false);
 
-                std::string size = gen.generate_expr(stmt_array->size, TokenType::var_type_int);
+                const std::vector<std::string> dimensions = gen.generate_dimensions(ident, stmt_array->sizes);
+                const std::string size = gen.generate_array_size(dimensions);
+                const ElementType element = get_array_element(stmt_array->type);
 
                 gen.instructions.push_back({
                                                    OperationType::array_allocate,
                                                    ident,
-                                                   size}
+                                                   size,
+                                                   {},
+                                                   {},
+                                                   element}
                 );
 
-                gen.var_types.try_emplace(ident, stmt_array->type);
+                const TokenType type = get_array_value_type(stmt_array->type);
+                gen.var_types.try_emplace(ident, type);
+                gen.array_elements.try_emplace(ident, element);
+                gen.array_dimensions.try_emplace(ident, dimensions);
                 gen.scopes.top().push_back(ident);
 
                 if (stmt_array->contents.has_value()) {
                     const NodeTermArray *array_expr = stmt_array->contents.value();
 
-                    gen.generate_array_expr(array_expr, ident, stmt_array->type);
+                    gen.generate_array_expr(array_expr, ident, type);
                 }
             }
 
@@ -451,12 +1314,14 @@ public:
                 const TokenType type = gen.var_types[ident];
 
                 std::string expr = gen.generate_expr(stmt_arr_assign->expr, type);
-                std::string index = gen.generate_expr(stmt_arr_assign->index, TokenType::var_type_int);
+                std::string index = gen.generate_index(stmt_arr_assign->ident, stmt_arr_assign->indexes);
                 gen.instructions.push_back({
                                                    OperationType::array_assign,
                                                    ident,
                                                    index,
-                                                   expr}
+                                                   expr,
+                                                   {},
+                                                   gen.get_element_type(ident)}
                 );
             }
         };
@@ -483,12 +1348,12 @@ public:
         return instructions;
     }
 
-    std::string ir_to_string() {
+    static std::string ir_to_string(const std::vector<TACInstruction> &instructions) {
         std::stringstream out;
 
         out << "_start" << std::endl;
 
-        for (TACInstruction &instr: instructions) {
+        for (const TACInstruction &instr: instructions) {
             if (instr.op == OperationType::label) {
                 out << instr.arg1.value() << ":";
             } else {
@@ -497,7 +1362,9 @@ public:
                     out << instr.result.value() << " = ";
                 }
                 if (operation_strings.contains(instr.op)) {
-                    out << operation_strings[instr.op] << " ";
+                    out << operation_strings.at(instr.op);
+                    if (element_strings.contains(instr.element)) out << "." << element_strings.at(instr.element);
+                    out << " ";
                 }
                 if (instr.arg1.has_value()) {
                     out << instr.arg1.value();
@@ -505,6 +1372,9 @@ public:
                 if (instr.arg2.has_value()) {
                     out << ", " << instr.arg2.value();
                 }
+                if (instr.arg3.has_value()) {
+                    out << ", " << instr.arg3.value();
+                }
             }
 
             out << std::endl;
@@ -518,14 +1388,46 @@ private:
     std::vector<TACInstruction> instructions;
 
     std::map<std::string, TokenType> var_types;
+    //The values of constants, as literals
+    std::map<std::string, std::string> constants;
+    std::map<std::string, ElementType> array_elements;
+    std::map<std::string, std::vector<std::string>> array_dimensions;
+    //Counters of the `dla` loops being generated, read-only inside them
+    std::set<std::string> loop_counters;
     std::stack<std::vector<std::string>> scopes;
+    bool bounds_check;
+
+    static inline const std::map<TokenType, ElementType> element_types = {
+            {TokenType::var_type_int,     ElementType::int64},
+            {TokenType::var_type_int32,   ElementType::int32},
+            {TokenType::var_type_int16,   ElementType::int16},
+            {TokenType::var_type_int8,    ElementType::int8},
+            {TokenType::var_type_char,    ElementType::character},
+            {TokenType::var_type_string,  ElementType::character},
+            {TokenType::var_type_boolean, ElementType::boolean},
+    };
+
+    static inline const std::map<ElementType, std::string> element_strings = {
+            {ElementType::int32,     "i32"},
+            {ElementType::int16,     "i16"},
+            {ElementType::int8,      "i8"},
+            {ElementType::character, "u8"},
+            {ElementType::boolean,   "bit"},
+    };
 
     int label_counter = 0;
     std::stack<std::pair<std::string, std::string>> loop_labels;
 
     int temp_var_counter = 0;
 
-    std::map<TokenType, OperationType> token_operation_map = {
+    static constexpr int max_select_cost = 6;
+
+    static constexpr size_t min_dispatch_cases = 4;
+    static constexpr size_t dispatch_linear_cases = 3;
+    static constexpr long long max_jump_table_size = 1024;
+    static constexpr long long jump_table_density = 3;
+
+    static inline const std::map<TokenType, OperationType> token_operation_map = {
             {TokenType::add,           OperationType::add},
             {TokenType::subtract,      OperationType::subtract},
             {TokenType::multiply,      OperationType::multiply},
@@ -542,7 +1444,7 @@ private:
             {TokenType::logical_not,   OperationType::log_not},
     };
 
-    std::map<OperationType, std::string> operation_strings = {
+    static inline const std::map<OperationType, std::string> operation_strings = {
             {OperationType::add,              "add"},
             {OperationType::subtract,         "sub"},
             {OperationType::multiply,         "mul"},
@@ -557,11 +1459,15 @@ private:
             {OperationType::log_and,          "and"},
             {OperationType::log_or,           "or"},
             {OperationType::log_not,          "not"},
+            {OperationType::cond_assign,      "cmov"},
             {OperationType::jump_false,       "jmp_false"},
             {OperationType::jump,             "jmp"},
+            {OperationType::jump_table,       "jmp_table"},
+            {OperationType::table_entry,      "case"},
             {OperationType::prog_exit,        "exit"},
             {OperationType::print_int,        "print_int"},
             {OperationType::print_char,       "print_char"},
+            {OperationType::print_string,     "print_string"},
             {OperationType::read_char,        "read_char"},
             {OperationType::bgn_scope,        "begin_scope"},
             {OperationType::end_scope,        "end_scope"},
@@ -569,8 +1475,24 @@ private:
             {OperationType::array_free,       "free"},
             {OperationType::array_assign,     "offset_set"},
             {OperationType::array_get,        "offset_get"},
+            {OperationType::array_fill,       "fill"},
+            {OperationType::array_copy,       "copy"},
+            {OperationType::print_array,      "print_array"},
+            {OperationType::array_init,       "array_init"},
+            {OperationType::array_constant,   "array_constant"},
+            {OperationType::data_entry,       "data"},
+            {OperationType::array_stack,      "stack_alloc"},
+            {OperationType::array_static,     "static_alloc"},
+            {OperationType::vectorize,        "vectorize"},
+            {OperationType::bounds_check,     "bounds_check"},
     };
 
+    //Indexing a scalar treats it as a pointer to qwords, as it always did, unless it was given a narrower array
+    [[nodiscard]] ElementType get_element_type(const std::string &ident) const {
+        if (!array_elements.contains(ident)) return ElementType::int64;
+        return array_elements.at(ident);
+    }
+
     std::string new_temp_var() {
         return "#" + std::to_string(temp_var_counter++);
     }
@@ -579,6 +1501,79 @@ private:
         return "label_" + std::to_string(label_counter++);
     }
 
+    /*
+     * The size of every dimension of an array. Sizes that aren't literals are copied, as the expressions could change
+     * later, except for the first one, which only the bounds checks need:
+     *
+     *  długość(t,1) = m
+     *  #1 = mul n, długość(t,1)
+     *  t = alloc #1
+     */
+    std::vector<std::string> generate_dimensions(const std::string &ident, const std::vector<NodeExpr *> &sizes) {
+        std::vector<std::string> dimensions;
+        for (size_t i = 0; i < sizes.size(); i++) {
+            std::string size = generate_expr(sizes[i], TokenType::var_type_int);
+
+            if (is_tac_value(size) && (i > 0 || bounds_check)) {
+                const std::string copy = dimension_name(ident, i, sizes.size());
+                instructions.push_back({OperationType::assign, copy, size});
+                size = copy;
+            }
+            dimensions.push_back(size);
+        }
+        return dimensions;
+    }
+
+    //The elements of all the dimensions are stored in one block
+    std::string generate_array_size(const std::vector<std::string> &dimensions) {
+        std::string size = dimensions.front();
+        for (size_t i = 1; i < dimensions.size(); i++) {
+            if (!is_tac_value(size) && !is_tac_value(dimensions[i])) {
+                size = std::to_string(static_cast<long long>(std::stoull(size) * std::stoull(dimensions[i])));
+                continue;
+            }
+
+            const std::string product = new_temp_var();
+            instructions.push_back({OperationType::multiply, product, size, dimensions[i]});
+            size = product;
+        }
+        return size;
+    }
+
+    /*
+     * The position of an element in the block of its array, row-major: `t` element `i` na `j` of an array declared
+     * `rozmiaru [n] na [m]` is at i*m + j. Every index is checked against its own dimension. Only declared arrays
+     * have known dimensions, a scalar holding the address of one is indexed with a single index, unchecked.
+     */
+    std::string generate_index(const Token &ident, const std::vector<NodeExpr *> &indexes) {
+        const std::string &array = ident.value.value();
+        if (constants.contains(array)) constant_err(ident);
+        const std::vector<std::string> *dimensions = array_dimensions.contains(array) ? &array_dimensions.at(array)
+                                                                                      : nullptr;
+
+        check_index_count(ident, dimensions != nullptr ? dimensions->size() : 1, indexes.size());
+
+        std::string position;
+        for (size_t i = 0; i < indexes.size(); i++) {
+            const std::string index = generate_expr(indexes[i], TokenType::var_type_int);
+            if (bounds_check && dimensions != nullptr) {
+                instructions.push_back({OperationType::bounds_check, {}, index, dimensions->at(i),
+                                        std::to_string(ident.line)});
+            }
+
+            if (i == 0) {
+                position = index;
+                continue;
+            }
+
+            const std::string row = new_temp_var();
+            instructions.push_back({OperationType::multiply, row, position, dimensions->at(i)});
+            position = new_temp_var();
+            instructions.push_back({OperationType::add, position, row, index});
+        }
+        return position;
+    }
+
     void gen_begin_scope() {
         scopes.emplace();
         instructions.push_back({OperationType::bgn_scope});
@@ -590,6 +1585,9 @@ private:
 
             }
             var_types.erase(var);
+            constants.erase(var);
+            array_elements.erase(var);
+            array_dimensions.erase(var);
 
         }
         scopes.pop();
@@ -0,0 +1,1214 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "ir_generator.hpp"
+
+enum class VectorKind {
+    sum, count, min, max, map
+};
+
+//A counted loop whose body can be executed several elements at a time, see IROptimizer::match_vector_loop
+struct VectorLoop {
+    VectorKind kind{};
+    std::string accumulator;
+    std::string array;
+    std::string dest;
+    OperationType op{};
+    std::string lhs;
+    std::string rhs;
+    bool lhs_array{};
+    bool rhs_array{};
+};
+
+struct CountedLoop {
+    size_t begin{};
+    size_t end{};
+    std::string counter;
+    std::string bound;
+    bool inclusive{};
+    bool scoped{};
+    std::vector<TACInstruction> body;
+};
+
+//A loop testing a counter at its top, see IROptimizer::match_guarded_loop
+struct GuardedLoop {
+    size_t header{};
+    size_t back_edge{};
+    std::string counter;
+    std::string bound;
+    bool inclusive{};
+    //Position of `i = #k` following `#k = add i, 1`, when that's the only way the counter changes
+    std::optional<size_t> increment;
+    //No other loop is nested inside
+    bool innermost{};
+};
+
+//`lhs op rhs - offset` has to hold for a bounds check to be moved in front of its loop
+struct RangeTest {
+    OperationType op{};
+    std::string lhs;
+    std::string rhs;
+    long long offset{};
+};
+
+class IROptimizer {
+public:
+    explicit IROptimizer(std::vector<TACInstruction> &instructions) : instructions(std::move(instructions)) {
+        for (const TACInstruction &instr: this->instructions) {
+            for (const auto &operand: {instr.result, instr.arg1, instr.arg2, instr.arg3}) {
+                if (!operand.has_value()) continue;
+
+                if (is_temp(operand.value())) {
+                    temp_var_counter = std::max(temp_var_counter, std::stoi(operand->substr(1)) + 1);
+                } else if (operand->starts_with("label_") && is_num(operand->substr(6))) {
+                    label_counter = std::max(label_counter, std::stoi(operand->substr(6)) + 1);
+                }
+            }
+        }
+    }
+
+    [[nodiscard]] std::vector<TACInstruction> optimize() {
+        hoist_loop_invariants();
+        reduce_row_offsets();
+        eliminate_bounds_checks();
+        replace_small_arrays();
+        use_constant_arrays();
+        place_fixed_arrays();
+        recognize_loop_idioms();
+        vectorize_loops();
+
+        return instructions;
+    }
+
+    static bool is_temp(const std::string &operand) {
+        return operand[0] == '#';
+    }
+
+    static bool is_num(const std::string &operand) {
+        char *p;
+        strtol(operand.c_str(), &p, 10);
+        return *p == 0;
+    }
+
+    static bool is_var(const std::string &operand) {
+        return !is_temp(operand) && !is_num(operand);
+    }
+
+    /*
+     * Matches the shape every `powtarzaj jeśli (`i` mniejsze N): { ... `i` równa `i` dodać [jeden] }` is lowered to:
+     *
+     *  L:  #c = lt/le i, N
+     *      jmp_false #c, E
+     *      begin_scope
+     *      <straight-line body>
+     *      [#g = ne i, N               a dla loop ends here at its last iteration, which only matters when
+     *      jmp_false #g, E]            stepping the counter would wrap it around
+     *      #k = add i, 1
+     *      i = #k
+     *      end_scope
+     *      jmp L
+     *  E:
+     *
+     * N has to be a literal or a variable the body doesn't write.
+     */
+    [[nodiscard]] static std::optional<CountedLoop> match_counted_loop(const std::vector<TACInstruction> &instructions,
+                                                                      const size_t at) {
+        const auto instr_at = [&instructions](const size_t index) -> const TACInstruction * {
+            return index < instructions.size() ? &instructions[index] : nullptr;
+        };
+
+        const TACInstruction *header = instr_at(at);
+        const TACInstruction *guard = instr_at(at + 1);
+        const TACInstruction *branch = instr_at(at + 2);
+        if (header == nullptr || guard == nullptr || branch == nullptr) return {};
+        if (header->op != OperationType::label) return {};
+        if (guard->op != OperationType::is_less && guard->op != OperationType::is_less_equal) return {};
+        if (branch->op != OperationType::jump_false || branch->arg1 != guard->result) return {};
+
+        CountedLoop loop;
+        loop.begin = at;
+        loop.counter = guard->arg1.value();
+        loop.bound = guard->arg2.value();
+        loop.inclusive = guard->op == OperationType::is_less_equal;
+        if (!is_var(loop.counter) || is_temp(loop.bound) || loop.bound == loop.counter) return {};
+
+        size_t index = at + 3;
+        loop.scoped = instr_at(index) != nullptr && instr_at(index)->op == OperationType::bgn_scope;
+        if (loop.scoped) index++;
+
+        for (; index < instructions.size(); index++) {
+            const TACInstruction &instr = instructions[index];
+            const TACInstruction *next = instr_at(index + 1);
+
+            if (instr.op == OperationType::add && next != nullptr && next->op == OperationType::assign &&
+                next->result == loop.counter && next->arg1 == instr.result &&
+                ((instr.arg1 == loop.counter && instr.arg2 == "1") ||
+                 (instr.arg1 == "1" && instr.arg2 == loop.counter))) {
+                break;
+            }
+
+            //Ends the same iterations as the check at the top, only leaving the counter one step short
+            if (loop.inclusive && instr.op == OperationType::not_equal && instr.arg1 == loop.counter &&
+                instr.arg2 == loop.bound && next != nullptr && next->op == OperationType::jump_false &&
+                next->arg1 == instr.result && next->arg2 == branch->arg2) {
+                index++;
+                continue;
+            }
+
+            switch (instr.op) {
+                case OperationType::label:
+                case OperationType::jump:
+                case OperationType::jump_false:
+                case OperationType::jump_table:
+                case OperationType::bgn_scope:
+                case OperationType::end_scope:
+                case OperationType::array_allocate:
+                case OperationType::array_init:
+                case OperationType::array_constant:
+                case OperationType::array_stack:
+                case OperationType::array_static:
+                case OperationType::bounds_check:
+                case OperationType::prog_exit:
+                    return {};
+                default:
+                    break;
+            }
+
+            //Array stores name the array in result, so they don't write a scalar
+            if (instr.op != OperationType::array_assign && instr.result.has_value() &&
+                (instr.result == loop.counter || instr.result == loop.bound)) {
+                return {};
+            }
+            loop.body.push_back(instr);
+        }
+
+        index += 2;
+        if (loop.scoped) {
+            if (instr_at(index) == nullptr || instr_at(index)->op != OperationType::end_scope) return {};
+            index++;
+        }
+
+        const TACInstruction *back_edge = instr_at(index);
+        const TACInstruction *exit = instr_at(index + 1);
+        if (back_edge == nullptr || back_edge->op != OperationType::jump || back_edge->arg1 != header->arg1) return {};
+        if (exit == nullptr || exit->op != OperationType::label || exit->arg1 != branch->arg2) return {};
+
+        loop.end = index + 1;
+        return loop;
+    }
+
+    /*
+     * Classifies the body of a counted loop, where every array access has to use the counter as the index:
+     *
+     *  sum:    `s` równa `s` dodać `a` element `i`
+     *  count:  jeśli (`a` element `i` równe/większe/mniejsze `k`): `c` równa `c` dodać [jeden]
+     *  min/max: jeśli (`a` element `i` mniejsze/większe `m`): `m` równa `a` element `i`
+     *  map:    `c` element `i` równa <array or invariant> dodać/odjąć/oraz/lub <array or invariant>
+     *
+     * The two latter reductions only reach this form through if-conversion.
+     */
+    [[nodiscard]] static std::optional<VectorLoop> match_vector_loop(const CountedLoop &loop) {
+        const std::vector<TACInstruction> &body = loop.body;
+        const std::string &counter = loop.counter;
+
+        //The vector instructions work on qword lanes
+        if (std::ranges::any_of(body, [](const TACInstruction &instr) {
+            return (instr.op == OperationType::array_get || instr.op == OperationType::array_assign) &&
+                   instr.element != ElementType::int64;
+        })) {
+            return {};
+        }
+
+        const auto is_element = [&counter](const TACInstruction &instr, const std::string &temp) {
+            return instr.op == OperationType::array_get && instr.result == temp && instr.arg2 == counter;
+        };
+        //Scalars read by the body must keep their value for the whole loop
+        const auto is_invariant = [&loop, &body](const std::string &operand) {
+            if (is_temp(operand) || operand == loop.counter) return false;
+            return std::ranges::none_of(body, [&operand](const TACInstruction &instr) {
+                return instr.op != OperationType::array_assign && instr.result == operand;
+            });
+        };
+
+        if (body.size() == 3 && body[1].op == OperationType::add && body[2].op == OperationType::assign &&
+            body[2].arg1 == body[1].result) {
+            const std::string &sum = body[2].result.value();
+            const std::string &element = body[1].arg1 == sum ? body[1].arg2.value() : body[1].arg1.value();
+            const std::string &other = body[1].arg1 == sum ? body[1].arg1.value() : body[1].arg2.value();
+
+            if (other == sum && is_var(sum) && sum != counter && is_element(body[0], element)) {
+                return VectorLoop{VectorKind::sum, sum, body[0].arg1.value()};
+            }
+            return {};
+        }
+
+        if (body.size() == 4 && body[3].op == OperationType::cond_assign && body[2].result == body[3].arg1) {
+            const TACInstruction &value = body[0];
+            const TACInstruction &element = body[1];
+            const TACInstruction &compare = body[2];
+            const std::string &target = body[3].result.value();
+            if (!is_element(element, element.result.value()) || target == counter) return {};
+
+            //Normalize the comparison to `element <op> other`
+            OperationType op = compare.op;
+            std::string other = compare.arg2.value();
+            if (compare.arg2 == element.result) {
+                other = compare.arg1.value();
+                if (op == OperationType::is_greater) op = OperationType::is_less;
+                else if (op == OperationType::is_less) op = OperationType::is_greater;
+                else if (op != OperationType::is_equal) return {};
+            } else if (compare.arg1 != element.result) {
+                return {};
+            }
+
+            if (value.op == OperationType::add && value.result == body[3].arg2 &&
+                ((value.arg1 == target && value.arg2 == "1") || (value.arg1 == "1" && value.arg2 == target)) &&
+                (op == OperationType::is_equal || op == OperationType::is_greater || op == OperationType::is_less) &&
+                other != target && is_invariant(other)) {
+                return VectorLoop{VectorKind::count, target, element.arg1.value(), {}, op, {}, other};
+            }
+
+            if (is_element(value, body[3].arg2.value()) && value.arg1 == element.arg1 && other == target) {
+                if (op == OperationType::is_greater) return VectorLoop{VectorKind::max, target, element.arg1.value()};
+                if (op == OperationType::is_less) return VectorLoop{VectorKind::min, target, element.arg1.value()};
+            }
+            return {};
+        }
+
+        //Every array_get feeds the element-wise operation, which feeds the only store
+        const TACInstruction &store = body.back();
+        if (body.size() < 2 || body.size() > 4 || store.op != OperationType::array_assign ||
+            store.arg1 != counter) {
+            return {};
+        }
+
+        const TACInstruction &operation = body[body.size() - 2];
+        if (operation.op != OperationType::add && operation.op != OperationType::subtract &&
+            operation.op != OperationType::log_and && operation.op != OperationType::log_or) {
+            return {};
+        }
+        if (store.arg2 != operation.result) return {};
+
+        std::map<std::string, std::string> elements;
+        for (size_t i = 0; i + 2 < body.size(); i++) {
+            if (!is_element(body[i], body[i].result.value())) return {};
+            elements[body[i].result.value()] = body[i].arg1.value();
+        }
+
+        VectorLoop vector_loop{VectorKind::map, {}, {}, store.result.value(), operation.op};
+        size_t used_elements = 0;
+        const auto resolve = [&](const std::string &operand, std::string &out, bool &is_array) {
+            if (elements.contains(operand)) {
+                out = elements.at(operand);
+                is_array = true;
+                used_elements++;
+                return true;
+            }
+            out = operand;
+            return is_invariant(operand);
+        };
+
+        if (!resolve(operation.arg1.value(), vector_loop.lhs, vector_loop.lhs_array) ||
+            !resolve(operation.arg2.value(), vector_loop.rhs, vector_loop.rhs_array) ||
+            used_elements != elements.size()) {
+            return {};
+        }
+
+        return vector_loop;
+    }
+
+private:
+    std::vector<TACInstruction> instructions;
+
+    int temp_var_counter = 0;
+    int label_counter = 0;
+
+    //Larger arrays stay out of the stack frame, and so does everything past the limit for all the arrays in it
+    static constexpr long long max_stack_array_bytes = 1 << 14;
+    static constexpr long long max_stack_bytes = 1 << 20;
+
+    //Arrays up to this many elements can be split into variables, more wouldn't fit into the registers anyway
+    static constexpr long long max_replaced_array_size = 8;
+
+    //Loops up to this many instructions get an unchecked copy, run when the checks moved in front of them pass
+    static constexpr size_t max_versioned_loop_size = 256;
+
+    std::string new_temp_var() {
+        return "#" + std::to_string(temp_var_counter++);
+    }
+
+    std::string get_new_label() {
+        return "label_" + std::to_string(label_counter++);
+    }
+
+    /*
+     * Marks counted loops that can process several elements per iteration. The loop itself is left untouched, so
+     * backends without vector support just ignore the hint, and the rest use it as the scalar epilogue. Every array
+     * the loop goes through has to be private, as an element stored through an alias could be read by a later
+     * iteration, which the vector loop already did. The same array can still be read and written, at the same index.
+     */
+    void vectorize_loops() {
+        const std::set<std::string> arrays = private_arrays();
+
+        std::vector<TACInstruction> result;
+        for (size_t i = 0; i < instructions.size(); i++) {
+            const std::optional<CountedLoop> loop = match_counted_loop(instructions, i);
+            if (loop.has_value()) {
+                const std::optional<VectorLoop> vector_loop = match_vector_loop(loop.value());
+                if (vector_loop.has_value() && std::ranges::all_of(accessed_arrays(vector_loop.value()),
+                                                                   [&arrays](const std::string &array) {
+                                                                       return arrays.contains(array);
+                                                                   }) &&
+                    !is_declared_array(vector_loop->accumulator)) {
+                    result.push_back({OperationType::vectorize, {}, instructions[i].arg1});
+                }
+            }
+
+            result.push_back(instructions[i]);
+        }
+
+        instructions = result;
+    }
+
+    static std::vector<std::string> accessed_arrays(const VectorLoop &loop) {
+        if (loop.kind != VectorKind::map) return {loop.array};
+
+        std::vector<std::string> arrays = {loop.dest};
+        if (loop.lhs_array) arrays.push_back(loop.lhs);
+        if (loop.rhs_array) arrays.push_back(loop.rhs);
+        return arrays;
+    }
+
+    static bool is_declaration(const OperationType op) {
+        return op == OperationType::array_allocate || op == OperationType::array_constant ||
+               op == OperationType::array_stack || op == OperationType::array_static;
+    }
+
+    [[nodiscard]] bool is_declared_array(const std::string &name) const {
+        return std::ranges::any_of(instructions, [&name](const TACInstruction &instr) {
+            return is_declaration(instr.op) && instr.result == name;
+        });
+    }
+
+    /*
+     * Arrays no other name can point into: every declaration keeps the address private and nothing else ever
+     * assigns the name. A scalar holding the address of an array, or an address computed from it, can't be told
+     * apart from the array it points into, so loops going through one are left as they are.
+     */
+    [[nodiscard]] std::set<std::string> private_arrays() const {
+        std::set<std::string> arrays;
+        std::set<std::string> escaping;
+        for (size_t i = 0; i < instructions.size(); i++) {
+            const TACInstruction &instr = instructions[i];
+            if (is_declaration(instr.op)) {
+                arrays.insert(instr.result.value());
+                if (!is_private(instr.result.value(), i + 1, true)) escaping.insert(instr.result.value());
+            } else if (const auto def = get_def(instr); def.has_value()) {
+                escaping.insert(def.value());
+            }
+        }
+
+        for (const std::string &array: escaping) {
+            arrays.erase(array);
+        }
+        return arrays;
+    }
+
+    //Value the counter ends with (the bound, plus one for inclusive loops), appending any instructions it needs
+    std::string loop_end_value(const CountedLoop &loop, std::vector<TACInstruction> &out) {
+        if (!loop.inclusive) return loop.bound;
+
+        if (is_num(loop.bound)) {
+            return std::to_string(static_cast<long long>(static_cast<uint64_t>(std::stoll(loop.bound)) + 1));
+        }
+
+        std::string end = new_temp_var();
+        out.push_back({OperationType::add, end, loop.bound, "1"});
+        return end;
+    }
+
+    /*
+     * Arithmetic a loop repeats with the same operands in every iteration is done once in front of it instead, which
+     * takes the row offsets of multi-dimensional arrays out of the loops going through a row:
+     *
+     *  L:  ...                             #1 = mul i, długość(t,1)
+     *      #1 = mul i, długość(t,1)   =>   L:  ...
+     *      #2 = add #1, j                      #2 = add #1, j
+     *      jmp L                               jmp L
+     *
+     * Only operations that can't trap are moved, as the loop might not run at all.
+     */
+    void hoist_loop_invariants() {
+        for (bool changed = true; changed;) {
+            changed = false;
+
+            std::map<std::string, size_t> back_edges;
+            for (size_t i = 0; i < instructions.size(); i++) {
+                if (instructions[i].op == OperationType::jump) back_edges[instructions[i].arg1.value()] = i;
+            }
+
+            for (size_t i = 0; i < instructions.size() && !changed; i++) {
+                const TACInstruction &instr = instructions[i];
+                if (instr.op != OperationType::label || !back_edges.contains(instr.arg1.value()) ||
+                    back_edges.at(instr.arg1.value()) < i) {
+                    continue;
+                }
+
+                changed = hoist_from_loop(i, back_edges.at(instr.arg1.value()));
+            }
+        }
+    }
+
+    bool hoist_from_loop(const size_t header, const size_t back_edge) {
+        std::set<std::string> defined;
+        for (size_t i = header; i <= back_edge; i++) {
+            if (const auto def = get_def(instructions[i]); def.has_value()) defined.insert(def.value());
+        }
+
+        std::set<size_t> hoisted;
+        for (size_t i = header + 1; i < back_edge; i++) {
+            const TACInstruction &instr = instructions[i];
+            if (instr.op != OperationType::add && instr.op != OperationType::subtract &&
+                instr.op != OperationType::multiply) {
+                continue;
+            }
+            if (!is_temp(instr.result.value()) || defined.contains(instr.arg1.value()) ||
+                defined.contains(instr.arg2.value())) {
+                continue;
+            }
+
+            hoisted.insert(i);
+            defined.erase(instr.result.value());
+        }
+        if (hoisted.empty()) return false;
+
+        std::vector<TACInstruction> result(instructions.begin(), instructions.begin() + static_cast<long>(header));
+        for (const size_t i: hoisted) {
+            result.push_back(instructions[i]);
+        }
+        for (size_t i = header; i < instructions.size(); i++) {
+            if (!hoisted.contains(i)) result.push_back(instructions[i]);
+        }
+
+        instructions = result;
+        return true;
+    }
+
+    /*
+     * A row offset left in a loop going through the rows multiplies its counter by the same size every time. It's
+     * kept in a variable instead, set up in front of the loop and moved to the next row together with the counter:
+     *
+     *                                      #3 = mul i, w
+     *                                      i*w = #3
+     *  L:  ...                             L:  ...
+     *      #1 = mul i, w                       #1 = i*w
+     *      ...                        =>       ...
+     *      #k = add i, 1                       #k = add i, 1
+     *      i = #k                              i = #k
+     *                                          #4 = add i*w, w
+     *                                          i*w = #4
+     *
+     * Innermost loops are left alone, so that the vectorizer still recognizes them.
+     */
+    void reduce_row_offsets() {
+        for (size_t h = instructions.size(); h-- > 0;) {
+            const std::optional<GuardedLoop> loop = match_guarded_loop(h);
+            if (!loop.has_value() || loop->innermost || !loop->increment.has_value()) continue;
+
+            const size_t increment = loop->increment.value();
+            std::map<std::string, std::string> products;
+            std::map<size_t, std::string> reduced;
+            for (size_t i = h + 3; i + 1 < increment; i++) {
+                const TACInstruction &instr = instructions[i];
+                if (instr.op != OperationType::multiply || !is_temp(instr.result.value())) continue;
+
+                const std::string &size = instr.arg1 == loop->counter ? instr.arg2.value() : instr.arg1.value();
+                if ((instr.arg1 != loop->counter && instr.arg2 != loop->counter) || size == loop->counter ||
+                    !is_invariant(loop.value(), size)) {
+                    continue;
+                }
+
+                products.try_emplace(size, loop->counter + "*" + size);
+                reduced[i] = products.at(size);
+            }
+            if (reduced.empty()) continue;
+
+            std::vector<TACInstruction> result(instructions.begin(), instructions.begin() + static_cast<long>(h));
+            for (const auto &[size, product]: products) {
+                const std::string start = new_temp_var();
+                result.push_back({OperationType::multiply, start, loop->counter, size});
+                result.push_back({OperationType::assign, product, start});
+            }
+            for (size_t i = h; i < instructions.size(); i++) {
+                if (reduced.contains(i)) {
+                    result.push_back({OperationType::assign, instructions[i].result, reduced.at(i)});
+                    continue;
+                }
+
+                result.push_back(instructions[i]);
+                if (i != increment) continue;
+
+                for (const auto &[size, product]: products) {
+                    const std::string next = new_temp_var();
+                    result.push_back({OperationType::add, next, product, size});
+                    result.push_back({OperationType::assign, product, next});
+                }
+            }
+
+            instructions = result;
+        }
+    }
+
+    /*
+     * With --bounds-check every array access is preceded by `bounds_check index, length, line`. Inside a loop running
+     * its counter over a range the array covers, most of them can't fail:
+     *
+     *  i = 0                               the counter starts at a literal,
+     *  L:  #c = lt i, n                    is compared against the bound at the top,
+     *      jmp_false #c, E
+     *      bounds_check i, długość(a), 5   so it's in [0, n) here, and `a` was declared with n elements
+     *      ...
+     *      #k = add i, 1                   and it only ever grows by one, after the check
+     *      i = #k
+     *      jmp L
+     *  E:
+     *
+     * Those are removed. The remaining checks of an innermost loop, indexed by the counter plus a constant or by
+     * something the loop doesn't change, are tested once in front of it for the whole range instead. When the tests
+     * pass, an unchecked copy of the loop runs, otherwise the original one does, so a failing access still fails at
+     * the very same iteration.
+     */
+    void eliminate_bounds_checks() {
+        std::set<size_t> removed;
+        for (size_t i = 0; i < instructions.size(); i++) {
+            const TACInstruction &instr = instructions[i];
+            if (instr.op == OperationType::bounds_check && is_num(instr.arg1.value()) && is_num(instr.arg2.value()) &&
+                holds(OperationType::is_greater_equal, instr.arg1.value(), "0", 0) &&
+                holds(OperationType::is_less, instr.arg1.value(), instr.arg2.value(), 0)) {
+                removed.insert(i);
+            }
+        }
+
+        std::map<size_t, std::set<size_t>> hoisted;
+        std::map<size_t, std::vector<RangeTest>> loop_tests;
+        for (size_t i = 0; i < instructions.size(); i++) {
+            const std::optional<GuardedLoop> loop = match_guarded_loop(i);
+            if (!loop.has_value()) continue;
+
+            std::set<size_t> moved;
+            std::vector<RangeTest> tests;
+            for (size_t check = loop->header + 3; check < loop->back_edge; check++) {
+                if (instructions[check].op != OperationType::bounds_check || removed.contains(check)) continue;
+
+                const std::optional<std::vector<RangeTest>> needed = range_tests(loop.value(), check);
+                if (!needed.has_value()) continue;
+
+                if (needed->empty()) {
+                    removed.insert(check);
+                } else if (loop->innermost) {
+                    moved.insert(check);
+                    tests.insert(tests.end(), needed->begin(), needed->end());
+                }
+            }
+
+            if (!moved.empty() && loop->back_edge - loop->header <= max_versioned_loop_size) {
+                hoisted[loop->header] = moved;
+                loop_tests[loop->header] = tests;
+            }
+        }
+
+        std::vector<TACInstruction> result;
+        for (size_t i = 0; i < instructions.size(); i++) {
+            if (hoisted.contains(i)) {
+                const size_t back_edge = match_guarded_loop(i)->back_edge;
+                for (const RangeTest &test: loop_tests.at(i)) {
+                    append_range_test(test, instructions[i].arg1.value(), result);
+                }
+                append_loop_copy(i, back_edge, hoisted.at(i), removed, result);
+            }
+
+            if (!removed.contains(i)) result.push_back(instructions[i]);
+        }
+
+        instructions = result;
+    }
+
+    /*
+     * Matches a loop tested at the top, with any body in between:
+     *
+     *  L:  #c = lt/le i, N
+     *      jmp_false #c, E
+     *      ...
+     *      jmp L
+     *  E:
+     *
+     * N has to be a literal or a variable the loop doesn't write.
+     */
+    [[nodiscard]] std::optional<GuardedLoop> match_guarded_loop(const size_t at) const {
+        if (at + 2 >= instructions.size()) return {};
+
+        const TACInstruction &header = instructions[at];
+        const TACInstruction &guard = instructions[at + 1];
+        const TACInstruction &branch = instructions[at + 2];
+        if (header.op != OperationType::label) return {};
+        if (guard.op != OperationType::is_less && guard.op != OperationType::is_less_equal) return {};
+        if (branch.op != OperationType::jump_false || branch.arg1 != guard.result) return {};
+
+        GuardedLoop loop;
+        loop.header = at;
+        loop.counter = guard.arg1.value();
+        loop.bound = guard.arg2.value();
+        loop.inclusive = guard.op == OperationType::is_less_equal;
+        if (!is_var(loop.counter) || loop.bound == loop.counter) return {};
+
+        std::map<std::string, size_t> labels;
+        for (size_t i = at + 3; i + 1 < instructions.size(); i++) {
+            const TACInstruction &instr = instructions[i];
+            if (instr.op == OperationType::jump && instr.arg1 == header.arg1 &&
+                instructions[i + 1].op == OperationType::label && instructions[i + 1].arg1 == branch.arg2) {
+                loop.back_edge = i;
+                break;
+            }
+            if (instr.op == OperationType::label) labels[instr.arg1.value()] = i;
+        }
+        if (loop.back_edge == 0 || !is_invariant(loop, loop.bound)) return {};
+
+        //Jumping back to a label inside the body makes a nested loop
+        std::vector<std::pair<size_t, size_t>> nested;
+        for (size_t i = at + 3; i < loop.back_edge; i++) {
+            const TACInstruction &instr = instructions[i];
+            const std::optional<std::string> &target = instr.op == OperationType::jump_false ? instr.arg2 : instr.arg1;
+            if ((instr.op == OperationType::jump || instr.op == OperationType::jump_false ||
+                 instr.op == OperationType::table_entry) && labels.contains(target.value()) &&
+                labels.at(target.value()) < i) {
+                nested.emplace_back(labels.at(target.value()), i);
+            }
+        }
+        loop.innermost = nested.empty();
+
+        std::vector<size_t> defs;
+        for (size_t i = at + 3; i < loop.back_edge; i++) {
+            if (get_def(instructions[i]) == loop.counter) defs.push_back(i);
+        }
+        if (defs.size() != 1 || defs[0] < at + 4) return loop;
+
+        const size_t def = defs[0];
+        const TACInstruction &assign = instructions[def];
+        const TACInstruction &add = instructions[def - 1];
+        if (assign.op != OperationType::assign || add.op != OperationType::add || add.result != assign.arg1 ||
+            !((add.arg1 == loop.counter && add.arg2 == "1") || (add.arg1 == "1" && add.arg2 == loop.counter))) {
+            return loop;
+        }
+        if (std::ranges::any_of(nested, [def](const std::pair<size_t, size_t> &range) {
+            return range.first <= def && def <= range.second;
+        })) {
+            return loop;
+        }
+
+        loop.increment = def;
+        return loop;
+    }
+
+    //Nothing in the loop writes it
+    [[nodiscard]] bool is_invariant(const GuardedLoop &loop, const std::string &operand) const {
+        if (is_num(operand)) return true;
+
+        for (size_t i = loop.header; i <= loop.back_edge; i++) {
+            if (get_def(instructions[i]) == operand) return false;
+        }
+        return true;
+    }
+
+    /*
+     * What has to hold in front of the loop for the check to pass in every iteration, nothing if it always does, or
+     * no value if that can't be told. A counter only ever growing by one can't wrap around before it runs past any
+     * bound, so in the body, before its increment, it's between its starting value and the bound.
+     */
+    [[nodiscard]] std::optional<std::vector<RangeTest>> range_tests(const GuardedLoop &loop, const size_t check) const {
+        const std::string &index = instructions[check].arg1.value();
+        const std::string &length = instructions[check].arg2.value();
+        if (!is_invariant(loop, length)) return {};
+
+        std::vector<RangeTest> tests;
+        const auto require = [&tests](const OperationType op, const std::string &lhs, const std::string &rhs,
+                                      const long long offset) {
+            if (is_num(lhs) && is_num(rhs)) return holds(op, lhs, rhs, offset);
+
+            tests.push_back({op, lhs, rhs, offset});
+            return true;
+        };
+
+        if (is_invariant(loop, index)) {
+            if (!require(OperationType::is_greater_equal, index, "0", 0) ||
+                !require(OperationType::is_less, index, length, 0)) {
+                return {};
+            }
+            return tests;
+        }
+
+        const std::optional<long long> offset = counter_offset(loop, check);
+        if (!offset.has_value()) return {};
+
+        //The counter plus the offset stays at least 0
+        const std::optional<long long> start = start_value(loop);
+        if (start.has_value() && start.value() + offset.value() < 0) return {};
+        if (!start.has_value() && !require(OperationType::is_greater_equal, loop.counter,
+                                           std::to_string(-offset.value()), 0)) {
+            return {};
+        }
+
+        //And below the length, as the bound is at most the length minus the offset
+        const bool bounded = loop.inclusive ? offset.value() < 0 : offset.value() <= 0;
+        if (!bounded || !same_value(length, loop.bound, loop.header)) {
+            if (!require(loop.inclusive ? OperationType::is_less : OperationType::is_less_equal, loop.bound, length,
+                         offset.value())) {
+                return {};
+            }
+        }
+
+        return tests;
+    }
+
+    //The constant the index of the check adds to the counter, when the counter can't have changed since the guard
+    [[nodiscard]] std::optional<long long> counter_offset(const GuardedLoop &loop, const size_t check) const {
+        if (!loop.increment.has_value() || loop.increment.value() < check) return {};
+
+        const std::string &index = instructions[check].arg1.value();
+        if (index == loop.counter) return 0;
+        if (!is_temp(index)) return {};
+
+        for (size_t i = check; i-- > loop.header + 3;) {
+            const TACInstruction &instr = instructions[i];
+            if (instr.result != index) continue;
+
+            std::optional<std::string> constant;
+            if (instr.op == OperationType::add && instr.arg1 == loop.counter) constant = instr.arg2;
+            if (instr.op == OperationType::add && instr.arg2 == loop.counter) constant = instr.arg1;
+            if (instr.op == OperationType::subtract && instr.arg1 == loop.counter && is_num(instr.arg2.value())) {
+                constant = "-" + instr.arg2.value();
+            }
+            if (!constant.has_value() || !is_num(constant.value())) return {};
+
+            const long long value = std::stoll(constant->starts_with("--") ? constant->substr(2) : constant.value());
+            if (std::llabs(value) >= 1 << 30) return {};
+            return value;
+        }
+
+        return {};
+    }
+
+    //The literal the counter is set to right in front of the loop, with nothing else able to jump in between
+    [[nodiscard]] std::optional<long long> start_value(const GuardedLoop &loop) const {
+        for (size_t i = loop.header; i-- > 0;) {
+            const TACInstruction &instr = instructions[i];
+            if (instr.op == OperationType::label) return {};
+            if (get_def(instr) != loop.counter) continue;
+
+            if (instr.op != OperationType::assign || !is_num(instr.arg1.value())) return {};
+            return std::stoll(instr.arg1.value());
+        }
+
+        return {};
+    }
+
+    /*
+     * Whether the length variable of an array still holds the value of the bound at the loop. The array is visible
+     * there, so its declaration `długość(a) = n` is the last write of the length before it, and runs again before
+     * any path reaching the loop once more, unless the loop is in the same scope. Neither can change until that
+     * scope ends.
+     */
+    [[nodiscard]] bool same_value(const std::string &length, const std::string &bound, const size_t header) const {
+        if (!is_var(length) || !is_var(bound)) return false;
+
+        size_t declaration = header;
+        while (declaration-- > 0 && get_def(instructions[declaration]) != length) {
+        }
+        if (declaration >= header) return false;
+
+        const TACInstruction &copy = instructions[declaration];
+        if (copy.op != OperationType::assign || copy.arg1 != bound) return false;
+
+        int depth = 0;
+        for (size_t i = declaration + 1; i < instructions.size() && depth >= 0; i++) {
+            if (instructions[i].op == OperationType::bgn_scope) depth++;
+            if (instructions[i].op == OperationType::end_scope) depth--;
+
+            const std::optional<std::string> def = get_def(instructions[i]);
+            if (def == length || def == bound) return false;
+        }
+
+        return true;
+    }
+
+    static bool holds(const OperationType op, const std::string &lhs, const std::string &rhs, const long long offset) {
+        const __int128 a = std::stoll(lhs);
+        const __int128 b = static_cast<__int128>(std::stoll(rhs)) - offset;
+        switch (op) {
+            case OperationType::is_greater_equal:
+                return a >= b;
+            case OperationType::is_less:
+                return a < b;
+            case OperationType::is_less_equal:
+                return a <= b;
+            default:
+                assert(false); //Unreachable
+        }
+    }
+
+    //Jumps to the checked loop unless the test holds, a literal compared from the other side
+    void append_range_test(const RangeTest &test, const std::string &checked_loop, std::vector<TACInstruction> &out) {
+        static const std::map<OperationType, OperationType> mirrored = {
+                {OperationType::is_greater_equal, OperationType::is_less_equal},
+                {OperationType::is_less,          OperationType::is_greater},
+                {OperationType::is_less_equal,    OperationType::is_greater_equal},
+        };
+
+        std::string rhs = test.rhs;
+        if (test.offset != 0 && is_num(rhs)) {
+            rhs = std::to_string(std::stoll(rhs) - test.offset);
+        } else if (test.offset != 0) {
+            rhs = new_temp_var();
+            out.push_back({OperationType::subtract, rhs, test.rhs, std::to_string(test.offset)});
+        }
+
+        const std::string cond = new_temp_var();
+        if (is_num(test.lhs)) {
+            out.push_back({mirrored.at(test.op), cond, rhs, test.lhs});
+        } else {
+            out.push_back({test.op, cond, test.lhs, rhs});
+        }
+        out.push_back({OperationType::jump_false, {}, cond, checked_loop});
+    }
+
+    //Copies the loop with new labels and temporaries, leaving out the checks moved in front of it
+    void append_loop_copy(const size_t header, const size_t back_edge, const std::set<size_t> &hoisted,
+                          const std::set<size_t> &removed, std::vector<TACInstruction> &out) {
+        std::map<std::string, std::string> renamed;
+        for (size_t i = header; i <= back_edge; i++) {
+            const TACInstruction &instr = instructions[i];
+            if (instr.op == OperationType::label) renamed[instr.arg1.value()] = get_new_label();
+            if (const auto def = get_def(instr); def.has_value() && is_temp(def.value())) {
+                renamed[def.value()] = new_temp_var();
+            }
+        }
+
+        for (size_t i = header; i <= back_edge; i++) {
+            if (hoisted.contains(i) || removed.contains(i)) continue;
+
+            TACInstruction copy = instructions[i];
+            for (std::optional<std::string> *operand: {&copy.result, &copy.arg1, &copy.arg2, &copy.arg3}) {
+                if (operand->has_value() && renamed.contains(operand->value())) {
+                    *operand = renamed.at(operand->value());
+                }
+            }
+            out.push_back(copy);
+        }
+    }
+
+    /*
+     * Small arrays only ever indexed with literals are split into a variable per element, which the register allocator
+     * can keep in registers instead of memory:
+     *
+     *  s = alloc 2                 s[0] = 0
+     *  s = offset_set 1, x    =>   s[1] = 0
+     *  #1 = offset_get s, 1        s[1] = x
+     *                              #1 = s[1]
+     *
+     * The array has to be declared only once and its name can't be used in any other way, so that its address can't
+     * escape. Narrower elements are left alone, as their values wrap around when stored.
+     */
+    void replace_small_arrays() {
+        std::map<std::string, long long> sizes;
+        std::set<std::string> rejected;
+        for (const TACInstruction &instr: instructions) {
+            if (instr.op != OperationType::array_allocate) continue;
+
+            const std::string &array = instr.result.value();
+            if (sizes.contains(array) || instr.element != ElementType::int64 || !is_num(instr.arg1.value()) ||
+                std::stoll(instr.arg1.value()) <= 0 || std::stoll(instr.arg1.value()) > max_replaced_array_size) {
+                rejected.insert(array);
+            }
+            sizes[array] = is_num(instr.arg1.value()) ? std::stoll(instr.arg1.value()) : 0;
+        }
+
+        const auto in_range = [&sizes](const std::string &array, const std::optional<std::string> &index) {
+            return is_num(index.value()) && std::stoll(index.value()) >= 0 &&
+                   std::stoll(index.value()) < sizes.at(array);
+        };
+
+        for (const TACInstruction &instr: instructions) {
+            std::optional<std::string> array;
+            switch (instr.op) {
+                case OperationType::array_allocate:
+                    continue;
+                case OperationType::array_get:
+                    if (sizes.contains(instr.arg1.value()) && in_range(instr.arg1.value(), instr.arg2)) {
+                        array = instr.arg1;
+                    }
+                    break;
+                case OperationType::array_assign:
+                    if (sizes.contains(instr.result.value()) && in_range(instr.result.value(), instr.arg1)) {
+                        array = instr.result;
+                    }
+                    break;
+                case OperationType::array_init:
+                    array = instr.result;
+                    break;
+                default:
+                    break;
+            }
+
+            for (const std::optional<std::string> &operand: {instr.result, instr.arg1, instr.arg2, instr.arg3}) {
+                if (operand.has_value() && operand != array && sizes.contains(operand.value())) {
+                    rejected.insert(operand.value());
+                }
+            }
+        }
+
+        const auto element = [](const std::string &array, const std::string &index) {
+            return array + "[" + index + "]";
+        };
+
+        std::vector<TACInstruction> result;
+        for (size_t i = 0; i < instructions.size(); i++) {
+            const TACInstruction &instr = instructions[i];
+            const std::optional<std::string> &array = instr.op == OperationType::array_get ? instr.arg1 : instr.result;
+            if (!array.has_value() || !sizes.contains(array.value()) || rejected.contains(array.value())) {
+                result.push_back(instr);
+                continue;
+            }
+
+            switch (instr.op) {
+                case OperationType::array_allocate: {
+                    //Elements given in the declaration don't have to be cleared first
+                    long long index = 0;
+                    if (i + 1 < instructions.size() && instructions[i + 1].op == OperationType::array_init &&
+                        instructions[i + 1].result == array) {
+                        index = std::stoll(instructions[i + 1].arg1.value());
+                    }
+                    for (; index < sizes.at(array.value()); index++) {
+                        result.push_back({OperationType::assign, element(array.value(), std::to_string(index)), "0"});
+                    }
+                    break;
+                }
+                case OperationType::array_get:
+                    result.push_back({OperationType::assign, instr.result, element(array.value(), instr.arg2.value())});
+                    break;
+                case OperationType::array_assign:
+                    result.push_back({OperationType::assign, element(array.value(), instr.arg1.value()), instr.arg2});
+                    break;
+                case OperationType::array_init:
+                    for (size_t index = 0; i + 1 < instructions.size() &&
+                                           instructions[i + 1].op == OperationType::data_entry; index++) {
+                        result.push_back({OperationType::assign, element(array.value(), std::to_string(index)),
+                                          instructions[++i].arg1});
+                    }
+                    break;
+                default:
+                    result.push_back(instr);
+            }
+        }
+
+        instructions = result;
+    }
+
+    /*
+     * An array initialized with literals and never written afterwards doesn't need any memory of its own, it can point
+     * straight at its read-only data:
+     *
+     *  t = alloc 3; t = array_init 3; data ...   =>   t = array_constant 3; data ...
+     */
+    void use_constant_arrays() {
+        std::vector<TACInstruction> result;
+
+        for (size_t i = 0; i < instructions.size(); i++) {
+            const TACInstruction &instr = instructions[i];
+            const TACInstruction *init = i + 1 < instructions.size() ? &instructions[i + 1] : nullptr;
+            if (instr.op != OperationType::array_allocate || init == nullptr ||
+                init->op != OperationType::array_init || init->result != instr.result || init->arg1 != instr.arg1 ||
+                !is_private(instr.result.value(), i + 2, false)) {
+                result.push_back(instr);
+                continue;
+            }
+
+            TACInstruction constant = *init;
+            constant.op = OperationType::array_constant;
+            result.push_back(constant);
+            i++;
+        }
+
+        instructions = result;
+    }
+
+    /*
+     * Arrays of a constant size don't need the heap, which costs a brk syscall at the declaration and another one at
+     * the end of the scope. Small ones go into the stack frame, the space of a scope reused by the next one once it
+     * ends, and large ones declared outside of any scope into .bss:
+     *
+     *  t = alloc 100   =>   t = stack_alloc 100
+     *
+     * Arrays with an escaping address stay on the heap, so that a declaration run again, in a loop without a scope of
+     * its own, still gets new memory.
+     */
+    void place_fixed_arrays() {
+        std::vector<long long> scope_bytes = {0};
+        long long stack_bytes = 0;
+
+        for (size_t i = 0; i < instructions.size(); i++) {
+            TACInstruction &instr = instructions[i];
+
+            if (instr.op == OperationType::bgn_scope) {
+                scope_bytes.push_back(0);
+                continue;
+            }
+            if (instr.op == OperationType::end_scope) {
+                stack_bytes -= scope_bytes.back();
+                scope_bytes.pop_back();
+                continue;
+            }
+            if (instr.op != OperationType::array_allocate || !is_num(instr.arg1.value()) ||
+                std::stoll(instr.arg1.value()) < 0 || !is_private(instr.result.value(), i + 1, true)) {
+                continue;
+            }
+
+            const long long bytes = array_bytes(instr.element, std::stoll(instr.arg1.value()));
+            if (bytes <= max_stack_array_bytes && stack_bytes + bytes <= max_stack_bytes) {
+                instr.op = OperationType::array_stack;
+                stack_bytes += bytes;
+                scope_bytes.back() += bytes;
+            } else if (scope_bytes.size() == 1) {
+                instr.op = OperationType::array_static;
+            }
+        }
+    }
+
+    /*
+     * Whether the address of the array can't escape before the end of the scope declaring it, so that only the array
+     * instructions naming it access its elements. Unless it's writable, none of them may write the elements either.
+     */
+    [[nodiscard]] bool is_private(const std::string &array, const size_t from, const bool writable) const {
+        int depth = 0;
+        for (size_t i = from; i < instructions.size() && depth >= 0; i++) {
+            const TACInstruction &instr = instructions[i];
+
+            switch (instr.op) {
+                case OperationType::bgn_scope:
+                    depth++;
+                    continue;
+                case OperationType::end_scope:
+                    depth--;
+                    continue;
+                case OperationType::array_get:
+                    if (instr.arg2 == array) return false;
+                    continue;
+                case OperationType::print_array:
+                    if (instr.arg1 == array || instr.arg2 == array) return false;
+                    continue;
+                case OperationType::array_assign:
+                case OperationType::array_fill:
+                case OperationType::array_copy:
+                case OperationType::array_init:
+                    if (instr.result == array && !writable) return false;
+                    //The source of a copy is only read
+                    if (instr.arg1 == array || instr.arg2 == array ||
+                        (instr.op != OperationType::array_copy && instr.arg3 == array)) {
+                        return false;
+                    }
+                    continue;
+                default:
+                    break;
+            }
+
+            //Any other use of the address could be an alias written through
+            const std::vector<std::string> uses = get_uses(instr);
+            if (get_def(instr) == array || std::ranges::find(uses, array) != uses.end()) return false;
+        }
+
+        return true;
+    }
+
+    /*
+     * Replaces counted loops that fill an array with a loop-invariant value, copy one array into another or print
+     * every element with a single call to a runtime routine covering the whole index range.
+     */
+    void recognize_loop_idioms() {
+        const std::set<std::string> arrays = private_arrays();
+        std::vector<TACInstruction> result;
+
+        for (size_t i = 0; i < instructions.size(); i++) {
+            const std::optional<CountedLoop> loop = match_counted_loop(instructions, i);
+            if (!loop.has_value()) {
+                result.push_back(instructions[i]);
+                continue;
+            }
+
+            std::optional<TACInstruction> idiom = match_idiom(loop.value(), arrays);
+            if (!idiom.has_value()) {
+                result.push_back(instructions[i]);
+                continue;
+            }
+
+            //Keep the header and guard, so the counter still ends up untouched when the loop doesn't run
+            result.insert(result.end(), instructions.begin() + i, instructions.begin() + i + 3);
+
+            const std::string count_end = loop_end_value(loop.value(), result);
+            std::string count = new_temp_var();
+            result.push_back({OperationType::subtract, count, count_end, loop->counter});
+
+            idiom->arg2 = count;
+            result.push_back(idiom.value());
+
+            const std::string end = loop_end_value(loop.value(), result);
+            result.push_back({OperationType::assign, loop->counter, end});
+            result.push_back(instructions[loop->end]);
+
+            i = loop->end;
+        }
+
+        instructions = result;
+    }
+
+    /*
+     * Returns the range operation equivalent to the loop body, with the element count left to be filled in. Packed
+     * bits don't start at byte boundaries, so they are left to the loop. Elements are only copied between arrays of
+     * the same type, and only printed when they're qwords or already single bytes. Fills and copies have to go
+     * through private arrays, a copy between overlapping ranges would see the elements it already stored.
+     */
+    static std::optional<TACInstruction> match_idiom(const CountedLoop &loop, const std::set<std::string> &arrays) {
+        const std::vector<TACInstruction> &body = loop.body;
+        const std::string &counter = loop.counter;
+
+        if (body.size() == 1 && body[0].op == OperationType::array_assign && body[0].arg1 == counter &&
+            is_var(body[0].result.value()) && !is_temp(body[0].arg2.value()) && body[0].arg2 != counter &&
+            body[0].element != ElementType::boolean && arrays.contains(body[0].result.value())) {
+            return TACInstruction{OperationType::array_fill, body[0].result, counter, {}, body[0].arg2,
+                                  body[0].element};
+        }
+
+        if (body.size() != 2 || body[0].op != OperationType::array_get || body[0].arg2 != counter ||
+            body[0].element == ElementType::boolean) {
+            return {};
+        }
+
+        const TACInstruction &get = body[0];
+        const TACInstruction &use = body[1];
+
+        if (use.op == OperationType::array_assign && use.arg1 == counter && use.arg2 == get.result &&
+            use.element == get.element && arrays.contains(use.result.value()) && arrays.contains(get.arg1.value())) {
+            return TACInstruction{OperationType::array_copy, use.result, counter, {}, get.arg1, get.element};
+        }
+        if (use.op == OperationType::print_char && use.arg1 == get.result &&
+            (get.element == ElementType::int64 || element_bits(get.element) == 8)) {
+            return TACInstruction{OperationType::print_array, {}, counter, {}, get.arg1, get.element};
+        }
+
+        return {};
+    }
+};
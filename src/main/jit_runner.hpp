@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <csetjmp>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+#include "peephole_optimizer.hpp"
+#include "x86_encoder.hpp"
+
+/*
+ * Runs the program inside the compiler process. The machine code is loaded into memory mapped below 2 GB and called
+ * directly. Every syscall becomes a call to a trampoline, which keeps the registers a syscall keeps and calls
+ * syscall_helper. That way the program doesn't touch the compiler's program break and can't exit the process while
+ * the compiler still has work to do.
+ */
+class JITRunner {
+public:
+    explicit JITRunner(const std::vector<AsmInstruction> &program) {
+        for (const AsmInstruction &instr: program) {
+            if (instr.kind == AsmInstruction::Kind::instruction && instr.opcode == "syscall") {
+                instructions.push_back({AsmInstruction::Kind::instruction, "call", {"_jit_syscall"}});
+            } else {
+                instructions.push_back(instr);
+            }
+        }
+
+        const std::vector<AsmInstruction> trampoline = parse_asm(trampoline_source());
+        instructions.insert(instructions.end(), trampoline.begin(), trampoline.end());
+    }
+
+    JITRunner(const JITRunner &) = delete;
+    JITRunner &operator=(const JITRunner &) = delete;
+
+    ~JITRunner() {
+        if (code != nullptr) munmap(code, code_size);
+        if (heap != nullptr) munmap(heap, heap_size);
+    }
+
+    //Encodes the program and maps it into memory, ready to be run
+    void load() {
+        X86Encoder encoder(instructions);
+        object = encoder.encode();
+
+        std::map<Section, uint64_t> offsets;
+        offsets[Section::text] = 0;
+        offsets[Section::rodata] = align(object.size(Section::text), 16);
+        offsets[Section::data] = align(offsets[Section::rodata] + object.size(Section::rodata), page_size);
+        offsets[Section::bss] = align(offsets[Section::data] + object.size(Section::data), 16);
+        code_size = align(offsets[Section::bss] + object.size(Section::bss), page_size);
+
+        code = mmap(nullptr, code_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+        if (code == MAP_FAILED) {
+            code = nullptr;
+            error("Nie udało się zarezerwować pamięci na kod maszynowy");
+        }
+
+        for (const auto &[section, offset]: offsets) {
+            addresses[section] = reinterpret_cast<uint64_t>(code) + offset;
+        }
+        object.relocate(addresses);
+
+        for (const Section section: {Section::text, Section::rodata, Section::data}) {
+            if (object.size(section) == 0) continue;
+            memcpy(static_cast<uint8_t *>(code) + offsets.at(section), object.contents.at(section).data(),
+                   object.size(section));
+        }
+
+        if (mprotect(code, offsets.at(Section::data), PROT_READ | PROT_EXEC) != 0) {
+            error("Nie udało się oznaczyć kodu maszynowego jako wykonywalnego");
+        }
+
+        write_perf_map(object, addresses.at(Section::text));
+    }
+
+    //Address of a symbol of the loaded code
+    [[nodiscard]] void *get_symbol(const std::string &symbol) const {
+        return reinterpret_cast<void *>(object.symbol_address(symbol, addresses));
+    }
+
+    //Runs the loaded program and returns its exit code
+    [[nodiscard]] int run() {
+        heap = mmap(nullptr, heap_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (heap == MAP_FAILED) {
+            heap = nullptr;
+            error("Nie udało się zarezerwować pamięci na sterty programu");
+        }
+
+        return run("_start", nullptr, heap, heap_size, heap);
+    }
+
+    /*
+     * Runs the loaded code from the given symbol, with rdi pointing to the given state, on a heap reserved by the
+     * caller, with its top at the given address. Returns the exit code of the program.
+     */
+    [[nodiscard]] int run(const std::string &symbol, const void *state, void *heap_start, const uint64_t size,
+                          void *heap_top) {
+        heap_begin = reinterpret_cast<uint64_t>(heap_start);
+        heap_end = heap_begin + size;
+        heap_break = reinterpret_cast<uint64_t>(heap_top);
+
+        //The program never returns, the exit syscall jumps back here
+        if (setjmp(exit_point) == 0) {
+            reinterpret_cast<void (*)(const void *)>(get_symbol(symbol))(state);
+        }
+
+        return exit_code;
+    }
+
+private:
+    std::vector<AsmInstruction> instructions;
+
+    static constexpr uint64_t page_size = 0x1000;
+    static constexpr uint64_t heap_size = 1ull << 36;
+
+    ObjectCode object;
+    std::map<Section, uint64_t> addresses;
+    void *code = nullptr;
+    uint64_t code_size = 0;
+    void *heap = nullptr;
+
+    static inline std::jmp_buf exit_point;
+    static inline int exit_code = 0;
+    static inline uint64_t heap_begin = 0;
+    static inline uint64_t heap_break = 0;
+    static inline uint64_t heap_end = 0;
+
+    [[noreturn]] static void error(const std::string &message) {
+        std::cerr << "[BŁĄD] [JIT] " << message << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    static uint64_t align(const uint64_t value, const uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    //Does what the syscalls the generated code and the runtime use would, returning like the kernel does
+    static int64_t syscall_helper(const int64_t number, const int64_t arg1, const int64_t arg2, const int64_t arg3) {
+        switch (number) {
+            case 0: {
+                const ssize_t result = read(static_cast<int>(arg1), reinterpret_cast<void *>(arg2), arg3);
+                return result < 0 ? -errno : result;
+            }
+            case 1: {
+                const ssize_t result = write(static_cast<int>(arg1), reinterpret_cast<const void *>(arg2), arg3);
+                return result < 0 ? -errno : result;
+            }
+            case 12:
+                //The program break moves within the reserved heap
+                if (static_cast<uint64_t>(arg1) >= heap_begin && static_cast<uint64_t>(arg1) <= heap_end) {
+                    heap_break = arg1;
+                }
+                return static_cast<int64_t>(heap_break);
+            case 9:
+                //The runtime only maps the heap, which is reserved already
+                if (static_cast<uint64_t>(arg1) >= heap_begin && static_cast<uint64_t>(arg1 + arg2) <= heap_end) {
+                    return arg1;
+                }
+                return -ENOMEM;
+            case 28:
+                if (static_cast<uint64_t>(arg1) < heap_begin || static_cast<uint64_t>(arg1 + arg2) > heap_end) {
+                    return -EINVAL;
+                }
+                return madvise(reinterpret_cast<void *>(arg1), arg2, static_cast<int>(arg3)) < 0 ? -errno : 0;
+            case 60:
+                exit_code = static_cast<int>(arg1 & 0xFF);
+                std::longjmp(exit_point, 1);
+            default:
+                return -ENOSYS;
+        }
+    }
+
+    static std::string trampoline_source() {
+        return R"(
+section .text
+_jit_syscall:                   ; rax - number, rdi, rsi, rdx - arguments
+    push rbx                    ; keep everything a syscall would
+    push rdx
+    push rsi
+    push rdi
+    push r8
+    push r9
+    push r10
+    mov rbx, rsp                ; the stack has to be aligned for the call
+    and rsp, -16
+    mov rcx, rdx
+    mov rdx, rsi
+    mov rsi, rdi
+    mov rdi, rax
+    mov r11, )" + std::to_string(reinterpret_cast<uint64_t>(&syscall_helper)) + R"(
+    call r11
+    mov rsp, rbx
+    pop r10
+    pop r9
+    pop r8
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rbx
+    ret
+)";
+    }
+
+    //Lets perf name the functions and labels of the loaded code
+    static void write_perf_map(const ObjectCode &object, const uint64_t text_address) {
+        std::vector<std::pair<size_t, std::string>> labels;
+        for (const auto &[symbol, location]: object.symbols) {
+            if (location.first == Section::text) labels.emplace_back(location.second, symbol);
+        }
+        std::ranges::sort(labels);
+
+        std::ofstream map("/tmp/perf-" + std::to_string(getpid()) + ".map", std::ios::trunc);
+        for (size_t i = 0; i < labels.size(); i++) {
+            const size_t end = i + 1 < labels.size() ? labels[i + 1].first : object.size(Section::text);
+            if (end == labels[i].first) continue;
+
+            map << std::hex << text_address + labels[i].first << " " << end - labels[i].first << " "
+                << labels[i].second << std::endl;
+        }
+    }
+};
@@ -5,9 +5,19 @@
 #include <string>
 
 #include "asm_generator.hpp"
+#include "baseline_generator.hpp"
+#include "bytecode_vm.hpp"
+#include "c_generator.hpp"
+#include "elf_writer.hpp"
 #include "ir_generator.hpp"
+#include "ir_optimizer.hpp"
+#include "jit_runner.hpp"
 #include "parser.hpp"
+#include "peephole_optimizer.hpp"
+#include "runtime.hpp"
+#include "tiered_runner.hpp"
 #include "tokenizer.hpp"
+#include "x86_encoder.hpp"
 
 using namespace std;
 
@@ -28,17 +38,149 @@ void write_file(const string &filename, const string &contents) {
     asm_file.close();
 }
 
+vector<TACInstruction> generate_ir(const NodeStart &tree, const string &filename, const bool bounds_check) {
+    //Generate intermediate code, while performing semantic analysis
+    auto ir_gen_start = chrono::high_resolution_clock::now();
+
+    IRGenerator ir_generator(tree, bounds_check);
+    vector<TACInstruction> instructions = ir_generator.generate_program();
+
+    auto ir_gen_end = chrono::high_resolution_clock::now();
+    auto ir_gen_time = chrono::duration_cast<chrono::microseconds>(ir_gen_end - ir_gen_start);
+    cout << "   [SUKCES] Pomyślnie wygenerowano pośrednią reprezentację kodu!  [" << ir_gen_time.count() << " μs]" <<
+         endl;
+
+
+    //Optimize intermediate code
+    auto ir_opt_start = chrono::high_resolution_clock::now();
+
+    IROptimizer ir_optimizer(instructions);
+    instructions = ir_optimizer.optimize();
+
+    auto ir_opt_end = chrono::high_resolution_clock::now();
+    auto ir_opt_time = chrono::duration_cast<chrono::microseconds>(ir_opt_end - ir_opt_start);
+    cout << "   [SUKCES] Pomyślnie zoptymalizowano pośrednią reprezentację kodu!  [" << ir_opt_time.count() << " μs]" <<
+         endl;
+
+
+    write_file(filename + ".ppprw", IRGenerator::ir_to_string(instructions));
+
+    return instructions;
+}
+
+vector<AsmInstruction> generate_optimized(const NodeStart &tree, const string &filename, const VectorISA vector_isa,
+                                          const bool bounds_check) {
+    vector<TACInstruction> instructions = generate_ir(tree, filename, bounds_check);
+
+    //Generate assembly code
+    auto asm_gen_start = chrono::high_resolution_clock::now();
+
+    ASMGenerator asm_generator(instructions, vector_isa);
+    vector<AsmInstruction> asm_code = asm_generator.generate_program();
+
+    auto asm_gen_end = chrono::high_resolution_clock::now();
+    auto asm_gen_time = chrono::duration_cast<chrono::microseconds>(asm_gen_end - asm_gen_start);
+    cout << "   [SUKCES] Pomyślnie wygenerowano kod assembly!  [" << asm_gen_time.count() << " μs]" << endl;
+
+    return asm_code;
+}
+
+//Translates the program into C and builds it with the system C compiler
+void compile_with_c(const NodeStart &tree, const string &filename, const string &optimization_level,
+                    const bool bounds_check) {
+    const vector<TACInstruction> instructions = generate_ir(tree, filename, bounds_check);
+
+    auto c_gen_start = chrono::high_resolution_clock::now();
+
+    CGenerator c_generator(instructions);
+    write_file(filename + ".c", c_generator.generate_program());
+
+    auto c_gen_end = chrono::high_resolution_clock::now();
+    auto c_gen_time = chrono::duration_cast<chrono::microseconds>(c_gen_end - c_gen_start);
+    cout << "   [SUKCES] Pomyślnie wygenerowano kod C!  [" << c_gen_time.count() << " μs]" << endl;
+
+    string cmd = "cc " + optimization_level + " " + filename + ".c -o " + filename;
+    if (int code = system(cmd.c_str()); code != 0) {
+        exit(code);
+    }
+}
+
 int main(const int argc, char *argv[]) {
-    if (argc != 2) {
-        std::cerr << "[BŁĄD] Nieprawidłowe użycie! Wpisz: pppjp <plik.pppp>" << endl;
+    string source_file;
+    VectorISA vector_isa = VectorISA::sse2;
+    bool optimize = true;
+    string optimization_level = "-O1";
+    bool c_backend = false;
+    bool emit_asm = false;
+    bool run = false;
+    bool interpret = false;
+    bool tiered = false;
+    bool bounds_check = false;
+
+    for (int i = 1; i < argc; i++) {
+        const string arg = argv[i];
+
+        if (arg == "-O0" || arg == "-O1" || arg == "-O2" || arg == "-O3") {
+            //The native backend has a single optimization level, the higher ones are for the C compiler
+            optimize = arg != "-O0";
+            optimization_level = arg;
+        } else if (arg == "--backend=native") {
+            c_backend = false;
+        } else if (arg == "--backend=c") {
+            c_backend = true;
+        } else if (arg == "-march=sse2") {
+            vector_isa = VectorISA::sse2;
+        } else if (arg == "-march=avx2") {
+            vector_isa = VectorISA::avx2;
+        } else if (arg == "--emit-asm") {
+            emit_asm = true;
+        } else if (arg == "--run") {
+            run = true;
+        } else if (arg == "--interpret") {
+            interpret = true;
+        } else if (arg == "--tiered") {
+            tiered = true;
+        } else if (arg == "--bounds-check") {
+            bounds_check = true;
+        } else if (arg.starts_with("-")) {
+            std::cerr << "[BŁĄD] Nieznana opcja '" << arg << "'" << endl;
+            return 1;
+        } else if (source_file.empty()) {
+            source_file = arg;
+        } else {
+            source_file.clear();
+            break;
+        }
+    }
+
+    if (source_file.empty()) {
+        std::cerr << "[BŁĄD] Nieprawidłowe użycie! Wpisz: pppjp [-O0/-O1/-O2/-O3] [--backend=native/c] [-march=sse2/avx2] [--emit-asm] [--run] [--interpret] [--tiered] [--bounds-check] <plik.pppp>" << endl;
+        return 1;
+    }
+
+    //Programs built by the C compiler are only ever written to disk
+    if (run && c_backend) {
+        std::cerr << "[BŁĄD] Opcji '--run' nie można użyć z '--backend=c'" << endl;
+        return 1;
+    }
+
+    //The interpreter runs the optimized intermediate code, without any backend
+    if (interpret && (!optimize || c_backend || run)) {
+        std::cerr << "[BŁĄD] Opcji '--interpret' nie można użyć z '-O0', '--backend=c' ani '--run'" << endl;
         return 1;
     }
 
-    const string content = read_file(argv[1]);
-    string filename = argv[1];
+    //Tiered execution starts in the interpreter and moves hot loops to the optimized native code
+    if (tiered && (!optimize || c_backend || run || interpret)) {
+        std::cerr << "[BŁĄD] Opcji '--tiered' nie można użyć z '-O0', '--backend=c', '--run' ani '--interpret'" << endl;
+        return 1;
+    }
+
+    const string content = read_file(source_file);
+    string filename = source_file;
     filename = filename.substr(0, filename.find_last_of('.'));
 
-    cout << "[INFO] Rozpoczęto proces kompilacji pliku '" << argv[1] << "'..." << endl;
+    cout << "[INFO] Rozpoczęto proces kompilacji pliku '" << source_file << "'..." << endl;
 
     //Tokenize
     auto tokenization_start = chrono::high_resolution_clock::now();
@@ -62,38 +204,107 @@ int main(const int argc, char *argv[]) {
     cout << "   [SUKCES] Pomyślnie utworzono drzewo parsowania!  [" << parsing_time.count() << " μs]" << endl;
 
 
-    //Generate intermediate code, while performing semantic analysis
-    auto ir_gen_start = chrono::high_resolution_clock::now();
+    if (tiered) {
+        const vector<TACInstruction> instructions = generate_ir(tree.value(), filename, bounds_check);
 
-    IRGenerator ir_generator((tree.value()));
-    vector<TACInstruction> instructions = ir_generator.generate_program();
+        cout << "[INFO] Uruchamianie programu '" << filename << "'..." << endl;
+        TieredRunner tiered_runner(instructions, vector_isa);
+        return tiered_runner.run();
+    }
 
-    auto ir_gen_end = chrono::high_resolution_clock::now();
-    auto ir_gen_time = chrono::duration_cast<chrono::microseconds>(ir_gen_end - ir_gen_start);
-    cout << "   [SUKCES] Pomyślnie wygenerowano pośrednią reprezentację kodu!  [" << ir_gen_time.count() << " μs]" <<
-         endl;
+    if (interpret) {
+        const vector<TACInstruction> instructions = generate_ir(tree.value(), filename, bounds_check);
 
+        //Compile the intermediate code into bytecode, to be run without any toolchain
+        auto bytecode_start = chrono::high_resolution_clock::now();
 
-    write_file(filename + ".ppprw", ir_generator.ir_to_string());
+        BytecodeVM bytecode_vm(instructions);
+        bytecode_vm.compile();
 
+        auto bytecode_end = chrono::high_resolution_clock::now();
+        auto bytecode_time = chrono::duration_cast<chrono::microseconds>(bytecode_end - bytecode_start);
+        cout << "   [SUKCES] Pomyślnie wygenerowano kod bajtowy!  [" << bytecode_time.count() << " μs]" << endl;
 
-    //Generate assembly code
-    auto asm_gen_start = chrono::high_resolution_clock::now();
+        cout << "[INFO] Uruchamianie programu '" << filename << "'..." << endl;
+        return bytecode_vm.run();
+    }
 
-    ASMGenerator asm_generator(instructions);
-    string asm_code = asm_generator.generate_program();
+    if (c_backend) {
+        compile_with_c(tree.value(), filename, optimization_level, bounds_check);
+        cout << "[SUKCES] Pomyślnie skompilowano plik '" << filename << "'!" << endl;
+        return 0;
+    }
 
-    auto asm_gen_end = chrono::high_resolution_clock::now();
-    auto asm_gen_time = chrono::duration_cast<chrono::microseconds>(asm_gen_end - asm_gen_start);
-    cout << "   [SUKCES] Pomyślnie wygenerowano kod assembly!  [" << asm_gen_time.count() << " μs]" << endl;
+    vector<AsmInstruction> asm_code;
+    if (optimize) {
+        asm_code = generate_optimized(tree.value(), filename, vector_isa, bounds_check);
+    } else {
+        //Generate assembly code straight from the parse tree, while performing semantic analysis
+        auto asm_gen_start = chrono::high_resolution_clock::now();
 
-    write_file(filename + ".asm", asm_code);
+        BaselineGenerator baseline_generator(tree.value(), bounds_check);
+        asm_code = baseline_generator.generate_program();
 
-    string cmd = "nasm -felf64 " + filename + ".asm && ld " + filename + ".o -o " + filename;
-    if (int code = system(cmd.c_str()); code != 0) {
-        exit(code);
+        auto asm_gen_end = chrono::high_resolution_clock::now();
+        auto asm_gen_time = chrono::duration_cast<chrono::microseconds>(asm_gen_end - asm_gen_start);
+        cout << "   [SUKCES] Pomyślnie wygenerowano kod assembly!  [" << asm_gen_time.count() << " μs]" << endl;
+    }
+
+
+    //Clean up the emitted instructions, at every optimization level
+    auto peephole_start = chrono::high_resolution_clock::now();
+
+    PeepholeOptimizer peephole_optimizer(asm_code);
+    asm_code = peephole_optimizer.optimize();
+
+    auto peephole_end = chrono::high_resolution_clock::now();
+    auto peephole_time = chrono::duration_cast<chrono::microseconds>(peephole_end - peephole_start);
+    cout << "   [SUKCES] Pomyślnie zoptymalizowano kod assembly!  [" << peephole_time.count() << " μs]" << endl;
+    for (const auto &[rule, hits]: peephole_optimizer.get_hits()) {
+        if (hits > 0) {
+            cout << "      [INFO] Reguła '" << rule << "' zastosowana " << hits << " razy" << endl;
+        }
+    }
+
+    const vector<AsmInstruction> runtime = runtime_program();
+    asm_code.insert(asm_code.end(), runtime.begin(), runtime.end());
+
+    if (emit_asm) {
+        write_file(filename + ".asm", asm_to_string(asm_code));
     }
 
+
+    if (run) {
+        //Encode the machine code and load it into the memory of the compiler
+        auto loading_start = chrono::high_resolution_clock::now();
+
+        JITRunner jit_runner(asm_code);
+        jit_runner.load();
+
+        auto loading_end = chrono::high_resolution_clock::now();
+        auto loading_time = chrono::duration_cast<chrono::microseconds>(loading_end - loading_start);
+        cout << "   [SUKCES] Pomyślnie zasemblowano i załadowano kod maszynowy!  [" << loading_time.count() << " μs]"
+             << endl;
+
+        cout << "[INFO] Uruchamianie programu '" << filename << "'..." << endl;
+        return jit_runner.run();
+    }
+
+
+    //Encode the machine code and write the executable
+    auto assembly_start = chrono::high_resolution_clock::now();
+
+    X86Encoder encoder(asm_code);
+    ObjectCode object = encoder.encode();
+
+    ELFWriter elf_writer(object);
+    elf_writer.write(filename);
+
+    auto assembly_end = chrono::high_resolution_clock::now();
+    auto assembly_time = chrono::duration_cast<chrono::microseconds>(assembly_end - assembly_start);
+    cout << "   [SUKCES] Pomyślnie zasemblowano i skonsolidowano kod maszynowy!  [" << assembly_time.count() << " μs]"
+         << endl;
+
     cout << "[SUKCES] Pomyślnie skompilowano plik '" << filename << "'!" << endl;
 
 
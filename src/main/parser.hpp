@@ -40,9 +40,10 @@ struct NodeTermParen {
     NodeExpr *expr;
 };
 
+//One index per dimension of the array
 struct NodeTermArrIdent {
     Token ident;
-    NodeExpr *index{};
+    std::vector<NodeExpr *> indexes;
 };
 
 struct NodeTermReadChar {
@@ -77,12 +78,14 @@ struct NodeStmtVariable {
     Token ident;
     TokenType type{};
     NodeExpr *expr{};
+    //Known at compile time and never assigned again
+    bool constant = false;
 };
 
 struct NodeStmtArray {
     Token ident;
     TokenType type{};
-    NodeExpr *size{};
+    std::vector<NodeExpr *> sizes;
     std::optional<NodeTermArray *> contents;
 };
 
@@ -110,6 +113,14 @@ struct NodeStmtWhile {
     NodeStatement *stmt{};
 };
 
+struct NodeStmtFor {
+    Token ident;
+    NodeExpr *from{};
+    NodeExpr *to{};
+    std::optional<NodeExpr *> step;
+    NodeStatement *stmt{};
+};
+
 struct NodeStmtBreak {
     Token token;
 };
@@ -125,7 +136,7 @@ struct NodeStmtAssign {
 
 struct NodeStmtArrAssign {
     Token ident;
-    NodeExpr *index{};
+    std::vector<NodeExpr *> indexes;
     NodeExpr *expr{};
 };
 
@@ -137,10 +148,14 @@ struct NodeStmtPrintChar {
     NodeExpr *expr;
 };
 
+struct NodeStmtPrintString {
+    NodeTermStringLit *text;
+};
+
 struct NodeStatement {
     std::variant<NodeStmtExit *, NodeStmtVariable *, NodeStmtScope *, NodeStmtIf *, NodeStmtAssign *, NodeStmtWhile *,
-            NodeStmtBreak *, NodeStmtContinue *, NodeStmtPrintInt *, NodeStmtPrintChar *, NodeStmtArray *, NodeStmtArrAssign
-            *> var;
+            NodeStmtFor *, NodeStmtBreak *, NodeStmtContinue *, NodeStmtPrintInt *, NodeStmtPrintChar *,
+            NodeStmtPrintString *, NodeStmtArray *, NodeStmtArrAssign *> var;
 };
 
 struct NodeStart {
@@ -282,10 +297,9 @@ public:
                 next_token({TokenType::backtick}, true);
 
                 if (next_token({TokenType::element}, false)) {
-                    NodeExpr *index = parse_expr();
                     auto *term_arr_ident = allocator.alloc<NodeTermArrIdent>();
                     term_arr_ident->ident = ident;
-                    term_arr_ident->index = index;
+                    term_arr_ident->indexes = parse_dimensions();
                     term->var = term_arr_ident;
                 } else {
                     auto *term_ident = allocator.alloc<NodeTermIdent>();
@@ -324,30 +338,7 @@ public:
                 break;
             }
             case TokenType::double_quote: {
-                next_token({TokenType::string_lit}, true);
-
-                std::string string_lit = it->value.value();
-
-                auto *term_string_lit = allocator.alloc<NodeTermStringLit>();
-                auto *array_expr = allocator.alloc<NodeTermArray>();
-
-                array_expr->token = *it;
-                for (const char c: string_lit) {
-                    auto *expr_char = allocator.alloc<NodeExpr>();
-                    auto *term_char = allocator.alloc<NodeTerm>();
-                    auto *term_char_lit = allocator.alloc<NodeTermCharLit>();
-
-                    term_char_lit->char_lit = Token{TokenType::character, std::to_string(c), it->line};
-                    term_char->var = term_char_lit;
-                    expr_char->var = term_char;
-                    array_expr->exprs.push_back(expr_char);
-                }
-
-                term_string_lit->array_expr = array_expr;
-
-                next_token({TokenType::double_quote}, true);
-
-                term->var = term_string_lit;
+                term->var = parse_string();
                 break;
             }
             case TokenType::read_char: {
@@ -368,6 +359,32 @@ public:
         return term;
     }
 
+    //The characters of the text become the elements of an array
+    NodeTermStringLit *parse_string() {
+        next_token({TokenType::string_lit}, true);
+
+        auto *term_string_lit = allocator.alloc<NodeTermStringLit>();
+        auto *array_expr = allocator.alloc<NodeTermArray>();
+
+        array_expr->token = *it;
+        for (const char c: it->value.value()) {
+            auto *expr_char = allocator.alloc<NodeExpr>();
+            auto *term_char = allocator.alloc<NodeTerm>();
+            auto *term_char_lit = allocator.alloc<NodeTermCharLit>();
+
+            term_char_lit->char_lit = Token{TokenType::character, std::string(1, c), it->line};
+            term_char->var = term_char_lit;
+            expr_char->var = term_char;
+            array_expr->exprs.push_back(expr_char);
+        }
+
+        term_string_lit->array_expr = array_expr;
+
+        next_token({TokenType::double_quote}, true);
+
+        return term_string_lit;
+    }
+
     NodeTermArray *parse_array_expr() {
         next_token({TokenType::cur_brkt_open}, true);
 
@@ -433,7 +450,9 @@ public:
                 node_statement->var = node_stmt_exit;
                 break;
             }
-            case TokenType::var_decl: {
+            case TokenType::var_decl:
+            case TokenType::const_decl: {
+                const bool constant = it->type == TokenType::const_decl;
                 next_token(var_types, true);
                 const Token var_type = *it;
 
@@ -450,6 +469,7 @@ public:
                 node_stmt_variable->ident = ident;
                 node_stmt_variable->type = var_type.type;
                 node_stmt_variable->expr = expr;
+                node_stmt_variable->constant = constant;
 
                 node_statement->var = node_stmt_variable;
                 break;
@@ -504,14 +524,14 @@ public:
 
                     node_statement->var = stmt_assign;
                 } else {
-                    NodeExpr *index = parse_expr();
+                    std::vector<NodeExpr *> indexes = parse_dimensions();
                     next_token({TokenType::var_assign}, true);
 
                     NodeExpr *value = parse_expr();
 
                     auto *stmt_arr_assign = allocator.alloc<NodeStmtArrAssign>();
                     stmt_arr_assign->ident = ident;
-                    stmt_arr_assign->index = index;
+                    stmt_arr_assign->indexes = indexes;
                     stmt_arr_assign->expr = value;
 
                     node_statement->var = stmt_arr_assign;
@@ -538,6 +558,30 @@ public:
                 node_statement->var = stmt_while;
                 break;
             }
+            case TokenType::for_loop: {
+                auto *stmt_for = allocator.alloc<NodeStmtFor>();
+
+                next_token({TokenType::backtick}, true);
+                next_token({TokenType::var_ident}, true);
+                stmt_for->ident = *it;
+                next_token({TokenType::backtick}, true);
+
+                next_token({TokenType::from}, true);
+                stmt_for->from = parse_expr();
+                next_token({TokenType::to}, true);
+                stmt_for->to = parse_expr();
+
+                if (next_token({TokenType::step}, false)) {
+                    stmt_for->step = parse_expr();
+                }
+                next_token({TokenType::colon}, true);
+
+                next_token(stmt_tokens, true);
+                stmt_for->stmt = parse_statement();
+
+                node_statement->var = stmt_for;
+                break;
+            }
             case TokenType::loop_break: {
                 auto *stmt_break = allocator.alloc<NodeStmtBreak>();
                 stmt_break->token = *it;
@@ -574,8 +618,20 @@ public:
                 node_statement->var = stmt_print;
                 break;
             }
+            case TokenType::print_string: {
+                next_token({TokenType::paren_open}, true);
+                next_token({TokenType::double_quote}, true);
+
+                auto *stmt_print = allocator.alloc<NodeStmtPrintString>();
+                stmt_print->text = parse_string();
+
+                next_token({TokenType::paren_close}, true);
+
+                node_statement->var = stmt_print;
+                break;
+            }
             case TokenType::array: {
-                next_token(var_types, true);
+                next_token(array_types, true);
                 const Token var_type = *it;
 
                 next_token({TokenType::backtick}, true);
@@ -590,10 +646,19 @@ public:
                 node_stmt_arr->type = var_type.type;
 
                 if (it->type == TokenType::of_size) {
-                    NodeExpr *expr = parse_expr();
-                    node_stmt_arr->size = expr;
+                    node_stmt_arr->sizes = parse_dimensions();
                 } else {
-                    auto *array_expr = parse_array_expr();
+                    NodeTermArray *array_expr;
+                    if (next_token({TokenType::double_quote}, false)) {
+                        if (var_type.type != TokenType::var_type_char) {
+                            std::cerr << "[BŁĄD] [Analiza składniowa] Tekstem można zainicjować tylko tablicę znaków "
+                                         "\n\t w linijce: " << it->line << std::endl;
+                            exit(EXIT_FAILURE);
+                        }
+                        array_expr = parse_string()->array_expr;
+                    } else {
+                        array_expr = parse_array_expr();
+                    }
 
                     auto *size_expr = allocator.alloc<NodeExpr>();
                     auto *size_term = allocator.alloc<NodeTerm>();
@@ -602,7 +667,7 @@ public:
                     size_term->var = size_int_lit;
                     size_expr->var = size_term;
 
-                    node_stmt_arr->size = size_expr;
+                    node_stmt_arr->sizes = {size_expr};
                     node_stmt_arr->contents = array_expr;
                 }
 
@@ -635,6 +700,15 @@ private:
     std::vector<Token>::iterator it = tokens.begin();
     ArenaAllocator allocator;
 
+    //`a` na `b` na `c`, the sizes or the indexes of the dimensions of an array
+    std::vector<NodeExpr *> parse_dimensions() {
+        std::vector<NodeExpr *> dimensions = {parse_expr()};
+        while (next_token({TokenType::by}, false)) {
+            dimensions.push_back(parse_expr());
+        }
+        return dimensions;
+    }
+
     bool next_token(const std::set<TokenType> &expected, const bool required) {
         const auto next = it + 1;
 
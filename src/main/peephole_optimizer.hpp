@@ -0,0 +1,297 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct AsmInstruction {
+    enum class Kind {
+        instruction, label, directive
+    };
+
+    Kind kind;
+    //Mnemonic, label name or the whole directive line
+    std::string opcode;
+    std::vector<std::string> operands;
+};
+
+static std::string asm_to_string(const std::vector<AsmInstruction> &instructions) {
+    std::stringstream out;
+
+    for (const AsmInstruction &instr: instructions) {
+        switch (instr.kind) {
+            case AsmInstruction::Kind::instruction:
+                out << "    " << instr.opcode;
+                for (size_t i = 0; i < instr.operands.size(); i++) {
+                    out << (i == 0 ? " " : ", ") << instr.operands[i];
+                }
+                break;
+            case AsmInstruction::Kind::label:
+                out << instr.opcode << ":";
+                break;
+            case AsmInstruction::Kind::directive:
+                out << instr.opcode;
+                break;
+        }
+        out << std::endl;
+    }
+
+    return out.str();
+}
+
+//The lowest 1, 2 or 4 bytes of a 64-bit general purpose register, or the whole of it
+static std::string sub_register(const std::string &reg, const int bytes) {
+    if (bytes == 8) return reg;
+
+    //r8 to r15 take a suffix
+    if (isdigit(reg[1])) return reg + (bytes == 1 ? "b" : bytes == 2 ? "w" : "d");
+
+    const std::string name = reg.substr(1);
+    if (bytes == 4) return "e" + name;
+    if (bytes == 2) return name;
+    return name.ends_with("x") ? name.substr(0, 1) + "l" : name + "l";
+}
+
+//Size keyword of a memory operand of the given width in bytes
+static std::string memory_size(const int bytes) {
+    switch (bytes) {
+        case 1:
+            return "BYTE";
+        case 2:
+            return "WORD";
+        case 4:
+            return "DWORD";
+        default:
+            return "QWORD";
+    }
+}
+
+static AsmInstruction parse_asm_line(const std::string &line) {
+    if (line.ends_with(":")) {
+        return {AsmInstruction::Kind::label, line.substr(0, line.size() - 1)};
+    }
+    if (line.starts_with("section ") || line.starts_with("global ") || line.starts_with("%")) {
+        return {AsmInstruction::Kind::directive, line};
+    }
+
+    AsmInstruction instr{AsmInstruction::Kind::instruction, line.substr(0, line.find(' '))};
+    if (line.find(' ') == std::string::npos) return instr;
+
+    std::stringstream operands(line.substr(line.find(' ') + 1));
+    std::string operand;
+    while (std::getline(operands, operand, ',')) {
+        const size_t first = operand.find_first_not_of(' ');
+        instr.operands.push_back(operand.substr(first, operand.find_last_not_of(' ') - first + 1));
+    }
+    return instr;
+}
+
+//Reads nasm source with one instruction, label or directive per line, ignoring comments
+static std::vector<AsmInstruction> parse_asm(const std::string &source) {
+    std::vector<AsmInstruction> instructions;
+
+    std::stringstream lines(source);
+    std::string line;
+    while (std::getline(lines, line)) {
+        line = line.substr(0, line.find(';'));
+        const size_t first = line.find_first_not_of(" \t");
+        if (first == std::string::npos) continue;
+
+        instructions.push_back(parse_asm_line(line.substr(first, line.find_last_not_of(" \t") - first + 1)));
+    }
+
+    return instructions;
+}
+
+using PeepholeBindings = std::map<std::string, std::string>;
+
+/*
+ * A rewrite of a window of consecutive instructions. Patterns and replacements are written like assembly, with
+ * $names matching whole operands (or labels) and binding them, so a name used twice has to match the same text.
+ */
+struct PeepholeRule {
+    std::string name;
+    std::vector<std::string> pattern;
+    std::vector<std::string> replacement;
+    std::function<bool(const PeepholeBindings &)> condition = nullptr;
+};
+
+class PeepholeOptimizer {
+public:
+    static bool is_register(const std::string &operand) {
+        return register_families.contains(operand);
+    }
+
+    static bool is_dword_register(const std::string &operand) {
+        return is_register(operand) && sub_register(register_families.at(operand), 4) == operand;
+    }
+
+    //Whether the operand reads or names the register, or any part of it
+    static bool mentions(const std::string &operand, const std::string &reg) {
+        const std::string family = register_families.contains(reg) ? register_families.at(reg) : reg;
+
+        std::string word;
+        for (const char c: operand + " ") {
+            if (isalnum(c)) {
+                word += c;
+                continue;
+            }
+            if (!word.empty() && register_families.contains(word) && register_families.at(word) == family) {
+                return true;
+            }
+            word.clear();
+        }
+        return false;
+    }
+
+    static inline const std::vector<PeepholeRule> rules = {
+            {"push a; pop a",              {"push $a", "pop $a"},                                 {}},
+            {"push a; pop b",              {"push $a", "pop $b"},                                 {"mov $b, $a"}},
+            {"push a; mov; pop b",         {"push $a", "mov $c, $b", "pop $d"},
+                                           {"mov $d, $a", "mov $c, $b"},
+                                           [](const PeepholeBindings &b) {
+                                               return !mentions(b.at("$c"), b.at("$d")) &&
+                                                      !mentions(b.at("$b"), b.at("$d"));
+                                           }},
+            {"push a; mov; mov; pop b",    {"push $a", "mov $c, $b", "mov $e, $f", "pop $d"},
+                                           {"mov $d, $a", "mov $c, $b", "mov $e, $f"},
+                                           [](const PeepholeBindings &b) {
+                                               return !mentions(b.at("$c"), b.at("$d")) &&
+                                                      !mentions(b.at("$b"), b.at("$d")) &&
+                                                      !mentions(b.at("$e"), b.at("$d")) &&
+                                                      !mentions(b.at("$f"), b.at("$d"));
+                                           }},
+            {"push a; mov; mov; mov; pop b", {"push $a", "mov $c, $b", "mov $e, $f", "mov $g, $h", "pop $d"},
+                                           {"mov $d, $a", "mov $c, $b", "mov $e, $f", "mov $g, $h"},
+                                           [](const PeepholeBindings &b) {
+                                               return std::ranges::none_of(
+                                                       std::vector<std::string>{"$b", "$c", "$e", "$f", "$g", "$h"},
+                                                       [&b](const std::string &name) {
+                                                           return mentions(b.at(name), b.at("$d"));
+                                                       });
+                                           }},
+            //Writing a dword register clears the upper half
+            {"mov a, a",                   {"mov $a, $a"},                                        {},
+                                           [](const PeepholeBindings &b) {
+                                               return !is_dword_register(b.at("$a"));
+                                           }},
+            {"mov a, b; mov b, a",         {"mov $a, $b", "mov $b, $a"},                          {"mov $a, $b"},
+                                           [](const PeepholeBindings &b) {
+                                               return !mentions(b.at("$b"), b.at("$a"));
+                                           }},
+            {"mov a, b; mov a, c",         {"mov $a, $b", "mov $a, $c"},                          {"mov $a, $c"},
+                                           [](const PeepholeBindings &b) {
+                                               return is_register(b.at("$a")) && !mentions(b.at("$c"), b.at("$a"));
+                                           }},
+            //Nothing the generators emit reads the flags of an addition
+            {"add a, 0",                   {"add $a, 0"},                                         {}},
+            {"sub a, 0",                   {"sub $a, 0"},                                         {}},
+            {"jmp L; L:",                  {"jmp $L", "$L:"},                                     {"$L:"}},
+    };
+
+    explicit PeepholeOptimizer(const std::vector<AsmInstruction> &instructions) : instructions(instructions) {
+        for (const PeepholeRule &rule: rules) {
+            std::vector<AsmInstruction> pattern;
+            for (const std::string &line: rule.pattern) {
+                pattern.push_back(parse_asm_line(line));
+            }
+            patterns.push_back(pattern);
+            hits.emplace_back(rule.name, 0);
+        }
+    }
+
+    /*
+     * Every window becomes the tail of the output at some point, so the rules are only tried there. A rewrite can
+     * complete another pattern ending at the new tail, so they are tried again until none applies.
+     */
+    [[nodiscard]] std::vector<AsmInstruction> optimize() {
+        std::vector<AsmInstruction> optimized;
+        optimized.reserve(instructions.size());
+
+        for (const AsmInstruction &instr: instructions) {
+            optimized.push_back(instr);
+            while (apply_rule(optimized)) {
+            }
+        }
+
+        return optimized;
+    }
+
+    //How many times each rule was applied, in the order of the rules
+    [[nodiscard]] const std::vector<std::pair<std::string, int>> &get_hits() const {
+        return hits;
+    }
+
+private:
+    std::vector<AsmInstruction> instructions;
+    std::vector<std::vector<AsmInstruction>> patterns;
+    std::vector<std::pair<std::string, int>> hits;
+
+    static inline const std::map<std::string, std::string> register_families = [] {
+        std::map<std::string, std::string> families;
+        for (const std::string reg: {"rax", "rbx", "rcx", "rdx", "rsi", "rdi", "rbp", "rsp", "r8", "r9", "r10", "r11",
+                                     "r12", "r13", "r14", "r15"}) {
+            for (const int bytes: {1, 2, 4, 8}) {
+                families[sub_register(reg, bytes)] = reg;
+            }
+        }
+        return families;
+    }();
+
+    static bool bind(PeepholeBindings &bindings, const std::string &pattern, const std::string &value) {
+        if (!pattern.starts_with("$")) return pattern == value;
+
+        const auto [it, inserted] = bindings.try_emplace(pattern, value);
+        return inserted || it->second == value;
+    }
+
+    static bool match(const std::vector<AsmInstruction> &pattern, const std::vector<AsmInstruction> &instructions,
+                      PeepholeBindings &bindings) {
+        if (pattern.size() > instructions.size()) return false;
+
+        const size_t at = instructions.size() - pattern.size();
+        for (size_t k = 0; k < pattern.size(); k++) {
+            const AsmInstruction &expected = pattern[k];
+            const AsmInstruction &actual = instructions[at + k];
+
+            if (expected.kind != actual.kind || expected.operands.size() != actual.operands.size()) return false;
+            if (!bind(bindings, expected.opcode, actual.opcode)) return false;
+
+            for (size_t op = 0; op < expected.operands.size(); op++) {
+                if (!bind(bindings, expected.operands[op], actual.operands[op])) return false;
+            }
+        }
+        return true;
+    }
+
+    static std::string substitute(const std::string &operand, const PeepholeBindings &bindings) {
+        return operand.starts_with("$") ? bindings.at(operand) : operand;
+    }
+
+    bool apply_rule(std::vector<AsmInstruction> &optimized) {
+        for (size_t r = 0; r < rules.size(); r++) {
+            PeepholeBindings bindings;
+            if (!match(patterns[r], optimized, bindings)) continue;
+            if (rules[r].condition && !rules[r].condition(bindings)) continue;
+
+            std::vector<AsmInstruction> replacement;
+            for (const std::string &line: rules[r].replacement) {
+                AsmInstruction instr = parse_asm_line(line);
+                instr.opcode = substitute(instr.opcode, bindings);
+                for (std::string &operand: instr.operands) {
+                    operand = substitute(operand, bindings);
+                }
+                replacement.push_back(instr);
+            }
+
+            optimized.resize(optimized.size() - patterns[r].size());
+            optimized.insert(optimized.end(), replacement.begin(), replacement.end());
+            hits[r].second++;
+            return true;
+        }
+        return false;
+    }
+};
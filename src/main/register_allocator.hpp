@@ -0,0 +1,329 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "ir_generator.hpp"
+
+struct Location {
+    enum class Kind {
+        reg, stack, constant
+    };
+
+    Kind kind;
+    std::string value;
+};
+
+struct LiveInterval {
+    std::string vreg;
+    size_t start;
+    size_t end;
+    double weight;
+    bool crosses_call;
+    std::optional<std::string> constant;
+};
+
+/*
+ * Linear scan register allocation (Poletto & Sarkar) over the TAC. Every variable and temporary gets one interval
+ * spanning all the positions it's live at, computed with a liveness analysis over the control flow graph.
+ */
+class RegisterAllocator {
+public:
+    //Registers the runtime routines and syscalls never overwrite, and the ones that they might
+    static inline const std::vector<std::string> call_safe_regs = {
+            "rbx", "r8", "r9", "r10", "r12", "r13", "r14", "r15"
+    };
+    static inline const std::vector<std::string> call_clobbered_regs = {"rcx", "rsi", "rdi"};
+
+    //Definitions the instruction selector folded into another instruction are read and written at that instruction
+    explicit RegisterAllocator(const std::vector<TACInstruction> &instructions,
+                               const std::map<size_t, size_t> &folded = {}) : instructions(instructions) {
+        std::set<std::string> folded_temps;
+        for (const auto &[def, root]: folded) {
+            folded_temps.insert(instructions[def].result.value());
+        }
+
+        const auto add_uses = [&](const TACInstruction &instr, std::vector<std::string> &uses) {
+            for (const std::string &use: get_uses(instr)) {
+                if (!folded_temps.contains(use)) uses.push_back(use);
+            }
+        };
+
+        uses.resize(instructions.size());
+        defs.resize(instructions.size());
+        for (size_t i = 0; i < instructions.size(); i++) {
+            if (folded.contains(i)) continue;
+
+            add_uses(instructions[i], uses[i]);
+            defs[i] = get_def(instructions[i]);
+        }
+        for (const auto &[def, root]: folded) {
+            add_uses(instructions[def], uses[root]);
+        }
+    }
+
+    [[nodiscard]] std::map<std::string, Location> allocate() {
+        compute_loop_depths();
+        build_intervals();
+        linear_scan();
+
+        return locations;
+    }
+
+    [[nodiscard]] size_t get_stack_slots() const {
+        return stack_slots;
+    }
+
+    [[nodiscard]] const std::vector<LiveInterval> &get_intervals() const {
+        return intervals;
+    }
+
+    //Array initializers and cleared arrays up to this long are stored inline by the ASMGenerator, longer ones are
+    //left to the runtime
+    static constexpr size_t max_inline_init_qwords = 4;
+
+    //Instructions that call into the runtime or the kernel, where rcx, rsi, rdi and the scratch registers are lost
+    static bool is_call(const TACInstruction &instr) {
+        switch (instr.op) {
+            case OperationType::print_int:
+            case OperationType::print_char:
+            case OperationType::print_string:
+            case OperationType::read_char:
+            case OperationType::array_allocate:
+            case OperationType::array_fill:
+            case OperationType::array_copy:
+            case OperationType::print_array:
+            case OperationType::end_scope:
+                return true;
+            case OperationType::array_init:
+            case OperationType::array_stack:
+            case OperationType::array_static:
+                return static_cast<size_t>(array_bytes(instr.element, std::stoll(instr.arg1.value()))) / 8 >
+                       max_inline_init_qwords;
+            default:
+                return false;
+        }
+    }
+
+private:
+    const std::vector<TACInstruction> &instructions;
+    std::vector<std::vector<std::string>> uses;
+    std::vector<std::optional<std::string>> defs;
+
+    std::vector<int> loop_depths;
+    std::vector<LiveInterval> intervals;
+    std::map<std::string, Location> locations;
+    size_t stack_slots = 0;
+
+    static constexpr double loop_weight = 10;
+
+    //A backward jump to a label closes a loop spanning everything in between
+    void compute_loop_depths() {
+        loop_depths.assign(instructions.size(), 0);
+
+        std::map<std::string, size_t> labels;
+        for (size_t i = 0; i < instructions.size(); i++) {
+            if (instructions[i].op == OperationType::label) {
+                labels[instructions[i].arg1.value()] = i;
+            }
+        }
+
+        for (size_t i = 0; i < instructions.size(); i++) {
+            if (instructions[i].op != OperationType::jump) continue;
+
+            const auto it = labels.find(instructions[i].arg1.value());
+            if (it == labels.end() || it->second > i) continue;
+
+            for (size_t j = it->second; j <= i; j++) {
+                loop_depths[j]++;
+            }
+        }
+    }
+
+    [[nodiscard]] std::vector<std::vector<size_t>> get_successors() const {
+        std::map<std::string, size_t> labels;
+        for (size_t i = 0; i < instructions.size(); i++) {
+            if (instructions[i].op == OperationType::label) {
+                labels[instructions[i].arg1.value()] = i;
+            }
+        }
+
+        std::vector<std::vector<size_t>> successors(instructions.size());
+        for (size_t i = 0; i < instructions.size(); i++) {
+            const TACInstruction &instr = instructions[i];
+            const bool falls_through = instr.op != OperationType::jump && instr.op != OperationType::prog_exit;
+
+            if (falls_through && i + 1 < instructions.size()) {
+                successors[i].push_back(i + 1);
+            }
+
+            switch (instr.op) {
+                case OperationType::jump:
+                    successors[i].push_back(labels.at(instr.arg1.value()));
+                    break;
+                case OperationType::jump_false:
+                case OperationType::jump_table:
+                    successors[i].push_back(labels.at(instr.arg2.value()));
+                    break;
+                case OperationType::table_entry:
+                    successors[i].push_back(labels.at(instr.arg1.value()));
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        return successors;
+    }
+
+    void build_intervals() {
+        const std::vector<std::vector<size_t>> successors = get_successors();
+
+        //Iterate the liveness equations on single instructions until they settle, walking backwards converges fast
+        std::vector<std::set<std::string>> live_in(instructions.size());
+        bool changed = true;
+        while (changed) {
+            changed = false;
+
+            for (size_t i = instructions.size(); i-- > 0;) {
+                std::set<std::string> live;
+                for (const size_t successor: successors[i]) {
+                    live.insert(live_in[successor].begin(), live_in[successor].end());
+                }
+
+                if (defs[i].has_value()) {
+                    live.erase(defs[i].value());
+                }
+                for (const std::string &use: uses[i]) {
+                    live.insert(use);
+                }
+
+                if (live != live_in[i]) {
+                    live_in[i] = std::move(live);
+                    changed = true;
+                }
+            }
+        }
+
+        std::map<std::string, LiveInterval> by_vreg;
+        std::map<std::string, int> def_count;
+        const auto extend = [&by_vreg](const std::string &vreg, const size_t position) {
+            auto [it, inserted] = by_vreg.try_emplace(vreg, LiveInterval{vreg, position, position, 0, false, {}});
+            it->second.start = std::min(it->second.start, position);
+            it->second.end = std::max(it->second.end, position);
+        };
+
+        for (size_t i = 0; i < instructions.size(); i++) {
+            for (const std::string &vreg: live_in[i]) {
+                extend(vreg, i);
+            }
+
+            const double weight = std::pow(loop_weight, loop_depths[i]);
+            for (const std::string &use: uses[i]) {
+                extend(use, i);
+                by_vreg.at(use).weight += weight;
+            }
+
+            if (const auto &def = defs[i]; def.has_value()) {
+                extend(def.value(), i);
+                by_vreg.at(def.value()).weight += weight;
+                def_count[def.value()]++;
+
+                //A variable only ever assigned one literal can be replaced by it wherever it's needed
+                if (instructions[i].op == OperationType::assign && !is_tac_value(instructions[i].arg1)) {
+                    by_vreg.at(def.value()).constant = instructions[i].arg1;
+                }
+            }
+        }
+
+        std::vector<size_t> calls;
+        for (size_t i = 0; i < instructions.size(); i++) {
+            if (is_call(instructions[i])) calls.push_back(i);
+        }
+
+        for (auto &[vreg, interval]: by_vreg) {
+            if (def_count[vreg] != 1) interval.constant.reset();
+
+            //Spill weight is the use density, rematerializing a constant costs nothing
+            interval.weight = interval.constant.has_value()
+                                      ? 0
+                                      : interval.weight / static_cast<double>(interval.end - interval.start + 1);
+
+            interval.crosses_call = std::ranges::any_of(calls, [&interval](const size_t call) {
+                return interval.start < call && call < interval.end;
+            });
+
+            intervals.push_back(interval);
+        }
+
+        std::ranges::sort(intervals, [](const LiveInterval &a, const LiveInterval &b) {
+            return a.start < b.start || (a.start == b.start && a.vreg < b.vreg);
+        });
+    }
+
+    void spill(const LiveInterval &interval) {
+        if (interval.constant.has_value()) {
+            locations[interval.vreg] = {Location::Kind::constant, interval.constant.value()};
+        } else {
+            locations[interval.vreg] = {Location::Kind::stack, std::to_string(stack_slots++)};
+        }
+    }
+
+    void linear_scan() {
+        std::vector<const LiveInterval *> active;
+        std::set<std::string> free_regs(call_safe_regs.begin(), call_safe_regs.end());
+        free_regs.insert(call_clobbered_regs.begin(), call_clobbered_regs.end());
+
+        const auto allowed = [](const LiveInterval &interval, const std::string &reg) {
+            return !interval.crosses_call || std::ranges::find(call_safe_regs, reg) != call_safe_regs.end();
+        };
+
+        for (const LiveInterval &interval: intervals) {
+            //Registers of operands read at the start position stay taken, so a result never overwrites them
+            std::erase_if(active, [&](const LiveInterval *other) {
+                if (other->end >= interval.start) return false;
+                free_regs.insert(locations.at(other->vreg).value);
+                return true;
+            });
+
+            //Short intervals take the registers calls overwrite first, keeping the safe ones for the long ones
+            std::optional<std::string> reg;
+            for (const auto *regs: {&call_clobbered_regs, &call_safe_regs}) {
+                for (const std::string &candidate: *regs) {
+                    if (!reg.has_value() && free_regs.contains(candidate) && allowed(interval, candidate)) {
+                        reg = candidate;
+                    }
+                }
+            }
+
+            if (reg.has_value()) {
+                free_regs.erase(reg.value());
+                locations[interval.vreg] = {Location::Kind::reg, reg.value()};
+                active.push_back(&interval);
+                continue;
+            }
+
+            //Evict the active interval with the lowest use density whose register this one may use
+            const LiveInterval *victim = nullptr;
+            for (const LiveInterval *other: active) {
+                if (!allowed(interval, locations.at(other->vreg).value)) continue;
+                if (victim == nullptr || other->weight < victim->weight) victim = other;
+            }
+
+            if (victim == nullptr || victim->weight >= interval.weight) {
+                spill(interval);
+                continue;
+            }
+
+            locations[interval.vreg] = locations.at(victim->vreg);
+            spill(*victim);
+            std::erase(active, victim);
+            active.push_back(&interval);
+        }
+    }
+};
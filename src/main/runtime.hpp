@@ -0,0 +1,414 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "ir_generator.hpp"
+#include "peephole_optimizer.hpp"
+
+//The bytes of a string as the operands of db
+static std::string byte_list(const std::string &text) {
+    std::string list;
+    for (const unsigned char c: text) {
+        list += (list.empty() ? "" : ", ") + std::to_string(c);
+    }
+    return list;
+}
+
+//Routines the generated code calls, linked into every program
+static const std::string runtime_source = R"(
+section .data
+boundsError:
+    db )" + byte_list(bounds_error_message) + R"(
+
+section .bss
+digitSpace:
+    resb 22                     ; reserve space for a number
+digitSpacePos:
+    resb 8                      ; reserve space for a pointer
+outputSize:
+    resb 8                      ; bytes waiting in the output buffer
+outputBuffer:
+    resb 65536                  ; output collected to be written with a single syscall
+heapBase:
+    resb 8                      ; start of the heap
+heapEnd:
+    resb 8                      ; end of the memory mapped for the heap so far
+heapHigh:
+    resb 8                      ; highest heap top that may still hold pages of memory
+
+section .text
+    global _flush
+    global _print_char
+    global _print_int
+    global _fill_qwords
+    global _copy_qwords
+    global _print_chars
+    global _fill_bytes
+    global _copy_bytes
+    global _print_bytes
+    global _heap_init
+    global _heap_start
+    global _heap_alloc
+    global _heap_release
+    global _bounds_error
+
+_flush:                         ; keeps every register a syscall keeps
+    push rdi
+    push rsi
+    push rdx
+
+    mov rsi, outputBuffer       ; write out everything that's buffered
+    mov rdx, [outputSize]       ; |
+
+_flush_write:
+    test rdx, rdx               ; until nothing is left
+    jz _flush_end               ; |
+    mov rax, 1                  ; print instruction
+    mov rdi, 1                  ; |
+    syscall                     ; rsi and rdx already hold the rest
+    test rax, rax               ; give up if stdout is gone
+    jle _flush_end              ; |
+    add rsi, rax                ; a pipe may take only a part of it
+    sub rdx, rax                ; |
+    jmp _flush_write            ; |
+
+_flush_end:
+    xor rdx, rdx                ; the buffer is empty again
+    mov [outputSize], rdx       ; |
+
+    pop rdx
+    pop rsi
+    pop rdi
+    ret
+
+_print_char:                    ; al - character, keeps every register a syscall keeps except rdi
+    mov rcx, [outputSize]       ; append it to the buffer
+    mov rdi, outputBuffer       ; |
+    mov [rdi + rcx], al         ; |
+    inc rcx                     ; |
+    mov [outputSize], rcx       ; |
+    cmp rcx, 65536              ; write the buffer out once it's full
+    je _flush                   ; |
+    ret
+
+_print_int:
+    push rbx                    ; rbx may hold a variable of the caller
+    push rax
+
+    test rax, rax
+    js _print_minus
+
+    pop rax
+    jmp _print_int_positive
+
+_print_minus:
+    mov rax, 45                 ; print the minus sign
+    call _print_char            ; |
+
+    pop rax
+    neg rax
+
+_print_int_positive:
+    mov rcx, digitSpace         ; move a pointer pointing to the memory space reserved for a number to rcx
+    mov rbx, 10                 ; move a newline character to rbx
+    mov [rcx], rbx              ; move a newline character to the number memory space
+    inc rcx                     ; increment a digitSpace pointer
+    mov [digitSpacePos], rcx    ; save the pointer to the variable
+
+_printRAXLoop:
+    mov rdx, 0                  ; divide a number in rax by 10
+    mov rbx, 10                 ; |
+    div rbx                     ; |
+    push rax                    ; save it to the memory
+    add rdx, 48                 ; add remainder and ascii '0' to get a digit character
+
+    mov rcx, [digitSpacePos]    ; move pointer to the digitSpacePos to rcx
+    mov [rcx], dl               ; move the ascii character to the pointer
+    inc rcx                     ; increment the pointer
+    mov [digitSpacePos], rcx    ; save the new pointer value
+
+    pop rax                     ; restore the number divided by 10
+    cmp rax, 0                  ; check if it's 0
+    jne _printRAXLoop           ; if it's not - continue the loop
+
+_printRAXLoop2:
+    mov rcx, [digitSpacePos]    ; move the pointer to the rcx
+    mov al, [rcx]               ; print the character it points to
+    call _print_char            ; |
+
+    mov rcx, [digitSpacePos]    ; move the pointer to the rcx
+    dec rcx                     ; decrement the pointer
+    mov [digitSpacePos], rcx    ; save the pointer
+
+    cmp rcx, digitSpace         ; check if it's the end of the string
+    jge _printRAXLoop2          ; if it's not - continue the loop
+
+    pop rbx                     ; restore the caller's rbx
+    ret                         ; ret from the call
+
+_fill_qwords:                   ; rdi - first element, rcx - element count, rax - value
+    movq xmm0, rax              ; broadcast the value to both halves of xmm0
+    punpcklqdq xmm0, xmm0       ; |
+
+_fill_qwords_pair:
+    cmp rcx, 2                  ; store two elements at once while possible
+    jb _fill_qwords_tail        ; |
+    movdqu [rdi], xmm0          ; |
+    add rdi, 16                 ; |
+    sub rcx, 2                  ; |
+    jmp _fill_qwords_pair       ; |
+
+_fill_qwords_tail:
+    test rcx, rcx               ; store the last element if the count was odd
+    jz _fill_qwords_end         ; |
+    mov [rdi], rax              ; |
+
+_fill_qwords_end:
+    ret
+
+_copy_qwords:                   ; rdi - destination, rsi - source, rcx - element count
+    cmp rcx, 2                  ; copy two elements at once while possible
+    jb _copy_qwords_tail        ; |
+    movdqu xmm0, [rsi]          ; |
+    movdqu [rdi], xmm0          ; |
+    add rsi, 16                 ; |
+    add rdi, 16                 ; |
+    sub rcx, 2                  ; |
+    jmp _copy_qwords            ; |
+
+_copy_qwords_tail:
+    test rcx, rcx               ; copy the last element if the count was odd
+    jz _copy_qwords_end         ; |
+    mov rax, [rsi]              ; |
+    mov [rdi], rax              ; |
+
+_copy_qwords_end:
+    ret
+
+_print_chars:                   ; rsi - first element, rcx - element count
+    mov rdi, outputBuffer       ; pack the low bytes of the elements into the output buffer
+    mov rdx, [outputSize]       ; |
+
+_print_chars_pack:
+    mov al, [rsi]               ; |
+    mov [rdi + rdx], al         ; |
+    add rsi, 8                  ; |
+    inc rdx                     ; |
+    cmp rdx, 65536              ; write the buffer out whenever it's full
+    jne _print_chars_next       ; |
+    mov [outputSize], rdx       ; |
+    push rcx                    ; | syscall overwrites rcx
+    call _flush                 ; |
+    pop rcx                     ; |
+    xor rdx, rdx                ; |
+
+_print_chars_next:
+    dec rcx                     ; until all the elements are packed
+    jnz _print_chars_pack       ; |
+
+    mov [outputSize], rdx
+    ret
+
+_fill_bytes:                    ; rdi - first byte, rcx - byte count, rax - value repeated in every byte
+    cmp rcx, 8                  ; store a whole qword at once while possible
+    jb _fill_bytes_tail         ; |
+    mov [rdi], rax              ; |
+    add rdi, 8                  ; |
+    sub rcx, 8                  ; |
+    jmp _fill_bytes             ; |
+
+_fill_bytes_tail:
+    test rcx, rcx               ; store the rest byte by byte
+    jz _fill_bytes_end          ; |
+    mov [rdi], al               ; |
+    shr rax, 8                  ; the next byte of the pattern
+    inc rdi                     ; |
+    dec rcx                     ; |
+    jmp _fill_bytes_tail        ; |
+
+_fill_bytes_end:
+    ret
+
+_copy_bytes:                    ; rdi - destination, rsi - source, rcx - byte count
+    cmp rcx, 16                 ; copy sixteen bytes at once while possible
+    jb _copy_bytes_tail         ; |
+    movdqu xmm0, [rsi]          ; |
+    movdqu [rdi], xmm0          ; |
+    add rsi, 16                 ; |
+    add rdi, 16                 ; |
+    sub rcx, 16                 ; |
+    jmp _copy_bytes             ; |
+
+_copy_bytes_tail:
+    test rcx, rcx               ; copy the rest byte by byte
+    jz _copy_bytes_end          ; |
+    mov al, [rsi]               ; |
+    mov [rdi], al               ; |
+    inc rsi                     ; |
+    inc rdi                     ; |
+    dec rcx                     ; |
+    jmp _copy_bytes_tail        ; |
+
+_copy_bytes_end:
+    ret
+
+_print_bytes:                   ; rsi - first byte, rcx - byte count
+    mov rdx, 65536              ; copy as much as fits in the output buffer
+    sub rdx, [outputSize]       ; |
+    cmp rcx, rdx                ; |
+    cmovb rdx, rcx              ; |
+    sub rcx, rdx                ; the rest waits for the next part
+    push rcx                    ; |
+
+    mov rdi, outputBuffer       ; right after what's already there
+    add rdi, [outputSize]       ; |
+    add [outputSize], rdx       ; |
+    mov rcx, rdx                ; |
+    call _copy_bytes            ; | moves rsi past the copied part
+
+    pop rcx
+    mov rax, [outputSize]       ; the rest fit unless the buffer got full
+    cmp rax, 65536              ; |
+    jne _print_bytes_end        ; |
+    push rcx                    ; write it out and copy the next part
+    call _flush                 ; |
+    pop rcx                     ; |
+    test rcx, rcx               ; |
+    jnz _print_bytes            ; |
+
+_print_bytes_end:
+    ret
+
+_heap_init:                     ; returns the heap top in rax
+    mov rax, 12                 ; the heap starts at the program break
+    mov rdi, 0                  ; |
+    syscall                     ; |
+    add rax, 4095               ; | rounded up to a whole page
+    and rax, -4096              ; |
+
+_heap_start:                    ; rax - heap top, keeps every other register
+    lea rdi, [rax + 4095]       ; memory up to the next page is already there
+    and rdi, -4096              ; |
+    mov [heapBase], rdi         ; |
+    mov [heapEnd], rdi          ; |
+    mov [heapHigh], rdi         ; |
+    ret
+
+_heap_alloc:                    ; rdi - new heap top, keeps rdx
+    cmp rdi, [heapEnd]          ; bump allocations only need more memory past the mapped end
+    ja _heap_grow               ; |
+    ret
+
+_heap_grow:
+    push rdx                    ; mmap takes six arguments
+    push r8                     ; |
+    push r9                     ; |
+    push r10                    ; |
+
+    mov rax, rdi                ; map at least what is missing
+    sub rax, [heapEnd]          ; |
+    mov rsi, [heapEnd]          ; and at least as much as is mapped already, doubling the heap each time
+    sub rsi, [heapBase]         ; |
+    cmp rsi, rax                ; |
+    cmovb rsi, rax              ; |
+    mov rax, 1048576            ; but no less than 1 MB
+    cmp rsi, rax                ; |
+    cmovb rsi, rax              ; |
+    add rsi, 4095               ; in whole pages
+    and rsi, -4096              ; |
+
+    mov rax, 9                  ; mmap instruction
+    mov rdi, [heapEnd]          ; right at the end of the heap
+    mov rdx, 3                  ; PROT_READ | PROT_WRITE
+    mov r10, 1048610            ; MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE
+    mov r8, -1                  ; no file
+    mov r9, 0                   ; |
+    syscall
+    cmp rax, rdi                ; the heap has to stay in one piece
+    jne _heap_out_of_memory     ; |
+    add [heapEnd], rsi          ; |
+
+    cmp rsi, 33554432           ; chunks of 32 MB and more are worth backing with huge pages
+    jb _heap_grow_end           ; |
+    mov rax, 28                 ; madvise instruction
+    mov rdx, 14                 ; MADV_HUGEPAGE, a hint the kernel may ignore
+    syscall                     ; rdi and rsi still hold the chunk
+
+_heap_grow_end:
+    pop r10
+    pop r9
+    pop r8
+    pop rdx
+    ret
+
+_heap_out_of_memory:
+    call _flush                 ; what was printed so far still shows up
+    mov rax, 60                 ; exit instruction
+    mov rdi, 1                  ; |
+    syscall
+
+_heap_release:                  ; rdi - heap top saved by the scope, rsi - heap top at its end, keeps rdx
+    cmp rsi, [heapHigh]         ; remember how high the heap got
+    jbe _heap_release_check     ; |
+    mov [heapHigh], rsi         ; |
+
+_heap_release_check:
+    add rdi, 4095               ; the pages above the saved top are free now
+    and rdi, -4096              ; |
+    mov rsi, [heapHigh]         ; |
+    sub rsi, rdi                ; |
+    cmp rsi, 16777216           ; give them back only once there are 16 MB of them
+    jl _heap_release_end        ; |
+    mov [heapHigh], rdi         ; |
+
+    push rdx
+    mov rax, 28                 ; madvise instruction
+    mov rdx, 4                  ; MADV_DONTNEED, they stay mapped and read as zeros when used again
+    syscall
+    pop rdx
+
+_heap_release_end:
+    ret
+
+_bounds_error:                  ; rdi - line of the failed access, doesn't return
+    call _flush                 ; the output printed before the access comes first
+    push rdi
+    mov rax, 1                  ; print instruction
+    mov rdi, 2                  ; to stderr
+    mov rsi, boundsError        ; message
+    mov rdx, )" + std::to_string(bounds_error_message.size()) + R"(                  ; len
+    syscall
+
+    pop rax
+    mov rcx, digitSpace         ; the digits are written backwards from the end of digitSpace
+    add rcx, 21                 ; |
+    mov rdx, 10                 ; newline after them
+    mov [rcx], dl               ; |
+    mov rbx, 10
+
+_bounds_error_digit:
+    dec rcx
+    mov rdx, 0                  ; divide the line by 10
+    div rbx                     ; |
+    add rdx, 48                 ; the remainder is the next digit
+    mov [rcx], dl               ; |
+    cmp rax, 0                  ; until there's nothing left
+    jne _bounds_error_digit     ; |
+
+    mov rsi, rcx                ; print the line
+    mov rdx, digitSpace         ; |
+    add rdx, 22                 ; |
+    sub rdx, rcx                ; |
+    mov rax, 1                  ; |
+    mov rdi, 2                  ; |
+    syscall
+
+    mov rax, 60                 ; exit instruction
+    mov rdi, 1                  ; |
+    syscall
+)";
+
+static std::vector<AsmInstruction> runtime_program() {
+    return parse_asm(runtime_source);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "asm_generator.hpp"
+#include "bytecode_vm.hpp"
+#include "ir_generator.hpp"
+#include "jit_runner.hpp"
+#include "peephole_optimizer.hpp"
+#include "runtime.hpp"
+
+/*
+ * Starts running the program in the bytecode interpreter, and once a loop gets hot compiles the whole program into
+ * native code entered right at the header of that loop. The interpreter's variables, saved heap tops and heap are
+ * handed over as they are, the native code then runs the program to its end.
+ */
+class TieredRunner {
+public:
+    TieredRunner(const std::vector<TACInstruction> &instructions, const VectorISA vector_isa) :
+            instructions(instructions), vector_isa(vector_isa) {
+    }
+
+    [[nodiscard]] int run() {
+        BytecodeVM bytecode_vm(instructions, [this, &bytecode_vm](const std::string &header) {
+            return tier_up(bytecode_vm, header);
+        });
+        bytecode_vm.compile();
+
+        return bytecode_vm.run();
+    }
+
+private:
+    const std::vector<TACInstruction> &instructions;
+    VectorISA vector_isa;
+    std::unique_ptr<JITRunner> jit_runner;
+
+    std::optional<int> tier_up(const BytecodeVM &bytecode_vm, const std::string &header) {
+        std::vector<TACInstruction> program = instructions;
+        ASMGenerator asm_generator(program, vector_isa);
+        asm_generator.set_osr_header(header);
+        std::vector<AsmInstruction> asm_code = asm_generator.generate_program();
+        const OSRLayout &layout = asm_generator.get_osr_layout();
+
+        std::vector<int64_t> state = {reinterpret_cast<int64_t>(bytecode_vm.get_heap_top())};
+        for (const size_t scope: layout.scopes) {
+            const std::optional<int64_t> top = bytecode_vm.get_scope_top(scope);
+            if (!top.has_value()) return {};
+            state.push_back(top.value());
+        }
+
+        //Values fused away by the interpreter can't be handed over, the loop stays interpreted then
+        for (const std::string &value: layout.values) {
+            const std::optional<int64_t> current = bytecode_vm.get_value(value);
+            if (!current.has_value()) return {};
+            state.push_back(current.value());
+        }
+
+        PeepholeOptimizer peephole_optimizer(asm_code);
+        asm_code = peephole_optimizer.optimize();
+
+        const std::vector<AsmInstruction> runtime = runtime_program();
+        asm_code.insert(asm_code.end(), runtime.begin(), runtime.end());
+
+        jit_runner = std::make_unique<JITRunner>(asm_code);
+        jit_runner->load();
+
+        //The digits left over by the last number printed show up in the next one
+        memcpy(jit_runner->get_symbol("digitSpace"), bytecode_vm.get_digit_space(), BytecodeVM::digit_space_size);
+
+        return jit_runner->run("_osr_entry", state.data(), bytecode_vm.get_heap(), BytecodeVM::heap_size,
+                               bytecode_vm.get_heap_top());
+    }
+};
@@ -22,7 +22,11 @@ enum class TokenType {
     cur_brkt_open,
     backtick,
     var_decl,
+    const_decl,
     var_type_int,
+    var_type_int8,
+    var_type_int16,
+    var_type_int32,
     var_type_boolean,
     var_type_char,
     var_type_string,
@@ -39,8 +43,13 @@ enum class TokenType {
     loop,
     loop_break,
     loop_continue,
+    for_loop,
+    from,
+    to,
+    step,
     print_int,
     print_char,
+    print_string,
     bool_lit,
     equal,
     not_equal,
@@ -57,6 +66,7 @@ enum class TokenType {
     array,
     of_size,
     element,
+    by,
     comma,
     double_quote,
     string_lit,
@@ -70,14 +80,14 @@ struct Token {
 };
 
 const inline std::set stmt_tokens = {
-        TokenType::var_decl, TokenType::exit, TokenType::cur_brkt_open, TokenType::backtick, TokenType::cond_if,
-        TokenType::loop, TokenType::loop_break, TokenType::loop_continue, TokenType::print_int, TokenType::print_char,
-        TokenType::array
+        TokenType::var_decl, TokenType::const_decl, TokenType::exit, TokenType::cur_brkt_open, TokenType::backtick,
+        TokenType::cond_if, TokenType::loop, TokenType::loop_break, TokenType::loop_continue, TokenType::for_loop,
+        TokenType::print_int, TokenType::print_char, TokenType::print_string, TokenType::array
 };
 const inline std::set int_tokens = {TokenType::int_lit_num, TokenType::int_lit_mul};
 const inline std::set term_tokens = {
         TokenType::sq_brkt_open, TokenType::backtick, TokenType::paren_open, TokenType::bool_lit,
-        TokenType::single_quote, TokenType::string_lit, TokenType::read_char
+        TokenType::single_quote, TokenType::double_quote, TokenType::read_char
 };
 const inline std::set arithmetic_tokens = {
         TokenType::add, TokenType::subtract, TokenType::divide, TokenType::multiply, TokenType::modulo
@@ -90,6 +100,11 @@ const inline std::set logical_tokens = {TokenType::logical_or, TokenType::logica
 const inline std::set var_types = {
         TokenType::var_type_int, TokenType::var_type_boolean, TokenType::var_type_char, TokenType::var_type_string
 };
+//Narrow integers only make sense packed densely in arrays
+const inline std::set array_types = {
+        TokenType::var_type_int, TokenType::var_type_int8, TokenType::var_type_int16, TokenType::var_type_int32,
+        TokenType::var_type_boolean, TokenType::var_type_char, TokenType::var_type_string
+};
 
 
 const inline std::unordered_map<TokenType, std::string> token_names = {
@@ -104,7 +119,11 @@ const inline std::unordered_map<TokenType, std::string> token_names = {
         {TokenType::cur_brkt_open,    "{"},
         {TokenType::backtick,         "`"},
         {TokenType::var_decl,         "zmienna"},
+        {TokenType::const_decl,       "stała"},
         {TokenType::var_type_int,     "całkowita"},
+        {TokenType::var_type_int8,    "ośmiobitowa"},
+        {TokenType::var_type_int16,   "szesnastobitowa"},
+        {TokenType::var_type_int32,   "trzydziestodwubitowa"},
         {TokenType::var_type_boolean, "logiczna"},
         {TokenType::var_type_char,    "znak"},
         {TokenType::var_type_string,  "tekstowa"},
@@ -121,8 +140,13 @@ const inline std::unordered_map<TokenType, std::string> token_names = {
         {TokenType::loop,             "powtarzaj"},
         {TokenType::loop_break,       "przerwij"},
         {TokenType::loop_continue,    "kontynuuj"},
+        {TokenType::for_loop,         "dla"},
+        {TokenType::from,             "od"},
+        {TokenType::to,               "do"},
+        {TokenType::step,             "krok"},
         {TokenType::print_int,        "wyświetl_liczbę"},
         {TokenType::print_char,       "wyświetl_znak"},
+        {TokenType::print_string,     "wyświetl_tekst"},
         {TokenType::bool_lit,         "<logiczna>"},
         {TokenType::equal,            "równe"},
         {TokenType::not_equal,        "różne"},
@@ -140,6 +164,7 @@ const inline std::unordered_map<TokenType, std::string> token_names = {
         {TokenType::array,            "tablica"},
         {TokenType::of_size,          "rozmiaru"},
         {TokenType::element,          "element"},
+        {TokenType::by,               "na"},
         {TokenType::comma,            ","},
         {TokenType::string_lit,       "<tekst>"},
         {TokenType::read_char,        "wczytaj_znak"},
@@ -257,7 +282,7 @@ public:
     std::vector<Token> tokenize() {
         contents += " ";
         bool comment = false;
-        for (int i = 0; i < contents.length(); i++) {
+        for (size_t i = 0; i < contents.length(); i++) {
             if (contents[i] == '\n') {
                 line++;
 
@@ -283,20 +308,25 @@ public:
 
                 tokens.push_back(token.value());
 
-                /*
+                //Everything up to the closing quote is the text itself, with \n, \t, \" and \\ escaped
                 if (token.value().type == TokenType::double_quote) {
-                    const int start = ++i;
-                    while (contents[i] != '"' && i < contents.length()) {
-                        i++;
+                    std::string str;
+                    for (i++; i < contents.length() && contents[i] != '"'; i++) {
+                        if (contents[i] == '\n') line++;
+
+                        if (contents[i] == '\\' && i + 1 < contents.length()) {
+                            i++;
+                            str += contents[i] == 'n' ? '\n' : contents[i] == 't' ? '\t' : contents[i];
+                            continue;
+                        }
+                        str += contents[i];
                     }
-                    const std::string str = contents.substr(start, i - start);
                     tokens.emplace_back(TokenType::string_lit, str, token.value().line);
 
                     if (i < contents.length()) {
                         tokens.push_back(create_char_token('"').value());
                     }
                 }
-                */
             } else {
                 buff += contents[i];
             }
@@ -373,7 +403,11 @@ private:
     const std::map<std::string, TokenType> tokenMap = {
             {"kończwaść",       TokenType::exit},
             {"zmienna",         TokenType::var_decl},
+            {"stała",           TokenType::const_decl},
             {"całkowita",       TokenType::var_type_int},
+            {"ośmiobitowa",     TokenType::var_type_int8},
+            {"szesnastobitowa", TokenType::var_type_int16},
+            {"trzydziestodwubitowa", TokenType::var_type_int32},
             {"równa",           TokenType::var_assign},
             {"dodać",           TokenType::add},
             {"odjąć",           TokenType::subtract},
@@ -385,8 +419,13 @@ private:
             {"powtarzaj",       TokenType::loop},
             {"przerwij",        TokenType::loop_break},
             {"kontynuuj",       TokenType::loop_continue},
+            {"dla",             TokenType::for_loop},
+            {"od",              TokenType::from},
+            {"do",              TokenType::to},
+            {"krok",            TokenType::step},
             {"wyświetl_liczbę", TokenType::print_int},
             {"wyświetl_znak",   TokenType::print_char},
+            {"wyświetl_tekst",  TokenType::print_string},
             {"logiczna",        TokenType::var_type_boolean},
             {"znak",            TokenType::var_type_char},
             {"tekstowa",        TokenType::var_type_char},
@@ -403,6 +442,7 @@ private:
             {"tablica",         TokenType::array},
             {"rozmiaru",        TokenType::of_size},
             {"element",         TokenType::element},
+            {"na",              TokenType::by},
             {"wczytaj_znak",    TokenType::read_char},
     };
 };
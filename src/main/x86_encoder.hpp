@@ -0,0 +1,739 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "peephole_optimizer.hpp"
+
+//Sections of the executable, in the order they are laid out in memory
+enum class Section {
+    text, rodata, data, bss
+};
+
+//A place in a section that has to be filled with the address of a symbol once the sections are laid out
+struct Relocation {
+    enum class Kind {
+        relative32, absolute32, absolute64
+    };
+
+    Kind kind;
+    Section section;
+    size_t offset;
+    std::string symbol;
+    long long addend = 0;
+};
+
+struct ObjectCode {
+    //The .bss section is only ever zeros, it keeps them just for its size
+    std::map<Section, std::vector<uint8_t>> contents;
+    std::map<std::string, std::pair<Section, size_t>> symbols;
+    std::vector<Relocation> relocations;
+
+    [[nodiscard]] uint64_t size(const Section section) const {
+        return contents.contains(section) ? contents.at(section).size() : 0;
+    }
+
+    [[nodiscard]] uint64_t symbol_address(const std::string &symbol,
+                                          const std::map<Section, uint64_t> &addresses) const {
+        if (!symbols.contains(symbol)) {
+            std::cerr << "[BŁĄD] [Konsolidacja] Niezdefiniowany symbol '" << symbol << "'" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        const auto [section, offset] = symbols.at(symbol);
+        return addresses.at(section) + offset;
+    }
+
+    //Fills in every relocation, once each section got the address it's going to be loaded at
+    void relocate(const std::map<Section, uint64_t> &addresses) {
+        for (const Relocation &relocation: relocations) {
+            const uint64_t target = symbol_address(relocation.symbol, addresses) + relocation.addend;
+            const uint64_t place = addresses.at(relocation.section) + relocation.offset;
+
+            uint64_t value = target;
+            int bytes = 4;
+            switch (relocation.kind) {
+                case Relocation::Kind::relative32:
+                    //Relative to the end of the instruction, which the displacement is always the last part of
+                    value = target - (place + 4);
+                    break;
+                case Relocation::Kind::absolute32:
+                    break;
+                case Relocation::Kind::absolute64:
+                    bytes = 8;
+                    break;
+            }
+
+            std::vector<uint8_t> &section = contents[relocation.section];
+            for (int i = 0; i < bytes; i++) {
+                section[relocation.offset + i] = static_cast<uint8_t>(value >> (8 * i));
+            }
+        }
+    }
+};
+
+struct X86Operand {
+    enum class Kind {
+        reg, vector_reg, imm, mem
+    };
+
+    Kind kind;
+    //In bytes, 0 for immediates and memory without a size given
+    int size = 0;
+    //Register number, or the base register of a memory operand
+    int reg = -1;
+    int index = -1;
+    int scale = 1;
+    //Value of an immediate, or the displacement of a memory operand
+    long long value = 0;
+    //Label the value is relative to
+    std::string symbol;
+};
+
+/*
+ * Translates the instructions emitted by the generators and the runtime into x86-64 machine code. Only the subset of
+ * the instruction set that's ever emitted is supported. Jumps always take a 32-bit displacement and labels are
+ * referenced by absolute 32-bit addresses, so the code has to be loaded below 2 GB, which both the ELFWriter and
+ * the JITRunner do.
+ */
+class X86Encoder {
+public:
+    explicit X86Encoder(const std::vector<AsmInstruction> &instructions) : instructions(instructions) {
+    }
+
+    [[nodiscard]] ObjectCode encode() {
+        for (const AsmInstruction &instr: instructions) {
+            switch (instr.kind) {
+                case AsmInstruction::Kind::label:
+                    if (!object.symbols.try_emplace(instr.opcode, section, out().size()).second) {
+                        error("Redefinicja etykiety '" + instr.opcode + "'");
+                    }
+                    break;
+                case AsmInstruction::Kind::directive:
+                    if (instr.opcode.starts_with("section ")) {
+                        const std::string name = instr.opcode.substr(instr.opcode.find(' ') + 1);
+                        if (!sections.contains(name)) error("Nieznana sekcja '" + name + "'");
+                        section = sections.at(name);
+                    } else if (!instr.opcode.starts_with("global ")) {
+                        error("Nieobsługiwana dyrektywa '" + instr.opcode + "'");
+                    }
+                    break;
+                case AsmInstruction::Kind::instruction:
+                    encode_instruction(instr);
+                    break;
+            }
+        }
+
+        return object;
+    }
+
+private:
+    const std::vector<AsmInstruction> &instructions;
+    ObjectCode object;
+    Section section = Section::text;
+
+    static inline const std::map<std::string, Section> sections = {
+            {".text",   Section::text},
+            {".rodata", Section::rodata},
+            {".data",   Section::data},
+            {".bss",    Section::bss},
+    };
+
+    //Name -> number and size in bytes
+    static inline const std::map<std::string, std::pair<int, int>> registers = [] {
+        std::map<std::string, std::pair<int, int>> regs;
+        const std::vector<std::string> names = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi"};
+        const std::vector<std::string> dword_names = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi"};
+        const std::vector<std::string> word_names = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di"};
+        const std::vector<std::string> low_names = {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil"};
+        for (int i = 0; i < 8; i++) {
+            regs[names[i]] = {i, 8};
+            regs[dword_names[i]] = {i, 4};
+            regs[word_names[i]] = {i, 2};
+            regs[low_names[i]] = {i, 1};
+        }
+        for (int i = 8; i < 16; i++) {
+            regs["r" + std::to_string(i)] = {i, 8};
+            regs["r" + std::to_string(i) + "d"] = {i, 4};
+            regs["r" + std::to_string(i) + "w"] = {i, 2};
+            regs["r" + std::to_string(i) + "b"] = {i, 1};
+        }
+        for (int i = 0; i < 16; i++) {
+            regs["xmm" + std::to_string(i)] = {i, 16};
+            regs["ymm" + std::to_string(i)] = {i, 32};
+        }
+        return regs;
+    }();
+
+    static inline const std::map<std::string, int> operand_sizes = {
+            {"BYTE",  1},
+            {"WORD",  2},
+            {"DWORD", 4},
+            {"QWORD", 8},
+    };
+
+    static inline const std::map<std::string, uint8_t> condition_codes = {
+            {"o",  0x0}, {"no", 0x1}, {"b",  0x2}, {"c",   0x2}, {"nae", 0x2}, {"ae", 0x3}, {"nb",  0x3},
+            {"nc", 0x3}, {"e",  0x4}, {"z",  0x4}, {"ne",  0x5}, {"nz",  0x5}, {"be", 0x6}, {"na",  0x6},
+            {"a",  0x7}, {"nbe", 0x7}, {"s", 0x8}, {"ns",  0x9}, {"p",   0xA}, {"np", 0xB}, {"l",   0xC},
+            {"nge", 0xC}, {"ge", 0xD}, {"nl", 0xD}, {"le", 0xE}, {"ng",  0xE}, {"g",  0xF}, {"nle", 0xF},
+    };
+
+    //Operation -> the /digit of its immediate form, the register forms are derived from it
+    static inline const std::map<std::string, int> alu_ops = {
+            {"add", 0}, {"or", 1}, {"and", 4}, {"sub", 5}, {"xor", 6}, {"cmp", 7},
+    };
+
+    //Operation -> /digit of the F7 and FF groups taking a single operand
+    static inline const std::map<std::string, std::pair<uint8_t, int>> unary_ops = {
+            {"not", {0xF7, 2}}, {"neg", {0xF7, 3}}, {"mul", {0xF7, 4}}, {"div", {0xF7, 6}}, {"idiv", {0xF7, 7}},
+            {"inc", {0xFF, 0}}, {"dec", {0xFF, 1}},
+    };
+
+    static inline const std::map<std::string, int> shift_ops = {
+            {"shl", 4}, {"shr", 5}, {"sar", 7},
+    };
+
+    //Operation -> the /digit of its immediate form and the opcode of its register form
+    static inline const std::map<std::string, std::pair<int, uint8_t>> bit_test_ops = {
+            {"bt", {4, 0xA3}}, {"bts", {5, 0xAB}}, {"btr", {6, 0xB3}},
+    };
+
+    //Operation -> the opcodes extending a byte and a word source
+    static inline const std::map<std::string, std::pair<uint8_t, uint8_t>> extend_ops = {
+            {"movzx", {0xB6, 0xB7}}, {"movsx", {0xBE, 0xBF}},
+    };
+
+    struct VectorOpcode {
+        uint8_t prefix;
+        //1 - 0F, 2 - 0F 38, 3 - 0F 3A
+        int map;
+        uint8_t opcode;
+    };
+
+    //Packed integer operations taking a destination and a source, or two sources in the AVX form
+    static inline const std::map<std::string, VectorOpcode> vector_ops = {
+            {"paddq",      {0x66, 1, 0xD4}},
+            {"psubq",      {0x66, 1, 0xFB}},
+            {"pand",       {0x66, 1, 0xDB}},
+            {"por",        {0x66, 1, 0xEB}},
+            {"pxor",       {0x66, 1, 0xEF}},
+            {"pcmpeqd",    {0x66, 1, 0x76}},
+            {"pcmpeqq",    {0x66, 2, 0x29}},
+            {"pcmpgtq",    {0x66, 2, 0x37}},
+            {"punpcklqdq", {0x66, 1, 0x6C}},
+    };
+
+    [[noreturn]] static void error(const std::string &message) {
+        std::cerr << "[BŁĄD] [Asembler] " << message << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::vector<uint8_t> &out() {
+        return object.contents[section];
+    }
+
+    void emit_byte(const uint64_t value) {
+        out().push_back(static_cast<uint8_t>(value));
+    }
+
+    void emit_bytes(const uint64_t value, const int count) {
+        for (int i = 0; i < count; i++) {
+            emit_byte(value >> (8 * i));
+        }
+    }
+
+    //32 bits of a value, or of the address of its symbol
+    void emit_imm32(const X86Operand &op) {
+        if (!op.symbol.empty()) {
+            object.relocations.push_back({Relocation::Kind::absolute32, section, out().size(), op.symbol, op.value});
+        } else if (!fits_int32(op.value)) {
+            error("Wartość '" + std::to_string(op.value) + "' nie mieści się w 32 bitach");
+        }
+        emit_bytes(op.symbol.empty() ? op.value : 0, 4);
+    }
+
+    void emit_rel32(const std::string &label) {
+        object.relocations.push_back({Relocation::Kind::relative32, section, out().size(), label});
+        emit_bytes(0, 4);
+    }
+
+    static bool fits_int8(const long long value) {
+        return value >= INT8_MIN && value <= INT8_MAX;
+    }
+
+    static bool fits_int32(const long long value) {
+        return value >= INT32_MIN && value <= INT32_MAX;
+    }
+
+    static bool is_number(const std::string &text) {
+        return !text.empty() && (isdigit(text[0]) || (text[0] == '-' && text.size() > 1 && isdigit(text[1])));
+    }
+
+    static X86Operand parse_operand(std::string text) {
+        X86Operand op{X86Operand::Kind::imm};
+
+        if (const size_t space = text.find(' ');
+            space != std::string::npos && operand_sizes.contains(text.substr(0, space))) {
+            op.size = operand_sizes.at(text.substr(0, space));
+            text = text.substr(space + 1);
+        }
+
+        if (text.starts_with("[")) {
+            op.kind = X86Operand::Kind::mem;
+            parse_address(text.substr(1, text.find(']') - 1), op);
+        } else if (registers.contains(text)) {
+            const auto [number, size] = registers.at(text);
+            op.kind = size >= 16 ? X86Operand::Kind::vector_reg : X86Operand::Kind::reg;
+            op.reg = number;
+            op.size = size;
+        } else if (is_number(text)) {
+            op.value = std::stoll(text, nullptr, 0);
+        } else {
+            op.symbol = text;
+        }
+
+        return op;
+    }
+
+    //base + index*scale ± displacement, with any of them left out
+    static void parse_address(const std::string &address, X86Operand &op) {
+        std::string term;
+        int sign = 1;
+
+        const auto add_term = [&] {
+            const size_t first = term.find_first_not_of(' ');
+            if (first == std::string::npos) return;
+            term = term.substr(first, term.find_last_not_of(' ') - first + 1);
+
+            if (const size_t star = term.find('*'); star != std::string::npos) {
+                op.index = registers.at(term.substr(0, star)).first;
+                op.scale = std::stoi(term.substr(star + 1));
+            } else if (registers.contains(term)) {
+                if (op.reg < 0) {
+                    op.reg = registers.at(term).first;
+                } else {
+                    op.index = registers.at(term).first;
+                }
+            } else if (is_number(term)) {
+                op.value += sign * std::stoll(term, nullptr, 0);
+            } else {
+                op.symbol = term;
+            }
+            term.clear();
+        };
+
+        for (const char c: address) {
+            if (c == '+' || c == '-') {
+                add_term();
+                sign = c == '-' ? -1 : 1;
+            } else {
+                term += c;
+            }
+        }
+        add_term();
+    }
+
+    //ModRM, SIB and displacement addressing the register or memory operand, with reg in the middle field
+    void emit_modrm(const int reg, const X86Operand &rm) {
+        if (rm.kind != X86Operand::Kind::mem) {
+            emit_byte(0xC0 | (reg & 7) << 3 | (rm.reg & 7));
+            return;
+        }
+
+        const int scale_bits = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+        const int index_bits = rm.index < 0 ? 4 : rm.index & 7;
+
+        //Without a base register there's only the absolute 32-bit displacement
+        if (rm.reg < 0) {
+            emit_byte(0x04 | (reg & 7) << 3);
+            emit_byte(scale_bits << 6 | index_bits << 3 | 5);
+            emit_imm32(rm);
+            return;
+        }
+
+        int mod = 2;
+        if (rm.symbol.empty() && rm.value == 0 && (rm.reg & 7) != 5) {
+            mod = 0;
+        } else if (rm.symbol.empty() && fits_int8(rm.value)) {
+            mod = 1;
+        }
+
+        //rsp and r12 as a base can only be encoded with a SIB byte
+        const bool sib = rm.index >= 0 || (rm.reg & 7) == 4;
+        emit_byte(mod << 6 | (reg & 7) << 3 | (sib ? 4 : rm.reg & 7));
+        if (sib) emit_byte(scale_bits << 6 | index_bits << 3 | (rm.reg & 7));
+
+        if (mod == 1) {
+            emit_byte(rm.value);
+        } else if (mod == 2) {
+            emit_imm32(rm);
+        }
+    }
+
+    static bool needs_rex_for_byte(const X86Operand &op) {
+        return op.kind == X86Operand::Kind::reg && op.size == 1 && op.reg >= 4 && op.reg < 8;
+    }
+
+    static uint8_t rex_bits(const int reg, const X86Operand &rm) {
+        uint8_t bits = (reg & 8) ? 0x4 : 0;
+        if (rm.kind == X86Operand::Kind::mem) {
+            if (rm.index >= 0 && (rm.index & 8)) bits |= 0x2;
+            if (rm.reg >= 0 && (rm.reg & 8)) bits |= 0x1;
+        } else if (rm.reg & 8) {
+            bits |= 0x1;
+        }
+        return bits;
+    }
+
+    //[prefix] [REX] opcode ModRM..., force_rex for spl, bpl, sil and dil
+    void emit_op(const uint8_t prefix, const bool wide, const std::vector<uint8_t> &opcode, const int reg,
+                 const X86Operand &rm, const bool force_rex = false) {
+        if (prefix != 0) emit_byte(prefix);
+
+        const uint8_t rex = 0x40 | (wide ? 0x8 : 0) | rex_bits(reg, rm);
+        if (rex != 0x40 || force_rex || needs_rex_for_byte(rm)) emit_byte(rex);
+
+        for (const uint8_t byte: opcode) {
+            emit_byte(byte);
+        }
+        emit_modrm(reg, rm);
+    }
+
+    //Instructions with the register in the low bits of the opcode
+    void emit_op_reg(const bool wide, const uint8_t opcode, const X86Operand &reg) {
+        const uint8_t rex = 0x40 | (wide ? 0x8 : 0) | ((reg.reg & 8) ? 0x1 : 0);
+        if (rex != 0x40 || needs_rex_for_byte(reg)) emit_byte(rex);
+        emit_byte(opcode + (reg.reg & 7));
+    }
+
+    void emit_vex(const uint8_t prefix, const int map, const bool wide, const int size, const int reg, const int vvvv,
+                  const X86Operand &rm, const uint8_t opcode) {
+        const int pp = prefix == 0x66 ? 1 : prefix == 0xF3 ? 2 : prefix == 0xF2 ? 3 : 0;
+        const uint8_t bits = rex_bits(reg, rm);
+        const int length = size == 32 ? 1 : 0;
+
+        //The fields are stored inverted
+        if (map == 1 && !wide && (bits & 0x3) == 0) {
+            emit_byte(0xC5);
+            emit_byte((bits & 0x4 ? 0 : 0x80) | (~vvvv & 0xF) << 3 | length << 2 | pp);
+        } else {
+            emit_byte(0xC4);
+            emit_byte((~bits & 0x7) << 5 | map);
+            emit_byte((wide ? 0x80 : 0) | (~vvvv & 0xF) << 3 | length << 2 | pp);
+        }
+        emit_byte(opcode);
+        emit_modrm(reg, rm);
+    }
+
+    static std::vector<uint8_t> map_opcode(const int map, const uint8_t opcode) {
+        switch (map) {
+            case 2:
+                return {0x0F, 0x38, opcode};
+            case 3:
+                return {0x0F, 0x3A, opcode};
+            default:
+                return {0x0F, opcode};
+        }
+    }
+
+    void encode_instruction(const AsmInstruction &instr) {
+        const std::string &name = instr.opcode;
+
+        std::vector<X86Operand> ops;
+        for (const std::string &operand: instr.operands) {
+            ops.push_back(parse_operand(operand));
+        }
+
+        const auto expect = [&](const size_t count) {
+            if (ops.size() != count) error("Nieprawidłowa liczba operandów instrukcji '" + name + "'");
+        };
+
+        if (section == Section::bss) {
+            expect(1);
+            if (name == "resb") {
+                out().resize(out().size() + ops[0].value);
+            } else if (name == "resq") {
+                out().resize(out().size() + ops[0].value * 8);
+            } else {
+                error("Sekcja .bss może jedynie rezerwować pamięć, a nie '" + name + "'");
+            }
+            return;
+        }
+
+        if (name == "db") {
+            for (const X86Operand &op: ops) {
+                emit_byte(op.value);
+            }
+        } else if (name == "dq") {
+            for (const X86Operand &op: ops) {
+                if (!op.symbol.empty()) {
+                    object.relocations.push_back({Relocation::Kind::absolute64, section, out().size(), op.symbol,
+                                                  op.value});
+                }
+                emit_bytes(op.symbol.empty() ? op.value : 0, 8);
+            }
+        } else if (name == "mov") {
+            expect(2);
+            encode_mov(ops[0], ops[1]);
+        } else if (alu_ops.contains(name)) {
+            expect(2);
+            encode_alu(alu_ops.at(name), ops[0], ops[1]);
+        } else if (name == "test") {
+            expect(2);
+            emit_op(0, ops[1].size == 8, {static_cast<uint8_t>(ops[1].size == 1 ? 0x84 : 0x85)}, ops[1].reg, ops[0],
+                    needs_rex_for_byte(ops[1]));
+        } else if (name == "lea") {
+            expect(2);
+            emit_op(0, true, {0x8D}, ops[0].reg, ops[1]);
+        } else if (name == "imul") {
+            encode_imul(ops);
+        } else if (unary_ops.contains(name)) {
+            expect(1);
+            const auto [opcode, digit] = unary_ops.at(name);
+            emit_op(0, true, {opcode}, digit, ops[0]);
+        } else if (shift_ops.contains(name)) {
+            expect(2);
+            if (ops[1].kind == X86Operand::Kind::reg) {
+                emit_op(0, true, {0xD3}, shift_ops.at(name), ops[0]);
+            } else {
+                emit_op(0, true, {0xC1}, shift_ops.at(name), ops[0]);
+                emit_byte(ops[1].value);
+            }
+        } else if (bit_test_ops.contains(name)) {
+            expect(2);
+            const auto [digit, opcode] = bit_test_ops.at(name);
+            if (ops[1].kind == X86Operand::Kind::reg) {
+                emit_op(0, true, {0x0F, opcode}, ops[1].reg, ops[0]);
+            } else {
+                emit_op(0, true, {0x0F, 0xBA}, digit, ops[0]);
+                emit_byte(ops[1].value);
+            }
+        } else if (extend_ops.contains(name)) {
+            expect(2);
+            const auto [byte_opcode, word_opcode] = extend_ops.at(name);
+            emit_op(0, ops[0].size == 8, {0x0F, ops[1].size == 1 ? byte_opcode : word_opcode}, ops[0].reg, ops[1],
+                    needs_rex_for_byte(ops[1]));
+        } else if (name == "movsxd") {
+            expect(2);
+            emit_op(0, true, {0x63}, ops[0].reg, ops[1]);
+        } else if (name == "push") {
+            expect(1);
+            encode_push(ops[0]);
+        } else if (name == "pop") {
+            expect(1);
+            if (ops[0].kind == X86Operand::Kind::reg) {
+                emit_op_reg(false, 0x58, ops[0]);
+            } else {
+                emit_op(0, false, {0x8F}, 0, ops[0]);
+            }
+        } else if (name == "jmp" || name == "call") {
+            expect(1);
+            if (ops[0].kind == X86Operand::Kind::imm) {
+                emit_byte(name == "jmp" ? 0xE9 : 0xE8);
+                emit_rel32(ops[0].symbol);
+            } else {
+                emit_op(0, false, {0xFF}, name == "jmp" ? 4 : 2, ops[0]);
+            }
+        } else if (name.starts_with("j") && condition_codes.contains(name.substr(1))) {
+            expect(1);
+            emit_byte(0x0F);
+            emit_byte(0x80 | condition_codes.at(name.substr(1)));
+            emit_rel32(ops[0].symbol);
+        } else if (name.starts_with("set") && condition_codes.contains(name.substr(3))) {
+            expect(1);
+            emit_op(0, false, {0x0F, static_cast<uint8_t>(0x90 | condition_codes.at(name.substr(3)))}, 0, ops[0]);
+        } else if (name.starts_with("cmov") && condition_codes.contains(name.substr(4))) {
+            expect(2);
+            emit_op(0, true, {0x0F, static_cast<uint8_t>(0x40 | condition_codes.at(name.substr(4)))}, ops[0].reg,
+                    ops[1]);
+        } else if (name == "ret") {
+            emit_byte(0xC3);
+        } else if (name == "syscall") {
+            emit_byte(0x0F);
+            emit_byte(0x05);
+        } else {
+            encode_vector(name, ops);
+        }
+    }
+
+    //Words take the operand size prefix
+    static uint8_t size_prefix(const X86Operand &op) {
+        return op.size == 2 ? 0x66 : 0;
+    }
+
+    void encode_mov(const X86Operand &dest, const X86Operand &src) {
+        if (src.kind == X86Operand::Kind::reg) {
+            emit_op(size_prefix(src), src.size == 8, {static_cast<uint8_t>(src.size == 1 ? 0x88 : 0x89)}, src.reg,
+                    dest, needs_rex_for_byte(src));
+            return;
+        }
+        if (src.kind == X86Operand::Kind::mem) {
+            emit_op(size_prefix(dest), dest.size == 8, {static_cast<uint8_t>(dest.size == 1 ? 0x8A : 0x8B)},
+                    dest.reg, src, needs_rex_for_byte(dest));
+            return;
+        }
+
+        //Immediates
+        if (dest.size == 1) {
+            if (dest.kind == X86Operand::Kind::reg) {
+                emit_op_reg(false, 0xB0, dest);
+            } else {
+                emit_op(0, false, {0xC6}, 0, dest);
+            }
+            emit_byte(src.value);
+            return;
+        }
+
+        //Words and dwords in memory, the immediate is as wide as the store
+        if (dest.kind == X86Operand::Kind::mem && (dest.size == 2 || dest.size == 4)) {
+            emit_op(size_prefix(dest), false, {0xC7}, 0, dest);
+            emit_bytes(src.value, dest.size);
+            return;
+        }
+
+        if (dest.kind == X86Operand::Kind::reg && src.symbol.empty()) {
+            if (src.value >= 0 && src.value <= UINT32_MAX) {
+                //Writing the 32-bit register clears the upper half
+                emit_op_reg(false, 0xB8, dest);
+                emit_bytes(src.value, 4);
+                return;
+            }
+            if (!fits_int32(src.value)) {
+                emit_op_reg(true, 0xB8, dest);
+                emit_bytes(src.value, 8);
+                return;
+            }
+        }
+
+        //Sign extended from 32 bits
+        emit_op(0, true, {0xC7}, 0, dest);
+        emit_imm32(src);
+    }
+
+    void encode_alu(const int digit, const X86Operand &dest, const X86Operand &src) {
+        if (src.kind == X86Operand::Kind::reg) {
+            emit_op(0, src.size == 8, {static_cast<uint8_t>(digit * 8 + (src.size == 1 ? 0 : 1))}, src.reg, dest,
+                    needs_rex_for_byte(src));
+        } else if (src.kind == X86Operand::Kind::mem) {
+            emit_op(0, dest.size == 8, {static_cast<uint8_t>(digit * 8 + (dest.size == 1 ? 2 : 3))}, dest.reg, src,
+                    needs_rex_for_byte(dest));
+        } else if (dest.size == 1) {
+            emit_op(0, false, {0x80}, digit, dest);
+            emit_byte(src.value);
+        } else if (src.symbol.empty() && fits_int8(src.value)) {
+            emit_op(0, true, {0x83}, digit, dest);
+            emit_byte(src.value);
+        } else {
+            emit_op(0, true, {0x81}, digit, dest);
+            emit_imm32(src);
+        }
+    }
+
+    void encode_imul(const std::vector<X86Operand> &ops) {
+        if (ops.size() == 2 && ops[1].kind != X86Operand::Kind::imm) {
+            emit_op(0, true, {0x0F, 0xAF}, ops[0].reg, ops[1]);
+            return;
+        }
+        if (ops.size() != 2 && ops.size() != 3) error("Nieprawidłowa liczba operandów instrukcji 'imul'");
+
+        //imul reg, imm is imul reg, reg, imm
+        const X86Operand &src = ops.size() == 3 ? ops[1] : ops[0];
+        const X86Operand &imm = ops.back();
+        if (imm.symbol.empty() && fits_int8(imm.value)) {
+            emit_op(0, true, {0x6B}, ops[0].reg, src);
+            emit_byte(imm.value);
+        } else {
+            emit_op(0, true, {0x69}, ops[0].reg, src);
+            emit_imm32(imm);
+        }
+    }
+
+    void encode_push(const X86Operand &op) {
+        switch (op.kind) {
+            case X86Operand::Kind::reg:
+                emit_op_reg(false, 0x50, op);
+                break;
+            case X86Operand::Kind::mem:
+                emit_op(0, false, {0xFF}, 6, op);
+                break;
+            default:
+                if (op.symbol.empty() && fits_int8(op.value)) {
+                    emit_byte(0x6A);
+                    emit_byte(op.value);
+                } else {
+                    emit_byte(0x68);
+                    emit_imm32(op);
+                }
+        }
+    }
+
+    void encode_vector(const std::string &name, const std::vector<X86Operand> &ops) {
+        const bool avx = name.starts_with("v");
+        const std::string base = avx ? name.substr(1) : name;
+
+        if (vector_ops.contains(base)) {
+            const auto [prefix, map, opcode] = vector_ops.at(base);
+            if (avx) {
+                if (ops.size() != 3) error("Nieprawidłowa liczba operandów instrukcji '" + name + "'");
+                emit_vex(prefix, map, false, ops[0].size, ops[0].reg, ops[1].reg, ops[2], opcode);
+            } else {
+                if (ops.size() != 2) error("Nieprawidłowa liczba operandów instrukcji '" + name + "'");
+                emit_op(prefix, false, map_opcode(map, opcode), ops[0].reg, ops[1]);
+            }
+            return;
+        }
+
+        if (base == "movdqu" && ops.size() == 2) {
+            //Stores have the register in the middle field
+            const bool store = ops[0].kind == X86Operand::Kind::mem;
+            const X86Operand &reg = store ? ops[1] : ops[0];
+            const X86Operand &rm = store ? ops[0] : ops[1];
+            const uint8_t opcode = store ? 0x7F : 0x6F;
+
+            if (avx) {
+                emit_vex(0xF3, 1, false, reg.size, reg.reg, 0, rm, opcode);
+            } else {
+                emit_op(0xF3, false, {0x0F, opcode}, reg.reg, rm);
+            }
+        } else if (base == "movq" && ops.size() == 2) {
+            //The vector register is always in the middle field
+            const bool to_vector = ops[0].kind == X86Operand::Kind::vector_reg;
+            const X86Operand &vector = to_vector ? ops[0] : ops[1];
+            const X86Operand &rm = to_vector ? ops[1] : ops[0];
+            const uint8_t opcode = to_vector ? 0x6E : 0x7E;
+
+            if (avx) {
+                emit_vex(0x66, 1, true, 16, vector.reg, 0, rm, opcode);
+            } else {
+                emit_op(0x66, true, {0x0F, opcode}, vector.reg, rm);
+            }
+        } else if (base == "pshufd" && ops.size() == 3) {
+            if (avx) {
+                emit_vex(0x66, 1, false, ops[0].size, ops[0].reg, 0, ops[1], 0x70);
+            } else {
+                emit_op(0x66, false, {0x0F, 0x70}, ops[0].reg, ops[1]);
+            }
+            emit_byte(ops[2].value);
+        } else if (name == "vpbroadcastq" && ops.size() == 2) {
+            emit_vex(0x66, 2, false, ops[0].size, ops[0].reg, 0, ops[1], 0x59);
+        } else if (name == "vextracti128" && ops.size() == 3) {
+            emit_vex(0x66, 3, false, 32, ops[1].reg, 0, ops[0], 0x39);
+            emit_byte(ops[2].value);
+        } else if (name == "vblendvpd" && ops.size() == 4) {
+            //The fourth register is in the upper half of an immediate byte
+            emit_vex(0x66, 3, false, ops[0].size, ops[0].reg, ops[1].reg, ops[2], 0x4B);
+            emit_byte(ops[3].reg << 4);
+        } else if (name == "vzeroupper" && ops.empty()) {
+            emit_byte(0xC5);
+            emit_byte(0xF8);
+            emit_byte(0x77);
+        } else {
+            error("Nieobsługiwana instrukcja '" + name + "'");
+        }
+    }
+};
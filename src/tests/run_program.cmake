@@ -0,0 +1,74 @@
+# Compiles and runs a program with the given options, checking that it prints exactly what the .out file next to it
+# holds and exits with the expected code:
+#
+#   cmake -DCOMPILER=<pppjp> -DPROGRAM=<file.pppp> -DOPTIONS=<options> -DWORK_DIR=<dir> -P run_program.cmake
+#
+# Comments at the top of the program can add options for every mode and give the exit code:
+#
+#   # opcje: --bounds-check
+#   # kod wyjścia: 1
+#
+# A .in file next to the program is given to it as the input. The output is compared byte by byte, as printed
+# numbers can start with a zero byte.
+
+get_filename_component(name "${PROGRAM}" NAME_WE)
+get_filename_component(dir "${PROGRAM}" DIRECTORY)
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+file(COPY "${PROGRAM}" DESTINATION "${WORK_DIR}")
+
+set(expected_code 0)
+file(STRINGS "${PROGRAM}" directives ENCODING UTF-8 REGEX "^# ")
+foreach (directive IN LISTS directives)
+    if (directive MATCHES "^# opcje: (.*)$")
+        separate_arguments(options UNIX_COMMAND "${CMAKE_MATCH_1}")
+        list(APPEND OPTIONS ${options})
+    elseif (directive MATCHES "^# kod wyjścia: ([0-9]+)$")
+        set(expected_code ${CMAKE_MATCH_1})
+    endif ()
+endforeach ()
+
+set(input /dev/null)
+if (EXISTS "${dir}/${name}.in")
+    set(input "${dir}/${name}.in")
+endif ()
+
+execute_process(COMMAND "${COMPILER}" ${OPTIONS} "${WORK_DIR}/${name}.pppp"
+                WORKING_DIRECTORY "${WORK_DIR}"
+                INPUT_FILE "${input}"
+                OUTPUT_FILE "${WORK_DIR}/compiler.txt"
+                ERROR_VARIABLE errors
+                RESULT_VARIABLE code)
+file(READ "${WORK_DIR}/compiler.txt" compiler_output HEX)
+
+# Modes running the program inside the compiler print its output right after announcing it
+file(WRITE "${WORK_DIR}/marker.txt" "[INFO] Uruchamianie programu '${WORK_DIR}/${name}'...\n")
+file(READ "${WORK_DIR}/marker.txt" marker HEX)
+string(FIND "${compiler_output}" "${marker}" marker_at)
+
+if (marker_at GREATER_EQUAL 0)
+    string(LENGTH "${marker}" marker_length)
+    math(EXPR output_at "${marker_at} + ${marker_length}")
+    string(SUBSTRING "${compiler_output}" ${output_at} -1 output)
+else ()
+    if (NOT code EQUAL 0)
+        message(FATAL_ERROR "Compilation failed with ${code}:\n${errors}")
+    endif ()
+
+    execute_process(COMMAND "${WORK_DIR}/${name}"
+                    WORKING_DIRECTORY "${WORK_DIR}"
+                    INPUT_FILE "${input}"
+                    OUTPUT_FILE "${WORK_DIR}/output.txt"
+                    ERROR_VARIABLE errors
+                    RESULT_VARIABLE code)
+    file(READ "${WORK_DIR}/output.txt" output HEX)
+endif ()
+
+file(READ "${dir}/${name}.out" expected HEX)
+if (NOT output STREQUAL expected)
+    message(FATAL_ERROR "The output differs from ${dir}/${name}.out\nexpected: ${expected}\nprinted:  ${output}\n${errors}")
+endif ()
+if (NOT code STREQUAL expected_code)
+    message(FATAL_ERROR "Exited with ${code} instead of ${expected_code}\n${errors}")
+endif ()